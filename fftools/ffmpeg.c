@@ -166,6 +166,8 @@ static int restore_tty;
 
 #if HAVE_THREADS
 static void free_input_threads(void);
+static void free_encoder_thread(OutputStream *ost);
+static void free_chunk_encoders(OutputStream *ost);
 #endif
 
 /* sub2video hack:
@@ -580,6 +582,10 @@ static void ffmpeg_cleanup(int ret)
         av_dict_free(&ost->sws_dict);
         av_dict_free(&ost->swr_opts);
 
+#if HAVE_THREADS
+        free_encoder_thread(ost);
+        free_chunk_encoders(ost);
+#endif
         avcodec_free_context(&ost->enc_ctx);
         avcodec_parameters_free(&ost->ref_par);
 
@@ -883,6 +889,571 @@ finish:
     }
 }
 
+static int encoding_threaded(OutputStream *ost)
+{
+#if HAVE_THREADS
+    return ost->enc_frame_queue || ost->chunk_encoders;
+#else
+    return 0;
+#endif
+}
+
+#if HAVE_THREADS
+static void encoder_thread_progress(OutputStream *ost)
+{
+    pthread_mutex_lock(&ost->enc_mutex);
+    ost->enc_progress++;
+    pthread_cond_broadcast(&ost->enc_cond);
+    pthread_mutex_unlock(&ost->enc_mutex);
+}
+
+static void *encoder_thread(void *arg)
+{
+    OutputStream *ost = arg;
+    AVCodecContext *enc = ost->enc_ctx;
+    int ret;
+
+    while (1) {
+        AVFrame *frame;
+        int64_t frame_pts;
+
+        ret = av_thread_message_queue_recv(ost->enc_frame_queue, &frame, 0);
+        if (ret < 0)
+            break;
+        encoder_thread_progress(ost);
+
+        frame_pts = frame ? frame->pts : AV_NOPTS_VALUE;
+        ret = avcodec_send_frame(enc, frame);
+        av_frame_free(&frame);
+        if (ret < 0)
+            break;
+
+        while (1) {
+            AVPacket pkt;
+
+            av_init_packet(&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+
+            ret = avcodec_receive_packet(enc, &pkt);
+            if (ret == AVERROR(EAGAIN))
+                break;
+            if (ret < 0)
+                goto finish;
+
+            if (enc->codec_type == AVMEDIA_TYPE_VIDEO &&
+                pkt.pts == AV_NOPTS_VALUE && !(enc->codec->capabilities & AV_CODEC_CAP_DELAY))
+                pkt.pts = frame_pts;
+
+            /* if two pass, output log */
+            if (ost->logfile && enc->stats_out)
+                fprintf(ost->logfile, "%s", enc->stats_out);
+
+            ret = av_thread_message_queue_send(ost->enc_packet_queue, &pkt, 0);
+            if (ret < 0) {
+                av_packet_unref(&pkt);
+                goto finish;
+            }
+            encoder_thread_progress(ost);
+        }
+    }
+
+finish:
+    if (ret == AVERROR_EOF && ost->logfile && enc->stats_out)
+        fprintf(ost->logfile, "%s", enc->stats_out);
+    if (ret != AVERROR_EOF)
+        av_log(NULL, AV_LOG_ERROR, "Encoder thread for output stream #%d:%d failed: %s\n",
+               ost->file_index, ost->index, av_err2str(ret));
+    av_thread_message_queue_set_err_send(ost->enc_frame_queue, ret);
+    av_thread_message_queue_set_err_recv(ost->enc_packet_queue, ret);
+    encoder_thread_progress(ost);
+    return NULL;
+}
+
+/*
+ * Mux the packets the encoder thread has produced so far; with flush set,
+ * wait for the thread to drain the encoder completely.
+ * Returns the number of packets received.
+ */
+static int receive_encoder_thread_packets(OutputFile *of, OutputStream *ost, int flush)
+{
+    AVCodecContext *enc = ost->enc_ctx;
+    AVPacket pkt;
+    int ret, nb_packets = 0;
+
+    while ((ret = av_thread_message_queue_recv(ost->enc_packet_queue, &pkt,
+                                               flush ? 0 : AV_THREAD_MESSAGE_NONBLOCK)) >= 0) {
+        nb_packets++;
+        if (flush && (ost->finished & MUXER_FINISHED)) {
+            av_packet_unref(&pkt);
+            continue;
+        }
+
+        av_packet_rescale_ts(&pkt, enc->time_base, ost->mux_timebase);
+
+        if (debug_ts) {
+            av_log(NULL, AV_LOG_INFO, "encoder -> type:%s "
+                   "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
+                   av_get_media_type_string(enc->codec_type),
+                   av_ts2str(pkt.pts), av_ts2timestr(pkt.pts, &ost->mux_timebase),
+                   av_ts2str(pkt.dts), av_ts2timestr(pkt.dts, &ost->mux_timebase));
+        }
+
+        output_packet(of, &pkt, ost, 0);
+    }
+
+    if (ret == AVERROR_EOF) {
+        if (flush) {
+            av_init_packet(&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+            output_packet(of, &pkt, ost, 1);
+        }
+    } else if (ret != AVERROR(EAGAIN)) {
+        av_log(NULL, AV_LOG_FATAL, "%s encoding failed: %s\n",
+               av_get_media_type_string(enc->codec_type), av_err2str(ret));
+        exit_program(1);
+    }
+
+    return nb_packets;
+}
+
+/*
+ * Queue a new reference to frame for the encoder thread, NULL to flush.
+ * While the queue is full, the packets the thread is waiting to hand over
+ * are muxed so that it can make progress; without any such packet, wait for
+ * the thread to make progress.
+ */
+static int encoder_thread_send_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
+{
+    AVFrame *clone = NULL;
+    int ret;
+
+    if (frame && !(clone = av_frame_clone(frame)))
+        return AVERROR(ENOMEM);
+
+    while (1) {
+        int progress;
+
+        pthread_mutex_lock(&ost->enc_mutex);
+        progress = ost->enc_progress;
+        pthread_mutex_unlock(&ost->enc_mutex);
+
+        ret = av_thread_message_queue_send(ost->enc_frame_queue, &clone,
+                                           AV_THREAD_MESSAGE_NONBLOCK);
+        if (ret != AVERROR(EAGAIN))
+            break;
+        if (receive_encoder_thread_packets(of, ost, 0))
+            continue;
+
+        pthread_mutex_lock(&ost->enc_mutex);
+        while (ost->enc_progress == progress)
+            pthread_cond_wait(&ost->enc_cond, &ost->enc_mutex);
+        pthread_mutex_unlock(&ost->enc_mutex);
+    }
+    if (ret < 0) {
+        av_frame_free(&clone);
+        return ret;
+    }
+
+    if (frame)
+        receive_encoder_thread_packets(of, ost, 0);
+    return 0;
+}
+
+static void encoder_thread_free_frame(void *msg)
+{
+    av_frame_free(msg);
+}
+
+static void encoder_thread_free_packet(void *msg)
+{
+    av_packet_unref(msg);
+}
+
+static int init_encoder_thread(OutputStream *ost)
+{
+    AVCodecContext *enc = ost->enc_ctx;
+    int ret;
+
+    if (ost->enc_thread_queue_size <= 0 ||
+        (enc->codec_type != AVMEDIA_TYPE_VIDEO && enc->codec_type != AVMEDIA_TYPE_AUDIO))
+        return 0;
+    /* the statistics are read from the encoder context after every frame */
+    if (vstats_filename || (enc->flags & AV_CODEC_FLAG_PSNR)) {
+        av_log(NULL, AV_LOG_WARNING, "Encoder threads are not supported with "
+               "-vstats or -psnr, encoding output stream #%d:%d on the main thread\n",
+               ost->file_index, ost->index);
+        return 0;
+    }
+
+    ret = av_thread_message_queue_alloc(&ost->enc_frame_queue,
+                                        ost->enc_thread_queue_size, sizeof(AVFrame *));
+    if (ret < 0)
+        return ret;
+    av_thread_message_queue_set_free_func(ost->enc_frame_queue, encoder_thread_free_frame);
+
+    /* room for the packets of every queued frame, plus some reordering delay */
+    ret = av_thread_message_queue_alloc(&ost->enc_packet_queue,
+                                        ost->enc_thread_queue_size + 16, sizeof(AVPacket));
+    if (ret < 0)
+        goto fail;
+    av_thread_message_queue_set_free_func(ost->enc_packet_queue, encoder_thread_free_packet);
+
+    pthread_mutex_init(&ost->enc_mutex, NULL);
+    pthread_cond_init(&ost->enc_cond, NULL);
+    if ((ret = pthread_create(&ost->enc_thread, NULL, encoder_thread, ost))) {
+        av_log(NULL, AV_LOG_ERROR, "pthread_create failed: %s. Try to increase `ulimit -v` or decrease `ulimit -s`.\n", strerror(ret));
+        pthread_mutex_destroy(&ost->enc_mutex);
+        pthread_cond_destroy(&ost->enc_cond);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+
+    return 0;
+fail:
+    av_thread_message_queue_free(&ost->enc_packet_queue);
+    av_thread_message_queue_free(&ost->enc_frame_queue);
+    return ret;
+}
+
+static void free_encoder_thread(OutputStream *ost)
+{
+    if (!ost->enc_frame_queue)
+        return;
+
+    /* drop pending work and make the thread's blocking calls return */
+    av_thread_message_queue_set_err_recv(ost->enc_frame_queue, AVERROR_EOF);
+    av_thread_message_flush(ost->enc_frame_queue);
+    av_thread_message_queue_set_err_send(ost->enc_packet_queue, AVERROR_EOF);
+    av_thread_message_flush(ost->enc_packet_queue);
+
+    pthread_join(ost->enc_thread, NULL);
+    pthread_mutex_destroy(&ost->enc_mutex);
+    pthread_cond_destroy(&ost->enc_cond);
+    av_thread_message_queue_free(&ost->enc_frame_queue);
+    av_thread_message_queue_free(&ost->enc_packet_queue);
+}
+
+typedef struct ChunkPacket {
+    AVPacket pkt;
+    int end_of_chunk;
+} ChunkPacket;
+
+static void chunk_encoder_progress(ChunkEncoder *ce)
+{
+    OutputStream *ost = ce->ost;
+
+    pthread_mutex_lock(&ost->chunk_mutex);
+    ost->chunk_progress++;
+    pthread_cond_broadcast(&ost->chunk_cond);
+    pthread_mutex_unlock(&ost->chunk_mutex);
+}
+
+static void *chunk_encoder_thread(void *arg)
+{
+    ChunkEncoder *ce = arg;
+    AVCodecContext *enc = ce->enc;
+    int ret;
+
+    while (1) {
+        AVFrame *frame;
+
+        ret = av_thread_message_queue_recv(ce->frame_queue, &frame, 0);
+        if (ret < 0)
+            break;
+        chunk_encoder_progress(ce);
+
+        ret = avcodec_send_frame(enc, frame);
+        av_frame_free(&frame);
+        if (ret < 0)
+            break;
+
+        while (1) {
+            ChunkPacket cp = { .end_of_chunk = 0 };
+
+            av_init_packet(&cp.pkt);
+            cp.pkt.data = NULL;
+            cp.pkt.size = 0;
+
+            ret = avcodec_receive_packet(enc, &cp.pkt);
+            if (ret == AVERROR(EAGAIN))
+                break;
+            if (ret == AVERROR_EOF) {
+                /* the chunk is complete, the next one starts from scratch */
+                cp.end_of_chunk = 1;
+                ret = av_thread_message_queue_send(ce->packet_queue, &cp, 0);
+                chunk_encoder_progress(ce);
+                if (ret >= 0)
+                    ret = avcodec_reset(enc);
+                if (ret < 0)
+                    goto finish;
+                break;
+            }
+            if (ret < 0)
+                goto finish;
+
+            ret = av_thread_message_queue_send(ce->packet_queue, &cp, 0);
+            if (ret < 0) {
+                av_packet_unref(&cp.pkt);
+                goto finish;
+            }
+            chunk_encoder_progress(ce);
+        }
+    }
+
+finish:
+    if (ret != AVERROR_EOF)
+        av_log(NULL, AV_LOG_ERROR, "Chunk encoder thread failed: %s\n", av_err2str(ret));
+    av_thread_message_queue_set_err_send(ce->frame_queue, ret);
+    av_thread_message_queue_set_err_recv(ce->packet_queue, ret);
+    chunk_encoder_progress(ce);
+    return NULL;
+}
+
+/*
+ * Mux the packets of the chunks in order, as far as they have been encoded;
+ * with flush set, wait for all the chunks to be encoded.
+ * Returns the number of packets received.
+ */
+static int receive_chunk_packets(OutputFile *of, OutputStream *ost, int flush)
+{
+    AVCodecContext *enc = ost->enc_ctx;
+    int64_t nb_chunks = (ost->chunk_frames_sent + ost->enc_chunk_size - 1) / ost->enc_chunk_size;
+    int nb_packets = 0;
+
+    while (ost->chunk_muxed < nb_chunks) {
+        ChunkEncoder *ce = &ost->chunk_encoders[ost->chunk_muxed % ost->nb_chunk_encoders];
+        ChunkPacket cp;
+        int ret;
+
+        ret = av_thread_message_queue_recv(ce->packet_queue, &cp,
+                                           flush ? 0 : AV_THREAD_MESSAGE_NONBLOCK);
+        if (ret == AVERROR(EAGAIN))
+            break;
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_FATAL, "video encoding failed: %s\n", av_err2str(ret));
+            exit_program(1);
+        }
+        if (cp.end_of_chunk) {
+            ost->chunk_muxed++;
+            continue;
+        }
+
+        nb_packets++;
+        if (flush && (ost->finished & MUXER_FINISHED)) {
+            av_packet_unref(&cp.pkt);
+            continue;
+        }
+
+        av_packet_rescale_ts(&cp.pkt, enc->time_base, ost->mux_timebase);
+
+        if (debug_ts) {
+            av_log(NULL, AV_LOG_INFO, "encoder -> type:video "
+                   "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s\n",
+                   av_ts2str(cp.pkt.pts), av_ts2timestr(cp.pkt.pts, &ost->mux_timebase),
+                   av_ts2str(cp.pkt.dts), av_ts2timestr(cp.pkt.dts, &ost->mux_timebase));
+        }
+
+        output_packet(of, &cp.pkt, ost, 0);
+    }
+
+    if (flush) {
+        AVPacket pkt;
+
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+        output_packet(of, &pkt, ost, 1);
+    }
+
+    return nb_packets;
+}
+
+/*
+ * Queue a frame for a chunk encoder. While its queue is full, the packets
+ * of the chunk being muxed are muxed, so that the encoder of that chunk is
+ * never blocked on handing them over; without any such packet, wait for an
+ * encoder to make progress.
+ */
+static int chunk_encoder_send(OutputFile *of, OutputStream *ost, ChunkEncoder *ce,
+                              AVFrame **frame)
+{
+    while (1) {
+        int progress, ret;
+
+        pthread_mutex_lock(&ost->chunk_mutex);
+        progress = ost->chunk_progress;
+        pthread_mutex_unlock(&ost->chunk_mutex);
+
+        ret = av_thread_message_queue_send(ce->frame_queue, frame,
+                                           AV_THREAD_MESSAGE_NONBLOCK);
+        if (ret != AVERROR(EAGAIN))
+            return ret;
+        if (receive_chunk_packets(of, ost, 0))
+            continue;
+
+        pthread_mutex_lock(&ost->chunk_mutex);
+        while (ost->chunk_progress == progress)
+            pthread_cond_wait(&ost->chunk_cond, &ost->chunk_mutex);
+        pthread_mutex_unlock(&ost->chunk_mutex);
+    }
+}
+
+/*
+ * Queue a new reference to frame for the encoder instance of the current
+ * chunk, NULL to flush. The instance is flushed at the end of every chunk.
+ */
+static int chunk_encoders_send_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
+{
+    ChunkEncoder *ce = &ost->chunk_encoders[(ost->chunk_frames_sent / ost->enc_chunk_size) %
+                                            ost->nb_chunk_encoders];
+    AVFrame *msg = NULL;
+    int ret, end_of_chunk;
+
+    if (frame) {
+        if (!(msg = av_frame_clone(frame)))
+            return AVERROR(ENOMEM);
+        if ((ret = chunk_encoder_send(of, ost, ce, &msg)) < 0) {
+            av_frame_free(&msg);
+            return ret;
+        }
+        ost->chunk_frames_sent++;
+        end_of_chunk = !(ost->chunk_frames_sent % ost->enc_chunk_size);
+    } else {
+        end_of_chunk = !!(ost->chunk_frames_sent % ost->enc_chunk_size);
+    }
+
+    if (end_of_chunk) {
+        msg = NULL;
+        if ((ret = chunk_encoder_send(of, ost, ce, &msg)) < 0)
+            return ret;
+    }
+
+    if (frame)
+        receive_chunk_packets(of, ost, 0);
+    return 0;
+}
+
+/*
+ * Create the additional encoder instances for chunked encoding. Must be
+ * called before the main encoder context is opened, so that its settings
+ * can be copied.
+ */
+static int init_chunk_encoders(OutputStream *ost)
+{
+    AVCodecContext *enc = ost->enc_ctx;
+    int i, ret;
+
+    if (ost->enc_chunks <= 1 || enc->codec_type != AVMEDIA_TYPE_VIDEO)
+        return 0;
+    if (vstats_filename || (enc->flags & (AV_CODEC_FLAG_PSNR | AV_CODEC_FLAG_PASS1 |
+                                          AV_CODEC_FLAG_PASS2)) ||
+        enc->hw_frames_ctx || enc->rc_override_count ||
+        enc->intra_matrix || enc->inter_matrix || enc->chroma_intra_matrix) {
+        av_log(NULL, AV_LOG_WARNING, "Chunked encoding is not supported with "
+               "these encoder settings, encoding output stream #%d:%d as a whole\n",
+               ost->file_index, ost->index);
+        return 0;
+    }
+
+    ost->chunk_encoders = av_mallocz_array(ost->enc_chunks, sizeof(*ost->chunk_encoders));
+    if (!ost->chunk_encoders)
+        return AVERROR(ENOMEM);
+    ost->nb_chunk_encoders = ost->enc_chunks;
+    pthread_mutex_init(&ost->chunk_mutex, NULL);
+    pthread_cond_init(&ost->chunk_cond, NULL);
+
+    for (i = 0; i < ost->nb_chunk_encoders; i++) {
+        ChunkEncoder *ce = &ost->chunk_encoders[i];
+        AVDictionary *opts = NULL;
+
+        ce->ost = ost;
+
+        /* every queue holds a whole chunk, so that the next chunks can be
+         * sent to the other instances while this one is encoding */
+        ret = av_thread_message_queue_alloc(&ce->frame_queue, ost->enc_chunk_size + 1,
+                                            sizeof(AVFrame *));
+        if (ret < 0)
+            return ret;
+        av_thread_message_queue_set_free_func(ce->frame_queue, encoder_thread_free_frame);
+
+        ret = av_thread_message_queue_alloc(&ce->packet_queue, ost->enc_chunk_size + 16,
+                                            sizeof(ChunkPacket));
+        if (ret < 0)
+            return ret;
+        av_thread_message_queue_set_free_func(ce->packet_queue, encoder_thread_free_packet);
+
+        if (!i) {
+            ce->enc = enc;
+            continue;
+        }
+
+        ce->enc = avcodec_alloc_context3(ost->enc);
+        if (!ce->enc)
+            return AVERROR(ENOMEM);
+        ret = av_opt_copy(ce->enc, enc);
+        if (ret < 0)
+            return ret;
+        ce->enc->framerate = enc->framerate;
+
+        ret = av_dict_copy(&opts, ost->encoder_opts, 0);
+        if (ret >= 0)
+            ret = avcodec_open2(ce->enc, ost->enc, &opts);
+        av_dict_free(&opts);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+static int start_chunk_encoders(OutputStream *ost)
+{
+    int i, ret;
+
+    for (i = 0; i < ost->nb_chunk_encoders; i++) {
+        ChunkEncoder *ce = &ost->chunk_encoders[i];
+
+        if ((ret = pthread_create(&ce->thread, NULL, chunk_encoder_thread, ce))) {
+            av_log(NULL, AV_LOG_ERROR, "pthread_create failed: %s. Try to increase `ulimit -v` or decrease `ulimit -s`.\n", strerror(ret));
+            return AVERROR(ret);
+        }
+        ce->thread_started = 1;
+    }
+
+    return 0;
+}
+
+static void free_chunk_encoders(OutputStream *ost)
+{
+    int i;
+
+    for (i = 0; i < ost->nb_chunk_encoders; i++) {
+        ChunkEncoder *ce = &ost->chunk_encoders[i];
+
+        if (ce->thread_started) {
+            /* drop pending work and make the thread's blocking calls return */
+            av_thread_message_queue_set_err_recv(ce->frame_queue, AVERROR_EOF);
+            av_thread_message_flush(ce->frame_queue);
+            av_thread_message_queue_set_err_send(ce->packet_queue, AVERROR_EOF);
+            av_thread_message_flush(ce->packet_queue);
+            pthread_join(ce->thread, NULL);
+        }
+        av_thread_message_queue_free(&ce->frame_queue);
+        av_thread_message_queue_free(&ce->packet_queue);
+        if (i)
+            avcodec_free_context(&ce->enc);
+    }
+    if (ost->chunk_encoders) {
+        pthread_mutex_destroy(&ost->chunk_mutex);
+        pthread_cond_destroy(&ost->chunk_cond);
+    }
+    av_freep(&ost->chunk_encoders);
+    ost->nb_chunk_encoders = 0;
+}
+#endif
+
 static int check_recording_time(OutputStream *ost)
 {
     OutputFile *of = output_files[ost->file_index];
@@ -925,6 +1496,14 @@ static void do_audio_out(OutputFile *of, OutputStream *ost,
                enc->time_base.num, enc->time_base.den);
     }
 
+#if HAVE_THREADS
+    if (ost->enc_frame_queue) {
+        if (encoder_thread_send_frame(of, ost, frame) < 0)
+            goto error;
+        return;
+    }
+#endif
+
     ret = avcodec_send_frame(enc, frame);
     if (ret < 0)
         goto error;
@@ -1274,13 +1853,20 @@ static void do_video_out(OutputFile *of,
 
         ost->frames_encoded++;
 
+#if HAVE_THREADS
+        if (ost->chunk_encoders)
+            ret = chunk_encoders_send_frame(of, ost, in_picture);
+        else if (ost->enc_frame_queue)
+            ret = encoder_thread_send_frame(of, ost, in_picture);
+        else
+#endif
         ret = avcodec_send_frame(enc, in_picture);
         if (ret < 0)
             goto error;
         // Make sure Closed Captions will not be duplicated
         av_frame_remove_side_data(in_picture, AV_FRAME_DATA_A53_CC);
 
-        while (1) {
+        while (!encoding_threaded(ost)) {
             ret = avcodec_receive_packet(enc, &pkt);
             update_benchmark("encode_video %d.%d", ost->file_index, ost->index);
             if (ret == AVERROR(EAGAIN))
@@ -1896,6 +2482,27 @@ static void flush_encoders(void)
         if (enc->codec_type != AVMEDIA_TYPE_VIDEO && enc->codec_type != AVMEDIA_TYPE_AUDIO)
             continue;
 
+#if HAVE_THREADS
+        if (ost->chunk_encoders) {
+            if ((ret = chunk_encoders_send_frame(of, ost, NULL)) < 0) {
+                av_log(NULL, AV_LOG_FATAL, "Flushing the chunk encoders failed: %s\n",
+                       av_err2str(ret));
+                exit_program(1);
+            }
+            receive_chunk_packets(of, ost, 1);
+            continue;
+        }
+        if (ost->enc_frame_queue) {
+            if ((ret = encoder_thread_send_frame(of, ost, NULL)) < 0) {
+                av_log(NULL, AV_LOG_FATAL, "Flushing the encoder thread failed: %s\n",
+                       av_err2str(ret));
+                exit_program(1);
+            }
+            receive_encoder_thread_packets(of, ost, 1);
+            continue;
+        }
+#endif
+
         for (;;) {
             const char *desc = NULL;
             AVPacket pkt;
@@ -3473,6 +4080,15 @@ static int init_output_stream(OutputStream *ost, char *error, int error_len)
             }
         }
 
+#if HAVE_THREADS
+        if ((ret = init_chunk_encoders(ost)) < 0) {
+            snprintf(error, error_len,
+                     "Error opening the chunk encoders for output stream #%d:%d",
+                     ost->file_index, ost->index);
+            return ret;
+        }
+#endif
+
         if ((ret = avcodec_open2(ost->enc_ctx, codec, &ost->encoder_opts)) < 0) {
             if (ret == AVERROR_EXPERIMENTAL)
                 abort_codec_experimental(codec, 1);
@@ -3487,6 +4103,21 @@ static int init_output_stream(OutputStream *ost, char *error, int error_len)
             av_buffersink_set_frame_size(ost->filter->filter,
                                             ost->enc_ctx->frame_size);
         assert_avoptions(ost->encoder_opts);
+#if HAVE_THREADS
+        if (ost->chunk_encoders) {
+            if ((ret = start_chunk_encoders(ost)) < 0) {
+                snprintf(error, error_len,
+                         "Error starting the chunk encoders for output stream #%d:%d",
+                         ost->file_index, ost->index);
+                return ret;
+            }
+        } else if ((ret = init_encoder_thread(ost)) < 0) {
+            snprintf(error, error_len,
+                     "Error starting the encoder thread for output stream #%d:%d",
+                     ost->file_index, ost->index);
+            return ret;
+        }
+#endif
         if (ost->enc_ctx->bit_rate && ost->enc_ctx->bit_rate < 1000 &&
             ost->enc_ctx->codec_id != AV_CODEC_ID_CODEC2 /* don't complain about 700 bit/s modes */)
             av_log(NULL, AV_LOG_WARNING, "The bitrate parameter is set too low."
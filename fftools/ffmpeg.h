@@ -215,6 +215,12 @@ typedef struct OptionsContext {
     int        nb_passlogfiles;
     SpecifierOpt *max_muxing_queue_size;
     int        nb_max_muxing_queue_size;
+    SpecifierOpt *enc_thread_queue_size;
+    int        nb_enc_thread_queue_size;
+    SpecifierOpt *enc_chunks;
+    int        nb_enc_chunks;
+    SpecifierOpt *enc_chunk_size;
+    int        nb_enc_chunk_size;
     SpecifierOpt *guess_layout_max;
     int        nb_guess_layout_max;
     SpecifierOpt *apad;
@@ -442,6 +448,18 @@ typedef enum {
     MUXER_FINISHED = 2,
 } OSTFinished ;
 
+#if HAVE_THREADS
+/* an encoder instance encoding every enc_chunks-th chunk of a stream */
+typedef struct ChunkEncoder {
+    AVCodecContext *enc;
+    AVThreadMessageQueue *frame_queue;  /* frames to encode, NULL ends a chunk */
+    AVThreadMessageQueue *packet_queue; /* encoded packets and chunk ends */
+    pthread_t thread;
+    int thread_started;
+    struct OutputStream *ost;
+} ChunkEncoder;
+#endif
+
 typedef struct OutputStream {
     int file_index;          /* file index */
     int index;               /* stream index in the output file */
@@ -547,6 +565,34 @@ typedef struct OutputStream {
     /* the packets are buffered here until the muxer is ready to be initialized */
     AVFifoBuffer *muxing_queue;
 
+    /* maximum number of frames queued for the encoder thread, 0 to encode
+     * on the main thread */
+    int enc_thread_queue_size;
+#if HAVE_THREADS
+    AVThreadMessageQueue *enc_frame_queue;  /* frames to encode, NULL to flush */
+    AVThreadMessageQueue *enc_packet_queue; /* encoded packets to be muxed */
+    pthread_t enc_thread;                   /* thread running the encoder */
+    /* signalled when the encoder thread takes a frame or hands over a packet */
+    pthread_mutex_t enc_mutex;
+    pthread_cond_t  enc_cond;
+    int             enc_progress;
+#endif
+
+    /* number of encoder instances encoding chunks of enc_chunk_size frames
+     * in parallel, 0 to encode the stream with a single encoder */
+    int enc_chunks;
+    int enc_chunk_size;
+#if HAVE_THREADS
+    ChunkEncoder *chunk_encoders;
+    int        nb_chunk_encoders;
+    int64_t chunk_frames_sent;  /* frames sent to the chunk encoders */
+    int64_t chunk_muxed;        /* index of the chunk whose packets are muxed */
+    /* signalled when a chunk encoder takes a frame or hands over a packet */
+    pthread_mutex_t chunk_mutex;
+    pthread_cond_t  chunk_cond;
+    int             chunk_progress;
+#endif
+
     /* packet picture type */
     int pict_type;
 
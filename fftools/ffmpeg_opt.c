@@ -87,6 +87,9 @@ static const char *opt_name_canvas_sizes[]              = {"canvas_size", NULL};
 static const char *opt_name_pass[]                      = {"pass", NULL};
 static const char *opt_name_passlogfiles[]              = {"passlogfile", NULL};
 static const char *opt_name_max_muxing_queue_size[]     = {"max_muxing_queue_size", NULL};
+static const char *opt_name_enc_thread_queue_size[]     = {"enc_thread_queue_size", NULL};
+static const char *opt_name_enc_chunks[]                = {"enc_chunks", NULL};
+static const char *opt_name_enc_chunk_size[]            = {"enc_chunk_size", NULL};
 static const char *opt_name_guess_layout_max[]          = {"guess_layout_max", NULL};
 static const char *opt_name_apad[]                      = {"apad", NULL};
 static const char *opt_name_discard[]                   = {"discard", NULL};
@@ -1563,6 +1566,16 @@ static OutputStream *new_output_stream(OptionsContext *o, AVFormatContext *oc, e
     MATCH_PER_STREAM_OPT(max_muxing_queue_size, i, ost->max_muxing_queue_size, oc, st);
     ost->max_muxing_queue_size *= sizeof(AVPacket);
 
+    MATCH_PER_STREAM_OPT(enc_thread_queue_size, i, ost->enc_thread_queue_size, oc, st);
+
+    MATCH_PER_STREAM_OPT(enc_chunks, i, ost->enc_chunks, oc, st);
+    ost->enc_chunk_size = 250;
+    MATCH_PER_STREAM_OPT(enc_chunk_size, i, ost->enc_chunk_size, oc, st);
+    if (ost->enc_chunk_size <= 0) {
+        av_log(NULL, AV_LOG_FATAL, "Invalid encoder chunk size %d\n", ost->enc_chunk_size);
+        exit_program(1);
+    }
+
     if (oc->oformat->flags & AVFMT_GLOBALHEADER)
         ost->enc_ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
@@ -3757,6 +3770,12 @@ const OptionDef options[] = {
 
     { "max_muxing_queue_size", HAS_ARG | OPT_INT | OPT_SPEC | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(max_muxing_queue_size) },
         "maximum number of packets that can be buffered while waiting for all streams to initialize", "packets" },
+    { "enc_thread_queue_size", HAS_ARG | OPT_INT | OPT_SPEC | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(enc_thread_queue_size) },
+        "run the encoder on its own thread, queueing up to this many frames for it", "frames" },
+    { "enc_chunks", HAS_ARG | OPT_INT | OPT_SPEC | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(enc_chunks) },
+        "encode video in chunks on this many parallel encoder instances", "number" },
+    { "enc_chunk_size", HAS_ARG | OPT_INT | OPT_SPEC | OPT_EXPERT | OPT_OUTPUT, { .off = OFFSET(enc_chunk_size) },
+        "set the number of frames of each chunk encoded with -enc_chunks", "frames" },
 
     /* data codec support */
     { "dcodec", HAS_ARG | OPT_DATA | OPT_PERFILE | OPT_EXPERT | OPT_INPUT | OPT_OUTPUT, { .func_arg = opt_data_codec },
@@ -3929,6 +3929,29 @@ int avcodec_fill_audio_frame(AVFrame *frame, int nb_channels,
  */
 void avcodec_flush_buffers(AVCodecContext *avctx);
 
+/**
+ * Reset an opened codec context to the state of a freshly opened one, so that
+ * it can be reused for a new, unrelated stream without paying the full cost of
+ * avcodec_close() and avcodec_open2(). Worker threads, the frame pool and the
+ * codec options are kept.
+ *
+ * Before calling this function, the caller may update the same fields it would
+ * set before avcodec_open2(), e.g. the dimensions, time base or extradata. The
+ * codec is then re-initialized with these values.
+ *
+ * @note for encoders, extradata and coded_side_data are regenerated, as is
+ *       frame_size for audio encoders: a frame size requested by the caller
+ *       must be set again before calling this function.
+ *
+ * @param avctx an opened codec context
+ * @return 0 on success, a negative AVERROR code on failure. AVERROR(ENOSYS) is
+ *         returned, with the context left untouched, for codecs running with
+ *         frame threading. After any other failure, the context still reports
+ *         being open but cannot be used anymore: it must be freed with
+ *         avcodec_free_context() (or closed with avcodec_close()).
+ */
+int avcodec_reset(AVCodecContext *avctx);
+
 /**
  * Return codec bits per sample.
  *
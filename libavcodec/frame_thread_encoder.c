@@ -41,6 +41,20 @@ typedef struct{
     unsigned index;
 } Task;
 
+/**
+ * A closed GOP, encoded by a single thread when encoding GOPs independently.
+ */
+typedef struct{
+    AVFrame **frames;
+    int nb_frames;
+    int64_t frame_offset;   ///< number of frames preceding the GOP
+    int64_t prev_pts;       ///< pts of the last frame preceding the GOP
+
+    AVPacket **pkts;
+    int nb_pkts;
+    int pkt_index;          ///< next packet to return
+} GOPChunk;
+
 typedef struct{
     AVCodecContext *parent_avctx;
     pthread_mutex_t buffer_mutex;
@@ -58,8 +72,76 @@ typedef struct{
 
     pthread_t worker[MAX_THREADS];
     atomic_int exit;
+
+    int gop_size;           ///< frames per task when encoding GOPs independently, 0 otherwise
+    GOPChunk *chunk;        ///< GOP being filled with input frames
+    int64_t nb_frames;      ///< number of input frames in GOP mode
+    int64_t last_pts;       ///< pts of the last input frame in GOP mode
 } ThreadContext;
 
+static void gop_chunk_free(GOPChunk **pchunk)
+{
+    GOPChunk *chunk = *pchunk;
+    int i;
+
+    if (!chunk)
+        return;
+    for (i = 0; i < chunk->nb_frames; i++)
+        av_frame_free(&chunk->frames[i]);
+    av_freep(&chunk->frames);
+    for (i = chunk->pkt_index; i < chunk->nb_pkts; i++)
+        av_packet_free(&chunk->pkts[i]);
+    av_freep(&chunk->pkts);
+    av_freep(pchunk);
+}
+
+/**
+ * Encode a GOP from the initial encoder state and drain the encoder.
+ */
+static int encode_gop(AVCodecContext *avctx, GOPChunk *chunk)
+{
+    int i, ret;
+
+    /* Only the first GOP can use the encoder as opened */
+    if (chunk->frame_offset) {
+        avctx->internal->gop_frame_offset = chunk->frame_offset;
+        ret = avcodec_reset(avctx);
+        if (ret < 0)
+            return ret;
+    }
+
+    for (i = 0; i <= chunk->nb_frames; i++) {
+        AVFrame *frame = i < chunk->nb_frames ? chunk->frames[i] : NULL;
+
+        do {
+            int got_packet = 0;
+            AVPacket *pkt = av_packet_alloc();
+            if (!pkt)
+                return AVERROR(ENOMEM);
+
+            ret = avctx->codec->encode2(avctx, pkt, frame, &got_packet);
+            if (ret >= 0 && got_packet)
+                ret = av_packet_make_refcounted(pkt);
+            if (ret >= 0 && got_packet)
+                ret = av_dynarray_add_nofree(&chunk->pkts, &chunk->nb_pkts, pkt);
+            if (ret < 0 || !got_packet) {
+                av_packet_free(&pkt);
+                if (ret < 0)
+                    return ret;
+                break;
+            }
+        } while (!frame);
+    }
+
+    /* Without B-frames, a delayed encoder gives its first packet the pts of
+     * the previous frame as dts, which a reset encoder does not know */
+    if (chunk->frame_offset && chunk->nb_pkts && avctx->has_b_frames &&
+        chunk->prev_pts != AV_NOPTS_VALUE)
+        chunk->pkts[0]->dts = chunk->prev_pts;
+
+    return 0;
+}
+
 static void * attribute_align_arg worker(void *v){
     AVCodecContext *avctx = v;
     ThreadContext *c = avctx->internal->frame_thread_encoder;
@@ -70,9 +152,11 @@ static void * attribute_align_arg worker(void *v){
         AVFrame *frame;
         Task task;
 
-        if(!pkt) pkt = av_packet_alloc();
-        if(!pkt) continue;
-        av_init_packet(pkt);
+        if (!c->gop_size) {
+            if(!pkt) pkt = av_packet_alloc();
+            if(!pkt) continue;
+            av_init_packet(pkt);
+        }
 
         pthread_mutex_lock(&c->task_fifo_mutex);
         while (av_fifo_size(c->task_fifo) <= 0 || atomic_load(&c->exit)) {
@@ -84,6 +168,24 @@ static void * attribute_align_arg worker(void *v){
         }
         av_fifo_generic_read(c->task_fifo, &task, sizeof(task), NULL);
         pthread_mutex_unlock(&c->task_fifo_mutex);
+
+        if (c->gop_size) {
+            GOPChunk *chunk = task.indata;
+            int i;
+
+            ret = encode_gop(avctx, chunk);
+            pthread_mutex_lock(&c->buffer_mutex);
+            for (i = 0; i < chunk->nb_frames; i++)
+                av_frame_unref(chunk->frames[i]);
+            pthread_mutex_unlock(&c->buffer_mutex);
+            pthread_mutex_lock(&c->finished_task_mutex);
+            c->finished_tasks[task.index].outdata = chunk;
+            c->finished_tasks[task.index].return_code = ret;
+            pthread_cond_signal(&c->finished_task_cond);
+            pthread_mutex_unlock(&c->finished_task_mutex);
+            continue;
+        }
+
         frame = task.indata;
 
         ret = avctx->codec->encode2(avctx, pkt, frame, &got_packet);
@@ -116,14 +218,32 @@ end:
 }
 
 int ff_frame_thread_encoder_init(AVCodecContext *avctx, AVDictionary *options){
-    int i=0;
+    int i=0, gop_size = 0;
     ThreadContext *c;
 
 
-    if(   !(avctx->thread_type & FF_THREAD_FRAME)
-       || !(avctx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS))
+    if (!(avctx->thread_type & FF_THREAD_FRAME))
         return 0;
 
+    /* Inter codecs are threaded by encoding closed GOPs without B-frames
+     * independently, each starting from a reset encoder. As this restarts
+     * rate control, it is only done with a constant quantizer, where the
+     * output does not change. */
+    if (!(avctx->codec->capabilities & AV_CODEC_CAP_FRAME_THREADS)) {
+        if (   !(avctx->codec->caps_internal & FF_CODEC_CAP_GOP_THREADS)
+            || !(avctx->flags & AV_CODEC_FLAG_CLOSED_GOP)
+            || avctx->gop_size <= 1 || avctx->max_b_frames
+            || avctx->flags & (AV_CODEC_FLAG_PASS1 | AV_CODEC_FLAG_PASS2))
+            return 0;
+        if (   !(avctx->flags & AV_CODEC_FLAG_QSCALE)
+            || avctx->rc_buffer_size || avctx->rc_max_rate) {
+            av_log(avctx, AV_LOG_VERBOSE, "Not encoding GOPs in parallel, "
+                   "this requires a constant quantizer without VBV\n");
+            return 0;
+        }
+        gop_size = avctx->gop_size;
+    }
+
     if(   !avctx->thread_count
        && avctx->codec_id == AV_CODEC_ID_MJPEG
        && !(avctx->flags & AV_CODEC_FLAG_QSCALE)) {
@@ -180,6 +300,7 @@ int ff_frame_thread_encoder_init(AVCodecContext *avctx, AVDictionary *options){
         return AVERROR(ENOMEM);
 
     c->parent_avctx = avctx;
+    c->gop_size     = gop_size;
 
     c->task_fifo = av_fifo_alloc_array(BUFFER_SIZE, sizeof(Task));
     if(!c->task_fifo)
@@ -230,6 +351,11 @@ int ff_frame_thread_encoder_init(AVCodecContext *avctx, AVDictionary *options){
         }
     }
 
+    if (gop_size)
+        av_log(avctx, AV_LOG_VERBOSE,
+               "Encoding GOPs of %d frames independently with %d threads\n",
+               gop_size, avctx->thread_count);
+
     avctx->active_thread_type = FF_THREAD_FRAME;
 
     return 0;
@@ -257,13 +383,23 @@ void ff_frame_thread_encoder_free(AVCodecContext *avctx){
         Task task;
         AVFrame *frame;
         av_fifo_generic_read(c->task_fifo, &task, sizeof(task), NULL);
+        if (c->gop_size) {
+            GOPChunk *chunk = task.indata;
+            gop_chunk_free(&chunk);
+            continue;
+        }
         frame = task.indata;
         av_frame_free(&frame);
         task.indata = NULL;
     }
+    gop_chunk_free(&c->chunk);
 
     for (i=0; i<BUFFER_SIZE; i++) {
-        if (c->finished_tasks[i].outdata != NULL) {
+        if (c->gop_size) {
+            GOPChunk *chunk = c->finished_tasks[i].outdata;
+            gop_chunk_free(&chunk);
+            c->finished_tasks[i].outdata = NULL;
+        } else if (c->finished_tasks[i].outdata != NULL) {
             AVPacket *pkt = c->finished_tasks[i].outdata;
             av_packet_free(&pkt);
             c->finished_tasks[i].outdata = NULL;
@@ -279,6 +415,105 @@ void ff_frame_thread_encoder_free(AVCodecContext *avctx){
     av_freep(&avctx->internal->frame_thread_encoder);
 }
 
+static void submit_gop(ThreadContext *c)
+{
+    Task task;
+
+    task.index  = c->task_index;
+    task.indata = c->chunk;
+    c->chunk    = NULL;
+    pthread_mutex_lock(&c->task_fifo_mutex);
+    av_fifo_generic_write(c->task_fifo, &task, sizeof(task), NULL);
+    pthread_cond_signal(&c->task_fifo_cond);
+    pthread_mutex_unlock(&c->task_fifo_mutex);
+
+    c->task_index = (c->task_index+1) % BUFFER_SIZE;
+}
+
+/**
+ * Collect the input frames into GOPs and return the packets of the finished
+ * GOPs in order, one per call.
+ */
+static int encode_frame_gop(AVCodecContext *avctx, AVPacket *pkt,
+                            const AVFrame *frame, int *got_packet_ptr)
+{
+    ThreadContext *c = avctx->internal->frame_thread_encoder;
+    GOPChunk *chunk;
+    int ret;
+
+    if (frame) {
+        AVFrame *new;
+
+        if (!c->chunk) {
+            c->chunk = av_mallocz(sizeof(*c->chunk));
+            if (!c->chunk)
+                return AVERROR(ENOMEM);
+            c->chunk->frame_offset = c->nb_frames;
+            c->chunk->prev_pts     = c->last_pts;
+        }
+        new = av_frame_alloc();
+        if (!new)
+            return AVERROR(ENOMEM);
+        ret = av_frame_ref(new, frame);
+        if (ret >= 0)
+            ret = av_dynarray_add_nofree(&c->chunk->frames, &c->chunk->nb_frames, new);
+        if (ret < 0) {
+            av_frame_free(&new);
+            return ret;
+        }
+        c->nb_frames++;
+        c->last_pts = frame->pts;
+
+        if (c->chunk->nb_frames == c->gop_size)
+            submit_gop(c);
+    } else if (c->chunk) {
+        submit_gop(c);
+    }
+
+    pthread_mutex_lock(&c->finished_task_mutex);
+    for (;;) {
+        Task *task = &c->finished_tasks[c->finished_task_index];
+
+        if (c->task_index == c->finished_task_index) {
+            pthread_mutex_unlock(&c->finished_task_mutex);
+            return 0;
+        }
+        if (!task->outdata) {
+            /* Keep every thread busy before waiting for the oldest GOP */
+            if (frame && (c->task_index - c->finished_task_index) % BUFFER_SIZE <= avctx->thread_count) {
+                pthread_mutex_unlock(&c->finished_task_mutex);
+                return 0;
+            }
+            pthread_cond_wait(&c->finished_task_cond, &c->finished_task_mutex);
+            continue;
+        }
+
+        chunk = task->outdata;
+        if (task->return_code < 0 || chunk->pkt_index == chunk->nb_pkts) {
+            ret = task->return_code;
+            gop_chunk_free(&chunk);
+            task->outdata = NULL;
+            c->finished_task_index = (c->finished_task_index+1) % BUFFER_SIZE;
+            if (ret < 0) {
+                pthread_mutex_unlock(&c->finished_task_mutex);
+                return ret;
+            }
+            continue;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&c->finished_task_mutex);
+
+    /* The GOP is only freed by this thread, so it can be read unlocked */
+    *pkt = *chunk->pkts[chunk->pkt_index];
+    av_freep(&chunk->pkts[chunk->pkt_index]);
+    chunk->pkt_index++;
+    if (pkt->data)
+        *got_packet_ptr = 1;
+
+    return 0;
+}
+
 int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt, const AVFrame *frame, int *got_packet_ptr){
     ThreadContext *c = avctx->internal->frame_thread_encoder;
     Task task;
@@ -286,6 +521,9 @@ int ff_thread_video_encode_frame(AVCodecContext *avctx, AVPacket *pkt, const AVF
 
     av_assert1(!*got_packet_ptr);
 
+    if (c->gop_size)
+        return encode_frame_gop(avctx, pkt, frame, got_packet_ptr);
+
     if(frame){
         AVFrame *new = av_frame_alloc();
         if(!new)
@@ -31,7 +31,9 @@
 #include "libavutil/md5.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/slicethread.h"
 #include "libavutil/stereo3d.h"
+#include "libavutil/thread.h"
 #include "libavutil/timecode.h"
 
 #include "bswapdsp.h"
@@ -891,8 +893,15 @@ static int hls_slice_header(HEVCContext *s)
                 sh->entry_point_offset[i] = val + 1; // +1; // +1 to get the size
             }
             if (s->threads_number > 1 && (s->ps.pps->num_tile_rows > 1 || s->ps.pps->num_tile_columns > 1)) {
-                s->enable_parallel_tiles = 0; // TODO: you can enable tiles in parallel here
-                s->threads_number = 1;
+                if (s->ps.pps->entropy_coding_sync_enabled_flag) {
+                    s->enable_parallel_tiles = 0;
+                    s->threads_number = 1;
+                } else if (s->ps.pps->dependent_slice_segments_enabled_flag) {
+                    /* a dependent slice segment starting inside a tile
+                     * continues the CABAC state of the previous segment */
+                    s->enable_parallel_tiles = 0;
+                } else
+                    s->enable_parallel_tiles = 1;
             } else
                 s->enable_parallel_tiles = 0;
         } else
@@ -2496,6 +2505,61 @@ static int hls_slice_data(HEVCContext *s)
     s->avctx->execute(s->avctx, hls_decode_entry, arg, ret , 1, sizeof(int));
     return ret[0];
 }
+/**
+ * Threads decoding the CTB rows of WPP slices, or the tiles of slices, when
+ * slice threading is not active, e.g. in each frame thread, so that both
+ * kinds of parallelism can be combined. The row progress mirrors the slice
+ * threading one.
+ */
+typedef struct HEVCWPPThreads {
+#if HAVE_THREADS
+    AVSliceThread *thread;
+    int *entries;
+    unsigned int entries_size;
+    int (*decode_entry)(AVCodecContext *avctx, void *arg, int jobnr, int threadnr);
+    int *args;
+    int *rets;
+    pthread_mutex_t progress_mutex[MAX_NB_THREADS];
+    pthread_cond_t  progress_cond[MAX_NB_THREADS];
+#endif
+} HEVCWPPThreads;
+
+static void wpp_report_progress(HEVCContext *s, int ctb_row, int thread, int n)
+{
+#if HAVE_THREADS
+    HEVCWPPThreads *wpp = s->wpp;
+
+    if (wpp) {
+        pthread_mutex_lock(&wpp->progress_mutex[thread]);
+        wpp->entries[ctb_row] += n;
+        pthread_cond_signal(&wpp->progress_cond[thread]);
+        pthread_mutex_unlock(&wpp->progress_mutex[thread]);
+        return;
+    }
+#endif
+    ff_thread_report_progress2(s->avctx, ctb_row, thread, n);
+}
+
+static void wpp_await_progress(HEVCContext *s, int ctb_row, int thread, int shift)
+{
+#if HAVE_THREADS
+    HEVCWPPThreads *wpp = s->wpp;
+
+    if (wpp) {
+        if (!ctb_row)
+            return;
+        thread = thread ? thread - 1 : s->threads_number - 1;
+
+        pthread_mutex_lock(&wpp->progress_mutex[thread]);
+        while (wpp->entries[ctb_row - 1] - wpp->entries[ctb_row] < shift)
+            pthread_cond_wait(&wpp->progress_cond[thread], &wpp->progress_mutex[thread]);
+        pthread_mutex_unlock(&wpp->progress_mutex[thread]);
+        return;
+    }
+#endif
+    ff_thread_await_progress2(s->avctx, ctb_row, thread, shift);
+}
+
 static int hls_decode_entry_wpp(AVCodecContext *avctxt, void *input_ctb_row, int job, int self_id)
 {
     HEVCContext *s1  = avctxt->priv_data, *s;
@@ -2525,10 +2589,10 @@ static int hls_decode_entry_wpp(AVCodecContext *avctxt, void *input_ctb_row, int
 
         hls_decode_neighbour(s, x_ctb, y_ctb, ctb_addr_ts);
 
-        ff_thread_await_progress2(s->avctx, ctb_row, thread, SHIFT_CTB_WPP);
+        wpp_await_progress(s1, ctb_row, thread, SHIFT_CTB_WPP);
 
         if (atomic_load(&s1->wpp_err)) {
-            ff_thread_report_progress2(s->avctx, ctb_row , thread, SHIFT_CTB_WPP);
+            wpp_report_progress(s1, ctb_row, thread, SHIFT_CTB_WPP);
             return 0;
         }
 
@@ -2546,18 +2610,18 @@ static int hls_decode_entry_wpp(AVCodecContext *avctxt, void *input_ctb_row, int
         ctb_addr_ts++;
 
         ff_hevc_save_states(s, ctb_addr_ts);
-        ff_thread_report_progress2(s->avctx, ctb_row, thread, 1);
+        wpp_report_progress(s1, ctb_row, thread, 1);
         ff_hevc_hls_filters(s, x_ctb, y_ctb, ctb_size);
 
         if (!more_data && (x_ctb+ctb_size) < s->ps.sps->width && ctb_row != s->sh.num_entry_point_offsets) {
             atomic_store(&s1->wpp_err, 1);
-            ff_thread_report_progress2(s->avctx, ctb_row ,thread, SHIFT_CTB_WPP);
+            wpp_report_progress(s1, ctb_row, thread, SHIFT_CTB_WPP);
             return 0;
         }
 
         if ((x_ctb+ctb_size) >= s->ps.sps->width && (y_ctb+ctb_size) >= s->ps.sps->height ) {
             ff_hevc_hls_filter(s, x_ctb, y_ctb, ctb_size);
-            ff_thread_report_progress2(s->avctx, ctb_row , thread, SHIFT_CTB_WPP);
+            wpp_report_progress(s1, ctb_row, thread, SHIFT_CTB_WPP);
             return ctb_addr_ts;
         }
         ctb_addr_rs       = s->ps.pps->ctb_addr_ts_to_rs[ctb_addr_ts];
@@ -2567,16 +2631,179 @@ static int hls_decode_entry_wpp(AVCodecContext *avctxt, void *input_ctb_row, int
             break;
         }
     }
-    ff_thread_report_progress2(s->avctx, ctb_row ,thread, SHIFT_CTB_WPP);
+    wpp_report_progress(s1, ctb_row, thread, SHIFT_CTB_WPP);
 
     return 0;
 error:
     s->tab_slice_address[ctb_addr_rs] = -1;
     atomic_store(&s1->wpp_err, 1);
-    ff_thread_report_progress2(s->avctx, ctb_row ,thread, SHIFT_CTB_WPP);
+    wpp_report_progress(s1, ctb_row, thread, SHIFT_CTB_WPP);
+    return ret;
+}
+
+static int hls_decode_entry_tile(AVCodecContext *avctxt, void *input_entry, int job, int self_id)
+{
+    HEVCContext *s1  = avctxt->priv_data, *s;
+    HEVCLocalContext *lc;
+    int more_data   = 1;
+    int *entry_p    = input_entry;
+    int entry       = entry_p[job];
+    int tile        = s1->ps.pps->tile_id[s1->ps.pps->ctb_addr_rs_to_ts[s1->sh.slice_ctb_addr_rs]] + entry;
+    int ctb_addr_rs = entry ? s1->ps.pps->tile_pos_rs[tile] : s1->sh.slice_ctb_addr_rs;
+    int ctb_addr_ts = s1->ps.pps->ctb_addr_rs_to_ts[ctb_addr_rs];
+    int x_ctb       = (ctb_addr_rs % s1->ps.sps->ctb_width) << s1->ps.sps->log2_ctb_size;
+    int ret;
+
+    s = s1->sList[self_id];
+    lc = s->HEVClc;
+
+    if (entry) {
+        ret = init_get_bits8(&lc->gb, s->data + s->sh.offset[entry - 1], s->sh.size[entry - 1]);
+        if (ret < 0)
+            goto error;
+    } else if (lc != s1->HEVClc) {
+        lc->gb = s1->HEVClc->gb;
+    }
+    lc->end_of_tiles_x = x_ctb + (s->ps.pps->column_width[s->ps.pps->col_idxX[x_ctb >> s->ps.sps->log2_ctb_size]] << s->ps.sps->log2_ctb_size);
+    lc->first_qp_group = 1;
+
+    while (more_data && ctb_addr_ts < s->ps.sps->ctb_size &&
+           s->ps.pps->tile_id[ctb_addr_ts] == tile) {
+        int y_ctb;
+
+        ctb_addr_rs = s->ps.pps->ctb_addr_ts_to_rs[ctb_addr_ts];
+        x_ctb = (ctb_addr_rs % s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+        y_ctb = (ctb_addr_rs / s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+        hls_decode_neighbour(s, x_ctb, y_ctb, ctb_addr_ts);
+
+        ret = ff_hevc_cabac_init(s, ctb_addr_ts);
+        if (ret < 0)
+            goto error;
+
+        hls_sao_param(s, x_ctb >> s->ps.sps->log2_ctb_size, y_ctb >> s->ps.sps->log2_ctb_size);
+
+        s->deblock[ctb_addr_rs].beta_offset = s->sh.beta_offset;
+        s->deblock[ctb_addr_rs].tc_offset   = s->sh.tc_offset;
+        s->filter_slice_edges[ctb_addr_rs]  = s->sh.slice_loop_filter_across_slices_enabled_flag;
+
+        more_data = hls_coding_quadtree(s, x_ctb, y_ctb, s->ps.sps->log2_ctb_size, 0);
+        if (more_data < 0) {
+            ret = more_data;
+            goto error;
+        }
+
+        ctb_addr_ts++;
+    }
+
+    // each tile of the slice has its own entry point
+    if (entry < s->sh.num_entry_point_offsets ? !more_data :
+        more_data && ctb_addr_ts < s->ps.sps->ctb_size) {
+        av_log(s->avctx, AV_LOG_ERROR, "Tile entry points do not match the slice data\n");
+        ret = AVERROR_INVALIDDATA;
+        goto error;
+    }
+
+    return entry == s->sh.num_entry_point_offsets ? ctb_addr_ts : 0;
+error:
+    s->tab_slice_address[ctb_addr_rs] = -1;
     return ret;
 }
 
+/**
+ * Run the loop filters of the slice decoded by hls_decode_entry_tile(), in
+ * the order of the sequential decoding, once all its tiles are available.
+ */
+static void hls_filter_tiles(HEVCContext *s, int ctb_addr_ts_end)
+{
+    int ctb_size    = 1 << s->ps.sps->log2_ctb_size;
+    int ctb_addr_ts = s->ps.pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs];
+    int x_ctb       = 0;
+    int y_ctb       = 0;
+    int i;
+
+    // also restores the state of the local context after the last tile
+    for (i = ctb_addr_ts; i < ctb_addr_ts_end; i++) {
+        int ctb_addr_rs = s->ps.pps->ctb_addr_ts_to_rs[i];
+
+        x_ctb = (ctb_addr_rs % s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+        y_ctb = (ctb_addr_rs / s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+        hls_decode_neighbour(s, x_ctb, y_ctb, i);
+        ff_hevc_deblocking_tile_boundary_strengths(s, x_ctb, y_ctb);
+    }
+
+    for (i = ctb_addr_ts; i < ctb_addr_ts_end; i++) {
+        int ctb_addr_rs = s->ps.pps->ctb_addr_ts_to_rs[i];
+
+        x_ctb = (ctb_addr_rs % s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+        y_ctb = (ctb_addr_rs / s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
+        ff_hevc_hls_filters(s, x_ctb, y_ctb, ctb_size);
+    }
+
+    if (x_ctb + ctb_size >= s->ps.sps->width &&
+        y_ctb + ctb_size >= s->ps.sps->height)
+        ff_hevc_hls_filter(s, x_ctb, y_ctb, ctb_size);
+}
+
+#if HAVE_THREADS
+static void wpp_worker(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    HEVCContext *s = priv;
+    HEVCWPPThreads *wpp = s->wpp;
+
+    wpp->rets[jobnr] = wpp->decode_entry(s->avctx, wpp->args, jobnr, threadnr);
+}
+#endif
+
+static void wpp_threads_free(HEVCContext *s)
+{
+#if HAVE_THREADS
+    HEVCWPPThreads *wpp = s->wpp;
+    int i;
+
+    if (!wpp)
+        return;
+    avpriv_slicethread_free(&wpp->thread);
+    for (i = 0; i < MAX_NB_THREADS; i++) {
+        pthread_mutex_destroy(&wpp->progress_mutex[i]);
+        pthread_cond_destroy(&wpp->progress_cond[i]);
+    }
+    av_freep(&wpp->entries);
+#endif
+    av_freep(&s->wpp);
+}
+
+static int wpp_threads_init(HEVCContext *s, int nb_entries)
+{
+#if HAVE_THREADS
+    HEVCWPPThreads *wpp = s->wpp;
+    int i, ret;
+
+    if (!wpp) {
+        wpp = s->wpp = av_mallocz(sizeof(*wpp));
+        if (!wpp)
+            return AVERROR(ENOMEM);
+        for (i = 0; i < MAX_NB_THREADS; i++) {
+            pthread_mutex_init(&wpp->progress_mutex[i], NULL);
+            pthread_cond_init(&wpp->progress_cond[i], NULL);
+        }
+        ret = avpriv_slicethread_create(&wpp->thread, s, wpp_worker, NULL,
+                                        s->threads_number);
+        if (ret < 0) {
+            wpp_threads_free(s);
+            return ret;
+        }
+    }
+
+    av_fast_malloc(&wpp->entries, &wpp->entries_size, nb_entries * sizeof(*wpp->entries));
+    if (!wpp->entries)
+        return AVERROR(ENOMEM);
+    memset(wpp->entries, 0, nb_entries * sizeof(*wpp->entries));
+    return 0;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
 static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
 {
     const uint8_t *data = nal->data;
@@ -2594,7 +2821,8 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
         return AVERROR(ENOMEM);
     }
 
-    if (s->sh.slice_ctb_addr_rs + s->sh.num_entry_point_offsets * s->ps.sps->ctb_width >= s->ps.sps->ctb_width * s->ps.sps->ctb_height) {
+    if (s->ps.pps->entropy_coding_sync_enabled_flag &&
+        s->sh.slice_ctb_addr_rs + s->sh.num_entry_point_offsets * s->ps.sps->ctb_width >= s->ps.sps->ctb_width * s->ps.sps->ctb_height) {
         av_log(s->avctx, AV_LOG_ERROR, "WPP ctb addresses are wrong (%d %d %d %d)\n",
             s->sh.slice_ctb_addr_rs, s->sh.num_entry_point_offsets,
             s->ps.sps->ctb_width, s->ps.sps->ctb_height
@@ -2602,8 +2830,20 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
         res = AVERROR_INVALIDDATA;
         goto error;
     }
+    if (s->enable_parallel_tiles &&
+        s->ps.pps->tile_id[s->ps.pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs]] + s->sh.num_entry_point_offsets >=
+        s->ps.pps->num_tile_columns * s->ps.pps->num_tile_rows) {
+        av_log(s->avctx, AV_LOG_ERROR, "Tile entry points are wrong (%d %d)\n",
+               s->sh.slice_ctb_addr_rs, s->sh.num_entry_point_offsets);
+        res = AVERROR_INVALIDDATA;
+        goto error;
+    }
 
-    ff_alloc_entries(s->avctx, s->sh.num_entry_point_offsets + 1);
+    if (s->avctx->active_thread_type & FF_THREAD_SLICE) {
+        ff_alloc_entries(s->avctx, s->sh.num_entry_point_offsets + 1);
+    } else if ((res = wpp_threads_init(s, s->sh.num_entry_point_offsets + 1)) < 0) {
+        goto error;
+    }
 
     if (!s->sList[1]) {
         for (i = 1; i < s->threads_number; i++) {
@@ -2657,18 +2897,44 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
     }
 
     atomic_store(&s->wpp_err, 0);
-    ff_reset_entries(s->avctx);
+    if (!s->wpp)
+        ff_reset_entries(s->avctx);
 
     for (i = 0; i <= s->sh.num_entry_point_offsets; i++) {
         arg[i] = i;
         ret[i] = 0;
     }
 
-    if (s->ps.pps->entropy_coding_sync_enabled_flag)
+    if (s->ps.pps->entropy_coding_sync_enabled_flag) {
+#if HAVE_THREADS
+        if (s->wpp) {
+            s->wpp->decode_entry = hls_decode_entry_wpp;
+            s->wpp->args = arg;
+            s->wpp->rets = ret;
+            avpriv_slicethread_execute(s->wpp->thread, s->sh.num_entry_point_offsets + 1, 0);
+        } else
+#endif
         s->avctx->execute2(s->avctx, hls_decode_entry_wpp, arg, ret, s->sh.num_entry_point_offsets + 1);
 
-    for (i = 0; i <= s->sh.num_entry_point_offsets; i++)
-        res += ret[i];
+        for (i = 0; i <= s->sh.num_entry_point_offsets; i++)
+            res += ret[i];
+    } else if (s->enable_parallel_tiles) {
+#if HAVE_THREADS
+        if (s->wpp) {
+            s->wpp->decode_entry = hls_decode_entry_tile;
+            s->wpp->args = arg;
+            s->wpp->rets = ret;
+            avpriv_slicethread_execute(s->wpp->thread, s->sh.num_entry_point_offsets + 1, 0);
+        } else
+#endif
+        s->avctx->execute2(s->avctx, hls_decode_entry_tile, arg, ret, s->sh.num_entry_point_offsets + 1);
+
+        for (i = 0; i < s->sh.num_entry_point_offsets && ret[i] >= 0; i++);
+        res = ret[i];
+        if (res >= 0)
+            hls_filter_tiles(s, res);
+    }
+
 error:
     av_free(ret);
     av_free(arg);
@@ -3363,6 +3629,7 @@ static av_cold int hevc_decode_free(AVCodecContext *avctx)
 
     pic_arrays_free(s);
 
+    wpp_threads_free(s);
     av_freep(&s->md5_ctx);
 
     av_freep(&s->cabac_state);
@@ -3558,6 +3825,8 @@ static av_cold int hevc_decode_init(AVCodecContext *avctx)
 
     if(avctx->active_thread_type & FF_THREAD_SLICE)
         s->threads_number = avctx->thread_count;
+    else if (HAVE_THREADS && s->wpp_threads > 1)
+        s->threads_number = s->wpp_threads;
     else
         s->threads_number = 1;
 
@@ -3596,6 +3865,8 @@ static const AVOption options[] = {
         AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, PAR },
     { "strict-displaywin", "stricly apply default display window size", OFFSET(apply_defdispwin),
         AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, PAR },
+    { "wpp_threads", "threads decoding the rows of WPP slices and tiles when slice threading is not used", OFFSET(wpp_threads),
+        AV_OPT_TYPE_INT, {.i64 = 0}, 0, MAX_NB_THREADS, PAR },
     { NULL },
 };
 
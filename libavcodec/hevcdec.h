@@ -554,6 +554,8 @@ typedef struct HEVCContext {
 
     int enable_parallel_tiles;
     atomic_int wpp_err;
+    int wpp_threads;            ///< threads decoding WPP rows and tiles without slice threading
+    struct HEVCWPPThreads *wpp;
 
     const uint8_t *data;
 
@@ -673,6 +675,7 @@ void ff_hevc_set_qPy(HEVCContext *s, int xBase, int yBase,
                      int log2_cb_size);
 void ff_hevc_deblocking_boundary_strengths(HEVCContext *s, int x0, int y0,
                                            int log2_trafo_size);
+void ff_hevc_deblocking_tile_boundary_strengths(HEVCContext *s, int x_ctb, int y_ctb);
 int ff_hevc_cu_qp_delta_sign_flag(HEVCContext *s);
 int ff_hevc_cu_qp_delta_abs(HEVCContext *s);
 int ff_hevc_cu_chroma_qp_offset_flag(HEVCContext *s);
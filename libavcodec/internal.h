@@ -73,6 +73,12 @@
  * uses ff_thread_report/await_progress().
  */
 #define FF_CODEC_CAP_ALLOCATE_PROGRESS      (1 << 6)
+/**
+ * The encoder can be frame threaded with closed GOPs, which are then encoded
+ * independently by resetting the encoder with avcodec_reset() at their
+ * start, see ff_frame_thread_encoder_init().
+ */
+#define FF_CODEC_CAP_GOP_THREADS            (1 << 7)
 
 /**
  * AVCodec.codec_tags termination value
@@ -201,6 +207,18 @@ typedef struct AVCodecInternal {
     int initial_sample_rate;
     int initial_channels;
     uint64_t initial_channel_layout;
+
+    /**
+     * Set when the codec init callback failed in avcodec_reset(), the close
+     * callback must not be called anymore.
+     */
+    int init_failed;
+
+    /**
+     * Number of frames preceding the GOP being encoded, when encoding GOPs
+     * independently with FF_CODEC_CAP_GOP_THREADS.
+     */
+    int64_t gop_frame_offset;
 } AVCodecInternal;
 
 struct AVCodecDefault {
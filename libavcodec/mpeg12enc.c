@@ -227,6 +227,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
     } else {
         s->timecode_frame_start = 0; // default is -1
     }
+    s->timecode_frame_start += avctx->internal->gop_frame_offset;
 
     return 0;
 }
@@ -1196,7 +1197,7 @@ AVCodec ff_mpeg1video_encoder = {
     .pix_fmts             = (const enum AVPixelFormat[]) { AV_PIX_FMT_YUV420P,
                                                            AV_PIX_FMT_NONE },
     .capabilities         = AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS,
-    .caps_internal        = FF_CODEC_CAP_INIT_CLEANUP,
+    .caps_internal        = FF_CODEC_CAP_INIT_CLEANUP | FF_CODEC_CAP_GOP_THREADS,
     .priv_class           = &mpeg1_class,
 };
 
@@ -1214,6 +1215,6 @@ AVCodec ff_mpeg2video_encoder = {
                                                            AV_PIX_FMT_YUV422P,
                                                            AV_PIX_FMT_NONE },
     .capabilities         = AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS,
-    .caps_internal        = FF_CODEC_CAP_INIT_CLEANUP,
+    .caps_internal        = FF_CODEC_CAP_INIT_CLEANUP | FF_CODEC_CAP_GOP_THREADS,
     .priv_class           = &mpeg2_class,
 };
@@ -1078,9 +1078,9 @@ av_cold int ff_mpv_encode_end(AVCodecContext *avctx)
         av_frame_free(&s->tmp_frames[i]);
 
     ff_free_picture_tables(&s->new_picture);
-    ff_mpeg_unref_picture(s->avctx, &s->new_picture);
+    ff_mpeg_unref_picture(avctx, &s->new_picture);
 
-    av_freep(&s->avctx->stats_out);
+    av_freep(&avctx->stats_out);
     av_freep(&s->ac_stats);
 
     if(s->q_chroma_intra_matrix   != s->q_intra_matrix  ) av_freep(&s->q_chroma_intra_matrix);
@@ -3722,6 +3722,23 @@ static int encode_picture(MpegEncContext *s, int picture_number)
         for(i=0; i<s->mb_stride*s->mb_height; i++)
             s->mb_type[i]= CANDIDATE_MB_TYPE_INTRA;
 
+        /* The motion estimation of the next P-frame uses the f_code and
+         * the field motion vectors of the previous one, which a closed GOP
+         * must not depend on. */
+        if (s->avctx->flags & AV_CODEC_FLAG_CLOSED_GOP) {
+            s->f_code = s->b_code = 1;
+            if (s->p_field_mv_table_base[0][0]) {
+                int mv_table_size = (s->mb_height + 2) * s->mb_stride + 1;
+                int j;
+                for (i = 0; i < 2; i++) {
+                    for (j = 0; j < 2; j++)
+                        memset(s->p_field_mv_table_base[i][j], 0,
+                               mv_table_size * sizeof(*s->p_field_mv_table_base[i][j]));
+                    memset(s->p_field_select_table[i], 0, mv_table_size * 2);
+                }
+            }
+        }
+
         if(!s->fixed_qscale){
             /* finding spatial complexity for I-frame rate control */
             s->avctx->execute(s->avctx, mb_var_thread, &s->thread_context[0], NULL, context_count, sizeof(void*));
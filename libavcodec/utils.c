@@ -1061,25 +1061,10 @@ FF_ENABLE_DEPRECATION_WARNINGS
     goto end;
 }
 
-void avcodec_flush_buffers(AVCodecContext *avctx)
+static void flush_buffers(AVCodecContext *avctx)
 {
     AVCodecInternal *avci = avctx->internal;
 
-    if (av_codec_is_encoder(avctx->codec)) {
-        int caps = avctx->codec->capabilities;
-
-        if (!(caps & AV_CODEC_CAP_ENCODER_FLUSH)) {
-            // Only encoders that explicitly declare support for it can be
-            // flushed. Otherwise, this is a no-op.
-            av_log(avctx, AV_LOG_WARNING, "Ignoring attempt to flush encoder "
-                   "that doesn't support it\n");
-            return;
-        }
-
-        // We haven't implemented flushing for frame-threaded encoders.
-        av_assert0(!(caps & AV_CODEC_CAP_FRAME_THREADS));
-    }
-
     avci->draining      = 0;
     avci->draining_done = 0;
     avci->nb_draining_errors = 0;
@@ -1106,6 +1091,129 @@ void avcodec_flush_buffers(AVCodecContext *avctx)
         av_frame_unref(avci->to_free);
 }
 
+void avcodec_flush_buffers(AVCodecContext *avctx)
+{
+    if (av_codec_is_encoder(avctx->codec)) {
+        int caps = avctx->codec->capabilities;
+
+        if (!(caps & AV_CODEC_CAP_ENCODER_FLUSH)) {
+            // Only encoders that explicitly declare support for it can be
+            // flushed. Otherwise, this is a no-op.
+            av_log(avctx, AV_LOG_WARNING, "Ignoring attempt to flush encoder "
+                   "that doesn't support it\n");
+            return;
+        }
+
+        // We haven't implemented flushing for frame-threaded encoders.
+        av_assert0(!(caps & AV_CODEC_CAP_FRAME_THREADS));
+    }
+
+    flush_buffers(avctx);
+}
+
+int avcodec_reset(AVCodecContext *avctx)
+{
+    AVCodecInternal *avci;
+    const AVCodec *codec;
+    void *priv_data = NULL;
+    int i, ret = 0;
+
+    if (!avcodec_is_open(avctx))
+        return AVERROR(EINVAL);
+    avci  = avctx->internal;
+    codec = avctx->codec;
+
+    /* Frame threads hold their own copies of the private context, which
+     * are only set up by ff_frame_thread_init() and ff_frame_thread_encoder_init(). */
+    if (avctx->active_thread_type & FF_THREAD_FRAME) {
+        av_log(avctx, AV_LOG_ERROR, "Resetting frame-threaded codecs is not supported\n");
+        return AVERROR(ENOSYS);
+    }
+
+    if (avctx->extradata_size < 0 || avctx->extradata_size >= FF_MAX_EXTRADATA_SIZE)
+        return AVERROR(EINVAL);
+    if (avctx->codec_type == AVMEDIA_TYPE_VIDEO &&
+        (avctx->width || avctx->height)) {
+        ret = av_image_check_size2(avctx->width, avctx->height, avctx->max_pixels,
+                                   AV_PIX_FMT_NONE, 0, avctx);
+        if (ret < 0)
+            return ret;
+    }
+    if (av_codec_is_encoder(codec) &&
+        (avctx->time_base.num <= 0 || avctx->time_base.den <= 0)) {
+        av_log(avctx, AV_LOG_ERROR, "The encoder timebase is not set.\n");
+        return AVERROR(EINVAL);
+    }
+
+    flush_buffers(avctx);
+    avctx->frame_number = 0;
+    avctx->pts_correction_num_faulty_pts =
+    avctx->pts_correction_num_faulty_dts = 0;
+    avci->skip_samples           = 0;
+    avci->changed_frames_dropped = 0;
+    av_packet_unref(avci->last_pkt_props);
+
+    /* Allocate the new private context first, carrying over the options
+     * set by the caller, so that failing here leaves the codec usable. */
+    if (codec->priv_data_size > 0) {
+        priv_data = av_mallocz(codec->priv_data_size);
+        if (!priv_data)
+            return AVERROR(ENOMEM);
+        if (codec->priv_class) {
+            *(const AVClass **)priv_data = codec->priv_class;
+            av_opt_set_defaults(priv_data);
+            ret = av_opt_copy(priv_data, avctx->priv_data);
+            if (ret < 0) {
+                av_opt_free(priv_data);
+                av_free(priv_data);
+                return ret;
+            }
+        }
+    }
+
+    if (codec->close)
+        codec->close(avctx);
+
+    if (avctx->hwaccel && avctx->hwaccel->uninit)
+        avctx->hwaccel->uninit(avctx);
+    av_freep(&avci->hwaccel_priv_data);
+    avctx->hwaccel = NULL;
+
+    if (codec->priv_class && avctx->priv_data)
+        av_opt_free(avctx->priv_data);
+    av_freep(&avctx->priv_data);
+    avctx->priv_data = priv_data;
+
+    if (av_codec_is_encoder(codec)) {
+        /* all generated again by the encoder init */
+        if (avctx->codec_type == AVMEDIA_TYPE_AUDIO)
+            avctx->frame_size = 0;
+        av_freep(&avctx->extradata);
+        avctx->extradata_size = 0;
+        for (i = 0; i < avctx->nb_coded_side_data; i++)
+            av_freep(&avctx->coded_side_data[i].data);
+        av_freep(&avctx->coded_side_data);
+        avctx->nb_coded_side_data = 0;
+    }
+
+    /* set again by the decoder init, as in avcodec_open2() */
+    if (av_codec_is_decoder(codec))
+        av_freep(&avctx->subtitle_header);
+
+    if (codec->init) {
+        ff_lock_avcodec(avctx, codec);
+        ret = codec->init(avctx);
+        ff_unlock_avcodec(codec);
+        if (ret < 0) {
+            if (codec->close && (codec->caps_internal & FF_CODEC_CAP_INIT_CLEANUP))
+                codec->close(avctx);
+            avci->init_failed = 1;
+        }
+    }
+
+    return ret;
+}
+
 void avsubtitle_free(AVSubtitle *sub)
 {
     int i;
@@ -1139,7 +1247,7 @@ av_cold int avcodec_close(AVCodecContext *avctx)
         }
         if (HAVE_THREADS && avctx->internal->thread_ctx)
             ff_thread_free(avctx);
-        if (avctx->codec && avctx->codec->close)
+        if (avctx->codec && avctx->codec->close && !avctx->internal->init_failed)
             avctx->codec->close(avctx);
         avctx->internal->byte_buffer_size = 0;
         av_freep(&avctx->internal->byte_buffer);
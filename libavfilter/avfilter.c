@@ -192,6 +192,16 @@ int avfilter_link_get_channels(AVFilterLink *link)
 
 void ff_filter_set_ready(AVFilterContext *filter, unsigned priority)
 {
+    AVFilterGraphInternal *gi = filter->graph ? filter->graph->internal : NULL;
+
+    /* filters sharing an input may be activated concurrently, see
+       ff_graph_run_branches() */
+    if (gi && gi->branch_active) {
+        ff_mutex_lock(&gi->ready_lock);
+        filter->ready = FFMAX(filter->ready, priority);
+        ff_mutex_unlock(&gi->ready_lock);
+        return;
+    }
     filter->ready = FFMAX(filter->ready, priority);
 }
 
@@ -527,13 +537,22 @@ static int set_enable_expr(AVFilterContext *ctx, const char *expr)
 
 void ff_update_link_current_pts(AVFilterLink *link, int64_t pts)
 {
+    AVFilterGraphInternal *gi = link->graph ? link->graph->internal : NULL;
+    int locked;
+
     if (pts == AV_NOPTS_VALUE)
         return;
+    /* the sink links heap is shared by all branches of the graph */
+    locked = gi && gi->branch_active && link->age_index >= 0;
+    if (locked)
+        ff_mutex_lock(&gi->ready_lock);
     link->current_pts = pts;
     link->current_pts_us = av_rescale_q(pts, link->time_base, AV_TIME_BASE_Q);
     /* TODO use duration */
     if (link->graph && link->age_index >= 0)
         ff_avfilter_graph_update_heap(link->graph, link);
+    if (locked)
+        ff_mutex_unlock(&gi->ready_lock);
 }
 
 int avfilter_process_command(AVFilterContext *filter, const char *cmd, const char *arg, char *res, int res_len, int flags)
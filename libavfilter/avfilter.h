@@ -332,6 +332,12 @@ typedef struct AVFilter {
  */
 #define AVFILTER_THREAD_SLICE (1 << 0)
 
+/**
+ * Activate filters from independent branches of a graph concurrently.
+ * Only meaningful in AVFilterGraph.thread_type; it is not enabled by default.
+ */
+#define AVFILTER_THREAD_BRANCH (1 << 1)
+
 typedef struct AVFilterInternal AVFilterInternal;
 
 /** An instance of a filter */
@@ -852,12 +858,15 @@ typedef struct AVFilterGraph {
      * of AVFILTER_THREAD_* flags.
      *
      * May be set by the caller at any point, the setting will apply to all
-     * filters initialized after that. The default is allowing everything.
+     * filters initialized after that. The default is AVFILTER_THREAD_SLICE.
      *
      * When a filter in this graph is initialized, this field is combined using
      * bit AND with AVFilterContext.thread_type to get the final mask used for
      * determining allowed threading types. I.e. a threading type needs to be
      * set in both to be allowed.
+     *
+     * AVFILTER_THREAD_BRANCH is not combined with the filters' masks and must
+     * be set before adding any filters to the graph.
      */
     int thread_type;
 
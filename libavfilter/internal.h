@@ -25,6 +25,7 @@
  */
 
 #include "libavutil/internal.h"
+#include "libavutil/thread.h"
 #include "avfilter.h"
 #include "formats.h"
 #include "framepool.h"
@@ -137,6 +138,10 @@ struct AVFilterPad {
 struct AVFilterGraphInternal {
     void *thread;
     avfilter_execute_func *thread_execute;
+    void *branch_thread;
+    /* set while filters are activated concurrently by the branch scheduler */
+    int branch_active;
+    AVMutex ready_lock;
     FFFrameQueueGlobal frame_queues;
 };
 
@@ -368,6 +373,12 @@ void ff_filter_graph_remove_filter(AVFilterGraph *graph, AVFilterContext *filter
  */
 #define FF_FILTER_FLAG_HWFRAME_AWARE (1 << 0)
 
+/**
+ * The filter accesses other filters of its graph (e.g. to send commands)
+ * and must never be activated concurrently with any other filter.
+ */
+#define FF_FILTER_FLAG_GRAPH_SERIAL (1 << 1)
+
 /**
  * Run one round of processing on a filter graph.
  */
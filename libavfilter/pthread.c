@@ -42,8 +42,19 @@ typedef struct ThreadContext {
     AVFilterContext *ctx;
     void *arg;
     int   *rets;
+
+    /* serializes execute() calls from concurrently activated filters */
+    AVMutex execute_lock;
 } ThreadContext;
 
+typedef struct BranchContext {
+    AVSliceThread *thread;
+
+    /* filters activated in the current round and their return values */
+    AVFilterContext **filters;
+    int *rets;
+} BranchContext;
+
 static void worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
 {
     ThreadContext *c = priv;
@@ -55,6 +66,7 @@ static void worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb
 static void slice_thread_uninit(ThreadContext *c)
 {
     avpriv_slicethread_free(&c->thread);
+    ff_mutex_destroy(&c->execute_lock);
 }
 
 static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
@@ -64,12 +76,14 @@ static int thread_execute(AVFilterContext *ctx, avfilter_action_func *func,
 
     if (nb_jobs <= 0)
         return 0;
+    ff_mutex_lock(&c->execute_lock);
     c->ctx         = ctx;
     c->arg         = arg;
     c->func        = func;
     c->rets        = ret;
 
     avpriv_slicethread_execute(c->thread, nb_jobs, 0);
+    ff_mutex_unlock(&c->execute_lock);
     return 0;
 }
 
@@ -78,9 +92,140 @@ static int thread_init_internal(ThreadContext *c, int nb_threads)
     nb_threads = avpriv_slicethread_create(&c->thread, c, worker_func, NULL, nb_threads);
     if (nb_threads <= 1)
         avpriv_slicethread_free(&c->thread);
+    else
+        ff_mutex_init(&c->execute_lock, NULL);
     return FFMAX(nb_threads, 1);
 }
 
+static void branch_worker_func(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    BranchContext *b = priv;
+    b->rets[jobnr] = ff_filter_activate(b->filters[jobnr]);
+}
+
+static int filter_feeds(const AVFilterContext *src, const AVFilterContext *dst)
+{
+    unsigned i;
+
+    for (i = 0; i < src->nb_outputs; i++)
+        if (src->outputs[i] && src->outputs[i]->dst == dst)
+            return 1;
+    return 0;
+}
+
+/**
+ * Check whether two filters may not be activated at the same time.
+ *
+ * Activating a filter touches its own links and the ready field of its
+ * neighbours, but also the output links of the filters it sends frames to
+ * (see filter_unblock()). Filters sharing only an upstream neighbour, like
+ * the outputs of split, are therefore independent: their common writes are
+ * protected by ready_lock.
+ */
+static int filters_conflict(const AVFilterContext *a, const AVFilterContext *b)
+{
+    unsigned i;
+
+    if (filter_feeds(a, b) || filter_feeds(b, a))
+        return 1;
+    for (i = 0; i < a->nb_outputs; i++) {
+        const AVFilterContext *dst = a->outputs[i] ? a->outputs[i]->dst : NULL;
+        if (dst && (filter_feeds(b, dst) || filter_feeds(dst, b)))
+            return 1;
+    }
+    for (i = 0; i < b->nb_outputs; i++) {
+        const AVFilterContext *dst = b->outputs[i] ? b->outputs[i]->dst : NULL;
+        if (dst && filter_feeds(dst, a))
+            return 1;
+    }
+    return 0;
+}
+
+static int serial_filter(const AVFilterContext *filter)
+{
+    return filter->filter->flags_internal & FF_FILTER_FLAG_GRAPH_SERIAL;
+}
+
+int ff_graph_run_branches(AVFilterGraph *graph, AVFilterContext *filter)
+{
+    BranchContext *b = graph->internal->branch_thread;
+    int nb_filters = 1, ret = 0, i, j;
+    unsigned k;
+
+    b->filters[0] = filter;
+    for (k = 0; k < graph->nb_filters && nb_filters < graph->nb_threads &&
+                !serial_filter(filter); k++) {
+        AVFilterContext *f = graph->filters[k];
+
+        if (!f->ready || f == filter || serial_filter(f))
+            continue;
+        for (j = 0; j < nb_filters; j++)
+            if (filters_conflict(f, b->filters[j]))
+                break;
+        if (j == nb_filters)
+            b->filters[nb_filters++] = f;
+    }
+
+    if (nb_filters == 1)
+        return ff_filter_activate(filter);
+
+    graph->internal->branch_active = 1;
+    avpriv_slicethread_execute(b->thread, nb_filters, 0);
+    graph->internal->branch_active = 0;
+
+    for (i = 0; i < nb_filters; i++)
+        if (b->rets[i] < 0) {
+            ret = b->rets[i];
+            break;
+        }
+    return ret;
+}
+
+static void branch_thread_free(AVFilterGraph *graph)
+{
+    BranchContext *b = graph->internal->branch_thread;
+
+    if (!b)
+        return;
+    avpriv_slicethread_free(&b->thread);
+    ff_mutex_destroy(&graph->internal->ready_lock);
+    av_freep(&b->filters);
+    av_freep(&b->rets);
+    av_freep(&graph->internal->branch_thread);
+}
+
+static int branch_thread_init(AVFilterGraph *graph)
+{
+    BranchContext *b;
+    int ret;
+
+    b = graph->internal->branch_thread = av_mallocz(sizeof(*b));
+    if (!b)
+        return AVERROR(ENOMEM);
+
+    b->filters = av_malloc_array(graph->nb_threads, sizeof(*b->filters));
+    b->rets    = av_malloc_array(graph->nb_threads, sizeof(*b->rets));
+    if (!b->filters || !b->rets) {
+        av_freep(&b->filters);
+        av_freep(&b->rets);
+        av_freep(&graph->internal->branch_thread);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = avpriv_slicethread_create(&b->thread, b, branch_worker_func, NULL,
+                                    graph->nb_threads);
+    if (ret <= 1) {
+        avpriv_slicethread_free(&b->thread);
+        av_freep(&b->filters);
+        av_freep(&b->rets);
+        av_freep(&graph->internal->branch_thread);
+        return ret < 0 ? ret : 0;
+    }
+    ff_mutex_init(&graph->internal->ready_lock, NULL);
+
+    return 0;
+}
+
 int ff_graph_thread_init(AVFilterGraph *graph)
 {
     int ret;
@@ -105,11 +250,18 @@ int ff_graph_thread_init(AVFilterGraph *graph)
 
     graph->internal->thread_execute = thread_execute;
 
+    if (graph->thread_type & AVFILTER_THREAD_BRANCH) {
+        ret = branch_thread_init(graph);
+        if (ret < 0)
+            return ret;
+    }
+
     return 0;
 }
 
 void ff_graph_thread_free(AVFilterGraph *graph)
 {
+    branch_thread_free(graph);
     if (graph->internal->thread)
         slice_thread_uninit(graph->internal->thread);
     av_freep(&graph->internal->thread);
@@ -0,0 +1,181 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Runs a graph with several branches after split/asplit once with the
+ * default thread type and once with AVFILTER_THREAD_BRANCH, and checks that
+ * every sink receives the same frames.
+ */
+
+#include <stdio.h>
+
+#include "libavutil/adler32.h"
+#include "libavutil/common.h"
+#include "libavutil/frame.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/samplefmt.h"
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+
+#define MAX_SINKS 8
+
+static const char graph_desc[] =
+    "testsrc=s=176x144:r=25:d=2,format=yuv420p,split=3[v0][v1][v2];"
+    "[v0]scale=88x72,hflip[o0];"
+    "[v1]negate,vflip[o1];"
+    "[v2]scale=352x288:flags=bicubic[o2];"
+    "sine=d=2,aformat=sample_fmts=s16,asplit[a0][a1];"
+    "[a0]volume=0.5[o3];"
+    "[a1]anull[o4]";
+
+typedef struct Result {
+    int sink;
+    int64_t pts;
+    uint32_t crc;
+} Result;
+
+static uint32_t frame_crc(const AVFrame *frame, enum AVMediaType type)
+{
+    uint32_t crc = 0;
+    int p, y;
+
+    if (type == AVMEDIA_TYPE_VIDEO) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+
+        for (p = 0; p < 4 && frame->data[p]; p++) {
+            int w = av_image_get_linesize(frame->format, frame->width, p);
+            int h = p == 1 || p == 2 ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h)
+                                     : frame->height;
+            for (y = 0; y < h; y++)
+                crc = av_adler32_update(crc, frame->data[p] + y * frame->linesize[p], w);
+        }
+    } else {
+        int planar = av_sample_fmt_is_planar(frame->format);
+        int size   = frame->nb_samples * av_get_bytes_per_sample(frame->format) *
+                     (planar ? 1 : frame->channels);
+
+        for (p = 0; p < (planar ? frame->channels : 1); p++)
+            crc = av_adler32_update(crc, frame->extended_data[p], size);
+    }
+    return crc;
+}
+
+static int run_graph(int thread_type, Result **results, int *nb_results)
+{
+    AVFilterGraph *graph = avfilter_graph_alloc();
+    AVFilterInOut *inputs = NULL, *outputs = NULL, *cur;
+    AVFilterContext *sinks[MAX_SINKS];
+    enum AVMediaType types[MAX_SINKS];
+    AVFrame *frame = av_frame_alloc();
+    int nb_sinks = 0, eof = 0, ret;
+
+    if (!graph || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    graph->thread_type = thread_type;
+    graph->nb_threads  = 4;
+
+    if ((ret = avfilter_graph_parse_ptr(graph, graph_desc, &inputs, &outputs, NULL)) < 0)
+        goto end;
+
+    for (cur = outputs; cur; cur = cur->next) {
+        enum AVMediaType type = avfilter_pad_get_type(cur->filter_ctx->output_pads,
+                                                      cur->pad_idx);
+        char name[16];
+
+        if (nb_sinks == MAX_SINKS) {
+            ret = AVERROR(EINVAL);
+            goto end;
+        }
+        snprintf(name, sizeof(name), "sink%d", nb_sinks);
+        ret = avfilter_graph_create_filter(&sinks[nb_sinks],
+                                           avfilter_get_by_name(type == AVMEDIA_TYPE_VIDEO ?
+                                                                "buffersink" : "abuffersink"),
+                                           name, NULL, NULL, graph);
+        if (ret < 0)
+            goto end;
+        if ((ret = avfilter_link(cur->filter_ctx, cur->pad_idx, sinks[nb_sinks], 0)) < 0)
+            goto end;
+        types[nb_sinks++] = type;
+    }
+
+    if ((ret = avfilter_graph_config(graph, NULL)) < 0)
+        goto end;
+
+    while (eof != (1 << nb_sinks) - 1) {
+        for (int i = 0; i < nb_sinks; i++) {
+            if (eof & (1 << i))
+                continue;
+            ret = av_buffersink_get_frame(sinks[i], frame);
+            if (ret == AVERROR_EOF) {
+                eof |= 1 << i;
+                continue;
+            } else if (ret < 0) {
+                goto end;
+            }
+            ret = av_reallocp_array(results, *nb_results + 1, sizeof(**results));
+            if (ret < 0) {
+                *nb_results = 0;
+                goto end;
+            }
+            (*results)[(*nb_results)++] = (Result){ i, frame->pts, frame_crc(frame, types[i]) };
+            av_frame_unref(frame);
+        }
+    }
+    ret = 0;
+
+end:
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    avfilter_graph_free(&graph);
+    av_frame_free(&frame);
+    return ret;
+}
+
+int main(void)
+{
+    Result *ref = NULL, *res = NULL;
+    int nb_ref = 0, nb_res = 0, ret;
+
+    if ((ret = run_graph(AVFILTER_THREAD_SLICE, &ref, &nb_ref)) < 0 ||
+        (ret = run_graph(AVFILTER_THREAD_SLICE | AVFILTER_THREAD_BRANCH, &res, &nb_res)) < 0) {
+        fprintf(stderr, "Running the graph failed: %s\n", av_err2str(ret));
+        ret = 1;
+        goto end;
+    }
+
+    ret = nb_ref != nb_res;
+    for (int i = 0; i < nb_res; i++) {
+        printf("%d, %5"PRId64", 0x%08"PRIx32"\n", res[i].sink, res[i].pts, res[i].crc);
+        if (i < nb_ref && (ref[i].sink != res[i].sink || ref[i].pts != res[i].pts ||
+                           ref[i].crc  != res[i].crc)) {
+            fprintf(stderr, "Frame %d differs from the unthreaded graph\n", i);
+            ret = 1;
+        }
+    }
+    if (nb_ref != nb_res)
+        fprintf(stderr, "Got %d frames instead of %d\n", nb_res, nb_ref);
+
+end:
+    av_free(ref);
+    av_free(res);
+    return ret;
+}
@@ -25,4 +25,11 @@ int ff_graph_thread_init(AVFilterGraph *graph);
 
 void ff_graph_thread_free(AVFilterGraph *graph);
 
+/**
+ * Activate filter together with other ready filters of the graph that do
+ * not share state with it, using the branch worker pool.
+ * Must only be called when graph->internal->branch_thread is set.
+ */
+int ff_graph_run_branches(AVFilterGraph *graph, AVFilterContext *filter);
+
 #endif /* AVFILTER_THREAD_H */
@@ -23,8 +23,8 @@
 #include "libavutil/imgutils.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/tx.h"
 #include "internal.h"
-#include "libavcodec/avfft.h"
 
 enum BufferTypes {
     CURRENT,
@@ -41,11 +41,12 @@ typedef struct PlaneContext {
     float n;
 
     float *buffer[BSIZE];
-    FFTComplex *hdata, *vdata;
+    AVComplexFloat *hdata, *vdata;
     int data_linesize;
     int buffer_linesize;
 
-    FFTContext *fft, *ifft;
+    AVTXContext *fft, *ifft;
+    av_tx_fn tx_fn, itx_fn;
 } PlaneContext;
 
 typedef struct FFTdnoizContext {
@@ -65,8 +66,8 @@ typedef struct FFTdnoizContext {
     int nb_planes;
     PlaneContext planes[4];
 
-    void (*import_row)(FFTComplex *dst, uint8_t *src, int rw);
-    void (*export_row)(FFTComplex *src, uint8_t *dst, int rw, float scale, int depth);
+    void (*import_row)(AVComplexFloat *dst, uint8_t *src, int rw);
+    void (*export_row)(AVComplexFloat *src, uint8_t *dst, int rw, float scale, int depth);
 } FFTdnoizContext;
 
 #define OFFSET(x) offsetof(FFTdnoizContext, x)
@@ -94,15 +95,20 @@ AVFILTER_DEFINE_CLASS(fftdnoiz);
 static av_cold int init(AVFilterContext *ctx)
 {
     FFTdnoizContext *s = ctx->priv;
-    int i;
+    int i, ret;
 
     for (i = 0; i < 4; i++) {
         PlaneContext *p = &s->planes[i];
+        float scale = 1.f;
 
-        p->fft  = av_fft_init(s->block_bits, 0);
-        p->ifft = av_fft_init(s->block_bits, 1);
-        if (!p->fft || !p->ifft)
-            return AVERROR(ENOMEM);
+        ret = av_tx_init(&p->fft, &p->tx_fn, AV_TX_FLOAT_FFT,
+                         0, 1 << s->block_bits, &scale, 0);
+        if (ret < 0)
+            return ret;
+        ret = av_tx_init(&p->ifft, &p->itx_fn, AV_TX_FLOAT_FFT,
+                         1, 1 << s->block_bits, &scale, 0);
+        if (ret < 0)
+            return ret;
     }
 
     return 0;
@@ -146,7 +152,7 @@ typedef struct ThreadData {
     float *src, *dst;
 } ThreadData;
 
-static void import_row8(FFTComplex *dst, uint8_t *src, int rw)
+static void import_row8(AVComplexFloat *dst, uint8_t *src, int rw)
 {
     int j;
 
@@ -156,7 +162,7 @@ static void import_row8(FFTComplex *dst, uint8_t *src, int rw)
     }
 }
 
-static void export_row8(FFTComplex *src, uint8_t *dst, int rw, float scale, int depth)
+static void export_row8(AVComplexFloat *src, uint8_t *dst, int rw, float scale, int depth)
 {
     int j;
 
@@ -164,7 +170,7 @@ static void export_row8(FFTComplex *src, uint8_t *dst, int rw, float scale, int
         dst[j] = av_clip_uint8(src[j].re * scale + 0.5f);
 }
 
-static void import_row16(FFTComplex *dst, uint8_t *srcp, int rw)
+static void import_row16(AVComplexFloat *dst, uint8_t *srcp, int rw)
 {
     uint16_t *src = (uint16_t *)srcp;
     int j;
@@ -175,7 +181,7 @@ static void import_row16(FFTComplex *dst, uint8_t *srcp, int rw)
     }
 }
 
-static void export_row16(FFTComplex *src, uint8_t *dstp, int rw, float scale, int depth)
+static void export_row16(AVComplexFloat *src, uint8_t *dstp, int rw, float scale, int depth)
 {
     uint16_t *dst = (uint16_t *)dstp;
     int j;
@@ -223,7 +229,7 @@ static int config_input(AVFilterLink *inlink)
 
         av_log(ctx, AV_LOG_DEBUG, "nox:%d noy:%d size:%d\n", p->nox, p->noy, size);
 
-        p->buffer_linesize = p->b * p->nox * sizeof(FFTComplex);
+        p->buffer_linesize = p->b * p->nox * sizeof(AVComplexFloat);
         p->buffer[CURRENT] = av_calloc(p->b * p->noy, p->buffer_linesize);
         if (!p->buffer[CURRENT])
             return AVERROR(ENOMEM);
@@ -239,7 +245,7 @@ static int config_input(AVFilterLink *inlink)
         }
         p->data_linesize = 2 * p->b * sizeof(float);
         p->hdata = av_calloc(p->b, p->data_linesize);
-        p->vdata = av_calloc(p->b, p->data_linesize);
+        p->vdata = av_calloc(p->b, sizeof(AVComplexFloat));
         if (!p->hdata || !p->vdata)
             return AVERROR(ENOMEM);
     }
@@ -260,9 +266,9 @@ static void import_plane(FFTdnoizContext *s,
     const int nox = p->nox;
     const int noy = p->noy;
     const int bpp = (s->depth + 7) / 8;
-    const int data_linesize = p->data_linesize / sizeof(FFTComplex);
-    FFTComplex *hdata = p->hdata;
-    FFTComplex *vdata = p->vdata;
+    const int data_linesize = p->data_linesize / sizeof(AVComplexFloat);
+    AVComplexFloat *hdata = p->hdata;
+    AVComplexFloat *vdata = p->vdata;
     int x, y, i, j;
 
     buffer_linesize /= sizeof(float);
@@ -272,37 +278,33 @@ static void import_plane(FFTdnoizContext *s,
             const int rw = FFMIN(block, width  - x * size);
             uint8_t *src = srcp + src_linesize * y * size + x * size * bpp;
             float *bdst = buffer + buffer_linesize * y * block + x * block * 2;
-            FFTComplex *ssrc, *dst = hdata;
+            AVComplexFloat *dst = hdata;
 
             for (i = 0; i < rh; i++) {
-                s->import_row(dst, src, rw);
+                s->import_row(vdata, src, rw);
                 for (j = rw; j < block; j++) {
-                    dst[j].re = dst[block - j - 1].re;
-                    dst[j].im = 0;
+                    vdata[j].re = vdata[block - j - 1].re;
+                    vdata[j].im = 0;
                 }
-                av_fft_permute(p->fft, dst);
-                av_fft_calc(p->fft, dst);
+                p->tx_fn(p->fft, dst, vdata, sizeof(AVComplexFloat));
 
                 src += src_linesize;
                 dst += data_linesize;
             }
 
-            dst = hdata;
             for (; i < block; i++) {
-                for (j = 0; j < block; j++) {
-                    dst[j].re = dst[(block - i - 1) * data_linesize + j].re;
-                    dst[j].im = dst[(block - i - 1) * data_linesize + j].im;
-                }
+                memcpy(dst, hdata + (block - i - 1) * data_linesize,
+                       block * sizeof(AVComplexFloat));
+                dst += data_linesize;
             }
 
-            ssrc = hdata;
-            dst = vdata;
+            /* Columns are transformed in place, all at once */
+            av_tx_batch(p->fft, hdata, hdata, p->data_linesize,
+                        sizeof(AVComplexFloat), block);
+
+            dst = hdata;
             for (i = 0; i < block; i++) {
-                for (j = 0; j < block; j++)
-                    dst[j] = ssrc[j * data_linesize + i];
-                av_fft_permute(p->fft, dst);
-                av_fft_calc(p->fft, dst);
-                memcpy(bdst, dst, block * sizeof(FFTComplex));
+                memcpy(bdst, dst, block * sizeof(AVComplexFloat));
 
                 dst += data_linesize;
                 bdst += buffer_linesize;
@@ -326,11 +328,11 @@ static void export_plane(FFTdnoizContext *s,
     const int size = block - overlap;
     const int nox = p->nox;
     const int noy = p->noy;
-    const int data_linesize = p->data_linesize / sizeof(FFTComplex);
+    const int data_linesize = p->data_linesize / sizeof(AVComplexFloat);
     const float scale = 1.f / (block * block);
-    FFTComplex *hdata = p->hdata;
-    FFTComplex *vdata = p->vdata;
-    int x, y, i, j;
+    AVComplexFloat *hdata = p->hdata;
+    AVComplexFloat *vdata = p->vdata;
+    int x, y, i;
 
     buffer_linesize /= sizeof(float);
     for (y = 0; y < noy; y++) {
@@ -341,26 +343,22 @@ static void export_plane(FFTdnoizContext *s,
             const int rh = y == 0 ? block : FFMIN(size, height - y * size - hoff);
             float *bsrc = buffer + buffer_linesize * y * block + x * block * 2;
             uint8_t *dst = dstp + dst_linesize * (y * size + hoff) + (x * size + woff) * bpp;
-            FFTComplex *hdst, *ddst = vdata;
+            AVComplexFloat *hdst = hdata;
 
-            hdst = hdata;
             for (i = 0; i < block; i++) {
-                memcpy(ddst, bsrc, block * sizeof(FFTComplex));
-                av_fft_permute(p->ifft, ddst);
-                av_fft_calc(p->ifft, ddst);
-                for (j = 0; j < block; j++) {
-                    hdst[j * data_linesize + i] = ddst[j];
-                }
+                memcpy(hdst, bsrc, block * sizeof(AVComplexFloat));
 
-                ddst += data_linesize;
+                hdst += data_linesize;
                 bsrc += buffer_linesize;
             }
 
+            av_tx_batch(p->ifft, hdata, hdata, p->data_linesize,
+                        sizeof(AVComplexFloat), block);
+
             hdst = hdata + hoff * data_linesize;
             for (i = 0; i < rh; i++) {
-                av_fft_permute(p->ifft, hdst);
-                av_fft_calc(p->ifft, hdst);
-                s->export_row(hdst + woff, dst, rw, scale, depth);
+                p->itx_fn(p->ifft, vdata, hdst, sizeof(AVComplexFloat));
+                s->export_row(vdata + woff, dst, rw, scale, depth);
 
                 hdst += data_linesize;
                 dst += dst_linesize;
@@ -657,8 +655,8 @@ static av_cold void uninit(AVFilterContext *ctx)
         av_freep(&p->buffer[PREV]);
         av_freep(&p->buffer[CURRENT]);
         av_freep(&p->buffer[NEXT]);
-        av_fft_end(p->fft);
-        av_fft_end(p->ifft);
+        av_tx_uninit(&p->fft);
+        av_tx_uninit(&p->ifft);
     }
 
     av_frame_free(&s->prev);
@@ -108,6 +108,8 @@ typedef struct ScaleContext {
     const AVClass *class;
     struct SwsContext *sws;     ///< software scaler context
     struct SwsContext *isws[2]; ///< software scaler context for interlaced material
+    struct SwsContext **slice_sws; ///< additional scaler contexts, one per extra slice thread
+    int nb_slice_sws;
     AVDictionary *opts;
 
     /**
@@ -328,6 +330,16 @@ static av_cold int init_dict(AVFilterContext *ctx, AVDictionary **opts)
     return 0;
 }
 
+static void free_slice_contexts(ScaleContext *scale)
+{
+    int i;
+
+    for (i = 0; i < scale->nb_slice_sws; i++)
+        sws_freeContext(scale->slice_sws[i]);
+    av_freep(&scale->slice_sws);
+    scale->nb_slice_sws = 0;
+}
+
 static av_cold void uninit(AVFilterContext *ctx)
 {
     ScaleContext *scale = ctx->priv;
@@ -338,6 +350,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     sws_freeContext(scale->isws[0]);
     sws_freeContext(scale->isws[1]);
     scale->sws = NULL;
+    free_slice_contexts(scale);
     av_dict_free(&scale->opts);
 }
 
@@ -478,6 +491,75 @@ fail:
     return ret;
 }
 
+/**
+ * Allocate and initialize a scaler context for the given link configuration.
+ * i selects the picture part: 0 for whole frames, 1 and 2 for the top and
+ * bottom field of interlaced material.
+ */
+static int alloc_sws_context(AVFilterContext *ctx, struct SwsContext **s,
+                             AVFilterLink *inlink0, AVFilterLink *outlink,
+                             enum AVPixelFormat outfmt, int i)
+{
+    ScaleContext *scale = ctx->priv;
+    int in_v_chr_pos = scale->in_v_chr_pos, out_v_chr_pos = scale->out_v_chr_pos;
+    int ret;
+
+    *s = sws_alloc_context();
+    if (!*s)
+        return AVERROR(ENOMEM);
+
+    av_opt_set_int(*s, "srcw", inlink0 ->w, 0);
+    av_opt_set_int(*s, "srch", inlink0 ->h >> !!i, 0);
+    av_opt_set_int(*s, "src_format", inlink0->format, 0);
+    av_opt_set_int(*s, "dstw", outlink->w, 0);
+    av_opt_set_int(*s, "dsth", outlink->h >> !!i, 0);
+    av_opt_set_int(*s, "dst_format", outfmt, 0);
+    av_opt_set_int(*s, "sws_flags", scale->flags, 0);
+    av_opt_set_int(*s, "param0", scale->param[0], 0);
+    av_opt_set_int(*s, "param1", scale->param[1], 0);
+    if (scale->in_range != AVCOL_RANGE_UNSPECIFIED)
+        av_opt_set_int(*s, "src_range",
+                       scale->in_range == AVCOL_RANGE_JPEG, 0);
+    if (scale->out_range != AVCOL_RANGE_UNSPECIFIED)
+        av_opt_set_int(*s, "dst_range",
+                       scale->out_range == AVCOL_RANGE_JPEG, 0);
+
+    if (scale->opts) {
+        AVDictionaryEntry *e = NULL;
+        while ((e = av_dict_get(scale->opts, "", e, AV_DICT_IGNORE_SUFFIX))) {
+            if ((ret = av_opt_set(*s, e->key, e->value, 0)) < 0)
+                return ret;
+        }
+    }
+    /* Override YUV420P default settings to have the correct (MPEG-2) chroma positions
+     * MPEG-2 chroma positions are used by convention
+     * XXX: support other 4:2:0 pixel formats */
+    if (inlink0->format == AV_PIX_FMT_YUV420P && scale->in_v_chr_pos == -513) {
+        in_v_chr_pos = (i == 0) ? 128 : (i == 1) ? 64 : 192;
+    }
+
+    if (outlink->format == AV_PIX_FMT_YUV420P && scale->out_v_chr_pos == -513) {
+        out_v_chr_pos = (i == 0) ? 128 : (i == 1) ? 64 : 192;
+    }
+
+    av_opt_set_int(*s, "src_h_chr_pos", scale->in_h_chr_pos, 0);
+    av_opt_set_int(*s, "src_v_chr_pos", in_v_chr_pos, 0);
+    av_opt_set_int(*s, "dst_h_chr_pos", scale->out_h_chr_pos, 0);
+    av_opt_set_int(*s, "dst_v_chr_pos", out_v_chr_pos, 0);
+
+    return sws_init_context(*s, NULL, NULL);
+}
+
+static int scale_slice_supported(struct SwsContext *sws)
+{
+    const uint8_t *src[4] = { NULL };
+    uint8_t *dst[4] = { NULL };
+    int stride[4] = { 0 };
+
+    /* an empty destination slice only checks whether the conversion can be split */
+    return sws_scale_slice(sws, src, stride, dst, stride, 0, 0) != AVERROR(ENOSYS);
+}
+
 static int config_props(AVFilterLink *outlink)
 {
     AVFilterContext *ctx = outlink->src;
@@ -520,6 +602,7 @@ static int config_props(AVFilterLink *outlink)
     if (scale->isws[1])
         sws_freeContext(scale->isws[1]);
     scale->isws[0] = scale->isws[1] = scale->sws = NULL;
+    free_slice_contexts(scale);
     if (inlink0->w == outlink->w &&
         inlink0->h == outlink->h &&
         !scale->out_color_matrix &&
@@ -528,59 +611,29 @@ static int config_props(AVFilterLink *outlink)
         ;
     else {
         struct SwsContext **swscs[3] = {&scale->sws, &scale->isws[0], &scale->isws[1]};
-        int i;
+        int i, nb_threads;
 
         for (i = 0; i < 3; i++) {
-            int in_v_chr_pos = scale->in_v_chr_pos, out_v_chr_pos = scale->out_v_chr_pos;
-            struct SwsContext **s = swscs[i];
-            *s = sws_alloc_context();
-            if (!*s)
-                return AVERROR(ENOMEM);
-
-            av_opt_set_int(*s, "srcw", inlink0 ->w, 0);
-            av_opt_set_int(*s, "srch", inlink0 ->h >> !!i, 0);
-            av_opt_set_int(*s, "src_format", inlink0->format, 0);
-            av_opt_set_int(*s, "dstw", outlink->w, 0);
-            av_opt_set_int(*s, "dsth", outlink->h >> !!i, 0);
-            av_opt_set_int(*s, "dst_format", outfmt, 0);
-            av_opt_set_int(*s, "sws_flags", scale->flags, 0);
-            av_opt_set_int(*s, "param0", scale->param[0], 0);
-            av_opt_set_int(*s, "param1", scale->param[1], 0);
-            if (scale->in_range != AVCOL_RANGE_UNSPECIFIED)
-                av_opt_set_int(*s, "src_range",
-                               scale->in_range == AVCOL_RANGE_JPEG, 0);
-            if (scale->out_range != AVCOL_RANGE_UNSPECIFIED)
-                av_opt_set_int(*s, "dst_range",
-                               scale->out_range == AVCOL_RANGE_JPEG, 0);
-
-            if (scale->opts) {
-                AVDictionaryEntry *e = NULL;
-                while ((e = av_dict_get(scale->opts, "", e, AV_DICT_IGNORE_SUFFIX))) {
-                    if ((ret = av_opt_set(*s, e->key, e->value, 0)) < 0)
-                        return ret;
-                }
-            }
-            /* Override YUV420P default settings to have the correct (MPEG-2) chroma positions
-             * MPEG-2 chroma positions are used by convention
-             * XXX: support other 4:2:0 pixel formats */
-            if (inlink0->format == AV_PIX_FMT_YUV420P && scale->in_v_chr_pos == -513) {
-                in_v_chr_pos = (i == 0) ? 128 : (i == 1) ? 64 : 192;
-            }
-
-            if (outlink->format == AV_PIX_FMT_YUV420P && scale->out_v_chr_pos == -513) {
-                out_v_chr_pos = (i == 0) ? 128 : (i == 1) ? 64 : 192;
-            }
-
-            av_opt_set_int(*s, "src_h_chr_pos", scale->in_h_chr_pos, 0);
-            av_opt_set_int(*s, "src_v_chr_pos", in_v_chr_pos, 0);
-            av_opt_set_int(*s, "dst_h_chr_pos", scale->out_h_chr_pos, 0);
-            av_opt_set_int(*s, "dst_v_chr_pos", out_v_chr_pos, 0);
-
-            if ((ret = sws_init_context(*s, NULL, NULL)) < 0)
+            if ((ret = alloc_sws_context(ctx, swscs[i], inlink0, outlink, outfmt, i)) < 0)
                 return ret;
             if (!scale->interlaced)
                 break;
         }
+
+        /* Progressive frames are split by output rows across the filter
+         * threads, each of which needs a scaler context of its own. */
+        nb_threads = ff_filter_get_nb_threads(ctx);
+        if (scale->interlaced <= 0 && !scale->nb_slices && nb_threads > 1 &&
+            outlink->h > 1 && scale_slice_supported(scale->sws)) {
+            scale->slice_sws = av_mallocz_array(nb_threads - 1, sizeof(*scale->slice_sws));
+            if (!scale->slice_sws)
+                return AVERROR(ENOMEM);
+            scale->nb_slice_sws = nb_threads - 1;
+            for (i = 0; i < scale->nb_slice_sws; i++) {
+                if ((ret = alloc_sws_context(ctx, &scale->slice_sws[i], inlink0, outlink, outfmt, 0)) < 0)
+                    return ret;
+            }
+        }
     }
 
     if (inlink0->sample_aspect_ratio.num){
@@ -647,6 +700,26 @@ static int scale_slice(AVFilterLink *link, AVFrame *out_buf, AVFrame *cur_pic, s
                          out,out_stride);
 }
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+} ThreadData;
+
+static int scale_slice_threaded(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ScaleContext *scale = ctx->priv;
+    ThreadData *td = arg;
+    AVFrame *in = td->in, *out = td->out;
+    struct SwsContext *sws = jobnr ? scale->slice_sws[jobnr - 1] : scale->sws;
+    const int vsub = av_pix_fmt_desc_get(out->format)->log2_chroma_h;
+    const int slice_start = ((out->height >> vsub) *  jobnr     ) / nb_jobs << vsub;
+    const int slice_end   = jobnr == nb_jobs - 1 ? out->height :
+                            ((out->height >> vsub) * (jobnr + 1)) / nb_jobs << vsub;
+
+    return sws_scale_slice(sws, (const uint8_t * const *)in->data, in->linesize,
+                           out->data, out->linesize,
+                           slice_start, slice_end - slice_start);
+}
+
 static int scale_frame(AVFilterLink *link, AVFrame *in, AVFrame **frame_out)
 {
     AVFilterContext *ctx = link->dst;
@@ -749,7 +822,7 @@ scale:
         || scale-> in_range != AVCOL_RANGE_UNSPECIFIED
         || in_range != AVCOL_RANGE_UNSPECIFIED
         || scale->out_range != AVCOL_RANGE_UNSPECIFIED) {
-        int in_full, out_full, brightness, contrast, saturation;
+        int in_full, out_full, brightness, contrast, saturation, i;
         const int *inv_table, *table;
 
         sws_getColorspaceDetails(scale->sws, (int **)&inv_table, &in_full,
@@ -781,6 +854,10 @@ scale:
             sws_setColorspaceDetails(scale->isws[1], inv_table, in_full,
                                      table, out_full,
                                      brightness, contrast, saturation);
+        for (i = 0; i < scale->nb_slice_sws; i++)
+            sws_setColorspaceDetails(scale->slice_sws[i], inv_table, in_full,
+                                     table, out_full,
+                                     brightness, contrast, saturation);
 
         out->color_range = out_full ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
     }
@@ -802,6 +879,11 @@ scale:
             slice_h     = slice_end - slice_start;
             scale_slice(link, out, in, scale->sws, slice_start, slice_h, 1, 0);
         }
+    } else if (scale->nb_slice_sws) {
+        ThreadData td = { .in = in, .out = out };
+        const int nb_jobs = FFMIN(scale->nb_slice_sws + 1,
+                                  outlink->h >> av_pix_fmt_desc_get(outlink->format)->log2_chroma_h);
+        ctx->internal->execute(ctx, scale_slice_threaded, &td, NULL, FFMAX(nb_jobs, 1));
     } else {
         scale_slice(link, out, in, scale->sws, 0, link->h, 1, 0);
     }
@@ -986,6 +1068,7 @@ AVFilter ff_vf_scale = {
     .inputs          = avfilter_vf_scale_inputs,
     .outputs         = avfilter_vf_scale_outputs,
     .process_command = process_command,
+    .flags           = AVFILTER_FLAG_SLICE_THREADS,
 };
 
 static const AVClass scale2ref_class = {
@@ -1041,4 +1124,5 @@ AVFilter ff_vf_scale2ref = {
     .inputs          = avfilter_vf_scale2ref_inputs,
     .outputs         = avfilter_vf_scale2ref_outputs,
     .process_command = process_command,
+    .flags           = AVFILTER_FLAG_SLICE_THREADS,
 };
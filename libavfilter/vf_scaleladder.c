@@ -0,0 +1,448 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * scale one input to several output resolutions at once
+ *
+ * Every output ("rung") is produced from the smallest already scaled rung
+ * that is at least as large in both dimensions, so a 1080p input feeding
+ * 720p, 480p and 360p outputs is only read once at full resolution.
+ */
+
+#include "libavutil/avstring.h"
+#include "libavutil/internal.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/parseutils.h"
+#include "libavutil/pixdesc.h"
+#include "libswscale/swscale.h"
+
+#include "avfilter.h"
+#include "filters.h"
+#include "formats.h"
+#include "internal.h"
+#include "video.h"
+
+typedef struct LadderRung {
+    int w, h;
+    int src;                    ///< index of the rung scaled from, -1 for the input
+    struct SwsContext **sws;    ///< scaler contexts, one per slice thread when threaded
+    int nb_sws;
+    struct SwsContext *isws[2]; ///< scaler contexts for the fields of interlaced material
+    int threaded;               ///< set if the rung is scaled with sws_scale_slice()
+} LadderRung;
+
+typedef struct ScaleLadderContext {
+    const AVClass *class;
+    char *sizes_str;
+    char *flags_str;
+    int cascade;
+    int interlaced;
+
+    unsigned int flags;         ///< sws flags
+    LadderRung *rungs;
+    int nb_rungs;
+    int *order;                 ///< rung indices by decreasing area
+    AVFrame **frames;
+} ScaleLadderContext;
+
+typedef struct ThreadData {
+    LadderRung *rung;
+    AVFrame *in, *out;
+} ThreadData;
+
+static int config_output(AVFilterLink *outlink);
+
+static av_cold int init(AVFilterContext *ctx)
+{
+    ScaleLadderContext *s = ctx->priv;
+    char *p, *arg, *saveptr = NULL;
+    int i, j, ret;
+
+    if (!s->sizes_str || !*s->sizes_str) {
+        av_log(ctx, AV_LOG_ERROR, "No output sizes specified.\n");
+        return AVERROR(EINVAL);
+    }
+
+    p = s->sizes_str;
+    while ((arg = av_strtok(p, "|", &saveptr))) {
+        LadderRung *rung;
+        p = NULL;
+
+        ret = av_reallocp_array(&s->rungs, s->nb_rungs + 1, sizeof(*s->rungs));
+        if (ret < 0) {
+            s->nb_rungs = 0;
+            return ret;
+        }
+        rung = &s->rungs[s->nb_rungs++];
+        memset(rung, 0, sizeof(*rung));
+        if ((ret = av_parse_video_size(&rung->w, &rung->h, arg)) < 0) {
+            av_log(ctx, AV_LOG_ERROR, "Invalid size '%s'\n", arg);
+            return ret;
+        }
+    }
+    if (!s->nb_rungs)
+        return AVERROR(EINVAL);
+
+    s->order  = av_malloc_array(s->nb_rungs, sizeof(*s->order));
+    s->frames = av_mallocz_array(s->nb_rungs, sizeof(*s->frames));
+    if (!s->order || !s->frames)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < s->nb_rungs; i++) {
+        int64_t area = (int64_t)s->rungs[i].w * s->rungs[i].h;
+        for (j = i; j > 0; j--) {
+            const LadderRung *prev = &s->rungs[s->order[j - 1]];
+            if ((int64_t)prev->w * prev->h >= area)
+                break;
+            s->order[j] = s->order[j - 1];
+        }
+        s->order[j] = i;
+    }
+
+    for (i = 0; i < s->nb_rungs; i++) {
+        LadderRung *rung = &s->rungs[s->order[i]];
+        rung->src = -1;
+        if (!s->cascade)
+            continue;
+        /* the last larger rung in the order is the closest one */
+        for (j = 0; j < i; j++) {
+            const LadderRung *prev = &s->rungs[s->order[j]];
+            if (prev->w >= rung->w && prev->h >= rung->h)
+                rung->src = s->order[j];
+        }
+    }
+
+    for (i = 0; i < s->nb_rungs; i++) {
+        AVFilterPad pad = { 0 };
+
+        pad.type         = AVMEDIA_TYPE_VIDEO;
+        pad.config_props = config_output;
+        pad.name         = av_asprintf("output%d", i);
+        if (!pad.name)
+            return AVERROR(ENOMEM);
+
+        if ((ret = ff_insert_outpad(ctx, i, &pad)) < 0) {
+            av_freep(&pad.name);
+            return ret;
+        }
+    }
+
+    s->flags = 0;
+    if (s->flags_str) {
+        const AVClass *class = sws_get_class();
+        const AVOption    *o = av_opt_find(&class, "sws_flags", NULL, 0,
+                                           AV_OPT_SEARCH_FAKE_OBJ);
+        ret = av_opt_eval_flags(&class, o, s->flags_str, &s->flags);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+static void free_rung_contexts(LadderRung *rung)
+{
+    int i;
+
+    for (i = 0; i < rung->nb_sws; i++)
+        sws_freeContext(rung->sws[i]);
+    av_freep(&rung->sws);
+    sws_freeContext(rung->isws[0]);
+    sws_freeContext(rung->isws[1]);
+    rung->isws[0]  = rung->isws[1] = NULL;
+    rung->nb_sws   = 0;
+    rung->threaded = 0;
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    ScaleLadderContext *s = ctx->priv;
+    int i;
+
+    for (i = 0; i < s->nb_rungs; i++)
+        free_rung_contexts(&s->rungs[i]);
+    for (i = 0; i < ctx->nb_outputs; i++)
+        av_freep(&ctx->output_pads[i].name);
+    av_freep(&s->rungs);
+    av_freep(&s->order);
+    av_freep(&s->frames);
+    s->nb_rungs = 0;
+}
+
+static int query_formats(AVFilterContext *ctx)
+{
+    AVFilterFormats *formats = NULL;
+    const AVPixFmtDescriptor *desc = NULL;
+    int ret;
+
+    /* every rung may serve as the source of a smaller one, so only
+     * formats the scaler reads and writes are usable */
+    while ((desc = av_pix_fmt_desc_next(desc))) {
+        enum AVPixelFormat pix_fmt = av_pix_fmt_desc_get_id(desc);
+        if (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL))
+            continue;
+        if (sws_isSupportedInput(pix_fmt) && sws_isSupportedOutput(pix_fmt) &&
+            (ret = ff_add_format(&formats, pix_fmt)) < 0)
+            return ret;
+    }
+
+    return ff_set_common_formats(ctx, formats);
+}
+
+/**
+ * Allocate and initialize a scaler context. field selects the picture part:
+ * 0 for whole frames, 1 and 2 for the top and bottom field of interlaced
+ * material.
+ */
+static int alloc_sws_context(ScaleLadderContext *s, struct SwsContext **sws,
+                             int srcw, int srch, int dstw, int dsth,
+                             enum AVPixelFormat format, int field)
+{
+    *sws = sws_alloc_context();
+    if (!*sws)
+        return AVERROR(ENOMEM);
+
+    av_opt_set_int(*sws, "srcw", srcw, 0);
+    av_opt_set_int(*sws, "srch", srch >> !!field, 0);
+    av_opt_set_int(*sws, "src_format", format, 0);
+    av_opt_set_int(*sws, "dstw", dstw, 0);
+    av_opt_set_int(*sws, "dsth", dsth >> !!field, 0);
+    av_opt_set_int(*sws, "dst_format", format, 0);
+    av_opt_set_int(*sws, "sws_flags", s->flags, 0);
+    /* MPEG-2 chroma positions of the fields, as in the scale filter */
+    if (field && format == AV_PIX_FMT_YUV420P) {
+        av_opt_set_int(*sws, "src_v_chr_pos", field == 1 ? 64 : 192, 0);
+        av_opt_set_int(*sws, "dst_v_chr_pos", field == 1 ? 64 : 192, 0);
+    }
+
+    return sws_init_context(*sws, NULL, NULL);
+}
+
+static int config_output(AVFilterLink *outlink)
+{
+    AVFilterContext *ctx = outlink->src;
+    ScaleLadderContext *s = ctx->priv;
+    AVFilterLink *inlink = ctx->inputs[0];
+    LadderRung *rung = &s->rungs[FF_OUTLINK_IDX(outlink)];
+    const uint8_t *src[4] = { NULL };
+    uint8_t *dst[4] = { NULL };
+    int stride[4] = { 0 };
+    int i, srcw, srch, nb_threads, ret;
+
+    /* never cascade through a rung that was upscaled from the input */
+    if (rung->src >= 0 && (s->rungs[rung->src].w > inlink->w ||
+                           s->rungs[rung->src].h > inlink->h))
+        rung->src = -1;
+    srcw = rung->src < 0 ? inlink->w : s->rungs[rung->src].w;
+    srch = rung->src < 0 ? inlink->h : s->rungs[rung->src].h;
+
+    outlink->w = rung->w;
+    outlink->h = rung->h;
+    if (inlink->sample_aspect_ratio.num)
+        outlink->sample_aspect_ratio = av_mul_q((AVRational){ outlink->h * inlink->w,
+                                                              outlink->w * inlink->h },
+                                                inlink->sample_aspect_ratio);
+    else
+        outlink->sample_aspect_ratio = inlink->sample_aspect_ratio;
+
+    free_rung_contexts(rung);
+    rung->sws = av_mallocz(sizeof(*rung->sws));
+    if (!rung->sws)
+        return AVERROR(ENOMEM);
+    rung->nb_sws = 1;
+    if ((ret = alloc_sws_context(s, &rung->sws[0], srcw, srch,
+                                 rung->w, rung->h, outlink->format, 0)) < 0)
+        return ret;
+    for (i = 0; i < 2 && s->interlaced; i++) {
+        if ((ret = alloc_sws_context(s, &rung->isws[i], srcw, srch,
+                                     rung->w, rung->h, outlink->format, i + 1)) < 0)
+            return ret;
+    }
+
+    /* an empty destination slice only checks whether the conversion can be split */
+    nb_threads = ff_filter_get_nb_threads(ctx);
+    if (nb_threads > 1 && rung->h > 1 &&
+        sws_scale_slice(rung->sws[0], src, stride, dst, stride, 0, 0) != AVERROR(ENOSYS)) {
+        ret = av_reallocp_array(&rung->sws, nb_threads, sizeof(*rung->sws));
+        if (ret < 0) {
+            rung->nb_sws = 0;
+            return ret;
+        }
+        for (i = 1; i < nb_threads; i++) {
+            rung->sws[i] = NULL;
+            rung->nb_sws++;
+            if ((ret = alloc_sws_context(s, &rung->sws[i], srcw, srch,
+                                         rung->w, rung->h, outlink->format, 0)) < 0)
+                return ret;
+        }
+        rung->threaded = 1;
+    }
+
+    av_log(ctx, AV_LOG_VERBOSE, "output%d: %dx%d from %s %dx%d%s\n",
+           FF_OUTLINK_IDX(outlink), rung->w, rung->h,
+           rung->src < 0 ? "input" : "rung", srcw, srch,
+           rung->threaded ? " (slice threaded)" : "");
+
+    return 0;
+}
+
+static int scale_rung_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    AVFrame *in = td->in, *out = td->out;
+    const int vsub = av_pix_fmt_desc_get(out->format)->log2_chroma_h;
+    const int slice_start = ((out->height >> vsub) *  jobnr     ) / nb_jobs << vsub;
+    const int slice_end   = jobnr == nb_jobs - 1 ? out->height :
+                            ((out->height >> vsub) * (jobnr + 1)) / nb_jobs << vsub;
+
+    return sws_scale_slice(td->rung->sws[jobnr], (const uint8_t * const *)in->data, in->linesize,
+                           out->data, out->linesize,
+                           slice_start, slice_end - slice_start);
+}
+
+static int scale_field(struct SwsContext *sws, AVFrame *in, AVFrame *out, int field)
+{
+    const uint8_t *src[4] = { NULL };
+    uint8_t *dst[4] = { NULL };
+    int src_stride[4] = { 0 }, dst_stride[4] = { 0 };
+    int i;
+
+    for (i = 0; i < 4 && in->data[i]; i++) {
+        src_stride[i] = in->linesize[i] * 2;
+        dst_stride[i] = out->linesize[i] * 2;
+        src[i] = in->data[i]  + field * in->linesize[i];
+        dst[i] = out->data[i] + field * out->linesize[i];
+    }
+
+    return sws_scale(sws, src, src_stride, 0, in->height >> 1, dst, dst_stride);
+}
+
+static int scale_rung(AVFilterContext *ctx, LadderRung *rung, AVFrame *in, AVFrame *out)
+{
+    ScaleLadderContext *s = ctx->priv;
+    int ret;
+
+    if (s->interlaced > 0 || (s->interlaced < 0 && in->interlaced_frame)) {
+        if ((ret = scale_field(rung->isws[0], in, out, 0)) < 0 ||
+            (ret = scale_field(rung->isws[1], in, out, 1)) < 0)
+            return ret;
+        return 0;
+    }
+
+    if (rung->threaded) {
+        ThreadData td = { .rung = rung, .in = in, .out = out };
+        const int vsub = av_pix_fmt_desc_get(out->format)->log2_chroma_h;
+        const int nb_jobs = FFMAX(FFMIN(rung->nb_sws, out->height >> vsub), 1);
+
+        ctx->internal->execute(ctx, scale_rung_slice, &td, NULL, nb_jobs);
+        return 0;
+    }
+
+    ret = sws_scale(rung->sws[0], (const uint8_t * const *)in->data, in->linesize,
+                    0, in->height, out->data, out->linesize);
+    return FFMIN(ret, 0);
+}
+
+static int filter_frame(AVFilterLink *inlink, AVFrame *in)
+{
+    AVFilterContext *ctx = inlink->dst;
+    ScaleLadderContext *s = ctx->priv;
+    int i, ret = 0;
+
+    for (i = 0; i < s->nb_rungs; i++) {
+        const int idx = s->order[i];
+        LadderRung *rung = &s->rungs[idx];
+        AVFilterLink *outlink = ctx->outputs[idx];
+        AVFrame *src = rung->src < 0 ? in : s->frames[rung->src];
+        AVFrame *out;
+
+        out = ff_get_video_buffer(outlink, outlink->w, outlink->h);
+        if (!out) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        s->frames[idx] = out;
+
+        av_frame_copy_props(out, in);
+        out->width  = outlink->w;
+        out->height = outlink->h;
+        av_reduce(&out->sample_aspect_ratio.num, &out->sample_aspect_ratio.den,
+                  (int64_t)in->sample_aspect_ratio.num * outlink->h * inlink->w,
+                  (int64_t)in->sample_aspect_ratio.den * outlink->w * inlink->h,
+                  INT_MAX);
+
+        if ((ret = scale_rung(ctx, rung, src, out)) < 0)
+            goto end;
+    }
+
+    for (i = 0; i < s->nb_rungs; i++) {
+        AVFrame *out = s->frames[i];
+
+        s->frames[i] = NULL;
+        if (ff_outlink_get_status(ctx->outputs[i])) {
+            av_frame_free(&out);
+            continue;
+        }
+        if ((ret = ff_filter_frame(ctx->outputs[i], out)) < 0)
+            goto end;
+    }
+    ret = 0;
+
+end:
+    for (i = 0; i < s->nb_rungs; i++)
+        av_frame_free(&s->frames[i]);
+    av_frame_free(&in);
+    return ret;
+}
+
+#define OFFSET(x) offsetof(ScaleLadderContext, x)
+#define FLAGS AV_OPT_FLAG_VIDEO_PARAM|AV_OPT_FLAG_FILTERING_PARAM
+
+static const AVOption scaleladder_options[] = {
+    { "sizes",   "set '|'-separated list of output sizes", OFFSET(sizes_str), AV_OPT_TYPE_STRING, { .str = NULL },       .flags = FLAGS },
+    { "flags",   "flags to pass to libswscale",            OFFSET(flags_str), AV_OPT_TYPE_STRING, { .str = "bilinear" }, .flags = FLAGS },
+    { "cascade", "scale each output from the closest larger output", OFFSET(cascade), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, FLAGS },
+    { "interl",  "set interlacing",                        OFFSET(interlaced), AV_OPT_TYPE_BOOL, { .i64 = 0 }, -1, 1, FLAGS },
+    { NULL }
+};
+
+AVFILTER_DEFINE_CLASS(scaleladder);
+
+static const AVFilterPad scaleladder_inputs[] = {
+    {
+        .name         = "default",
+        .type         = AVMEDIA_TYPE_VIDEO,
+        .filter_frame = filter_frame,
+    },
+    { NULL }
+};
+
+AVFilter ff_vf_scaleladder = {
+    .name          = "scaleladder",
+    .description   = NULL_IF_CONFIG_SMALL("Scale the input video to several output sizes."),
+    .priv_size     = sizeof(ScaleLadderContext),
+    .priv_class    = &scaleladder_class,
+    .init          = init,
+    .uninit        = uninit,
+    .query_formats = query_formats,
+    .inputs        = scaleladder_inputs,
+    .outputs       = NULL,
+    .flags         = AVFILTER_FLAG_DYNAMIC_OUTPUTS | AVFILTER_FLAG_SLICE_THREADS,
+};
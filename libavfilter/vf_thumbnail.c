@@ -42,8 +42,15 @@ typedef struct ThumbContext {
     const AVClass *class;
     int n;                      ///< current frame
     int n_frames;               ///< number of frames for analysis
-    struct thumb_frame *frames; ///< the n_frames frames
+    int low_memory;             ///< keep only the best frame so far
+    struct thumb_frame *frames; ///< the n_frames frames, or the best and the current one in low memory mode
     AVRational tb;              ///< copy of the input timebase to ease access
+
+    int best_frame_idx;         ///< index of the best frame so far in low memory mode
+    int64_t hist_sum[HIST_SIZE];///< sum of the histograms of the batch in low memory mode
+
+    int *thread_hist;           ///< per-job histograms of the current frame
+    int nb_threads;
 } ThumbContext;
 
 #define OFFSET(x) offsetof(ThumbContext, x)
@@ -51,6 +58,7 @@ typedef struct ThumbContext {
 
 static const AVOption thumbnail_options[] = {
     { "n", "set the frames batch size", OFFSET(n_frames), AV_OPT_TYPE_INT, {.i64=100}, 2, INT_MAX, FLAGS },
+    { "low_memory", "keep only the best frame so far instead of the whole batch", OFFSET(low_memory), AV_OPT_TYPE_BOOL, {.i64=0}, 0, 1, FLAGS },
     { NULL }
 };
 
@@ -60,7 +68,7 @@ static av_cold int init(AVFilterContext *ctx)
 {
     ThumbContext *s = ctx->priv;
 
-    s->frames = av_calloc(s->n_frames, sizeof(*s->frames));
+    s->frames = av_calloc(s->low_memory ? 2 : s->n_frames, sizeof(*s->frames));
     if (!s->frames) {
         av_log(ctx, AV_LOG_ERROR,
                "Allocation failure, try to lower the number of frames\n");
@@ -96,6 +104,18 @@ static AVFrame *get_best_frame(AVFilterContext *ctx)
     int nb_frames = s->n;
     double avg_hist[HIST_SIZE] = {0}, sq_err, min_sq_err = -1;
 
+    if (s->low_memory) {
+        // the best frame has been selected already, see update_best_frame()
+        picref = s->frames[0].buf;
+        av_log(ctx, AV_LOG_INFO, "frame id #%d (pts_time=%f) selected "
+               "from a set of %d images\n", s->best_frame_idx,
+               picref->pts * av_q2d(s->tb), nb_frames);
+        s->frames[0].buf = NULL;
+        memset(s->hist_sum, 0, sizeof(s->hist_sum));
+        s->n = 0;
+        return picref;
+    }
+
     // average histogram of the N frames
     for (j = 0; j < FF_ARRAY_ELEMS(avg_hist); j++) {
         for (i = 0; i < nb_frames; i++)
@@ -128,28 +148,85 @@ static AVFrame *get_best_frame(AVFilterContext *ctx)
     return picref;
 }
 
+/**
+ * Keep the better one of the best frame so far and the current frame,
+ * judged by their closeness to the average histogram of the frames so far.
+ * This approximates the selection against the average of the whole batch
+ * without keeping all of its frames.
+ */
+static void update_best_frame(ThumbContext *s)
+{
+    struct thumb_frame *best = &s->frames[0], *cur = &s->frames[1];
+    double avg_hist[HIST_SIZE];
+    int i;
+
+    for (i = 0; i < HIST_SIZE; i++) {
+        s->hist_sum[i] += cur->histogram[i];
+        avg_hist[i] = (double)s->hist_sum[i] / (s->n + 1);
+    }
+
+    if (!best->buf ||
+        frame_sum_square_err(cur->histogram, avg_hist) <
+        frame_sum_square_err(best->histogram, avg_hist)) {
+        av_frame_free(&best->buf);
+        FFSWAP(struct thumb_frame, *best, *cur);
+        s->best_frame_idx = s->n;
+    } else {
+        av_frame_free(&cur->buf);
+    }
+}
+
+static int do_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ThumbContext *s = ctx->priv;
+    AVFrame *frame = arg;
+    int *hist = s->thread_hist + HIST_SIZE * jobnr;
+    const int h = frame->height;
+    const int w = frame->width;
+    const int slice_start = (h * jobnr) / nb_jobs;
+    const int slice_end = (h * (jobnr+1)) / nb_jobs;
+    const uint8_t *p = frame->data[0] + slice_start * frame->linesize[0];
+    int i, j;
+
+    memset(hist, 0, sizeof(*hist) * HIST_SIZE);
+
+    for (j = slice_start; j < slice_end; j++) {
+        for (i = 0; i < w; i++) {
+            hist[0*256 + p[i*3    ]]++;
+            hist[1*256 + p[i*3 + 1]]++;
+            hist[2*256 + p[i*3 + 2]]++;
+        }
+        p += frame->linesize[0];
+    }
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
 {
     int i, j;
     AVFilterContext *ctx  = inlink->dst;
     ThumbContext *s   = ctx->priv;
     AVFilterLink *outlink = ctx->outputs[0];
-    int *hist = s->frames[s->n].histogram;
-    const uint8_t *p = frame->data[0];
+    struct thumb_frame *cur = &s->frames[s->low_memory ? 1 : s->n];
+    int *hist = cur->histogram;
+    int nb_jobs = FFMIN(frame->height, s->nb_threads);
 
     // keep a reference of each frame
-    s->frames[s->n].buf = frame;
+    cur->buf = frame;
 
     // update current frame RGB histogram
-    for (j = 0; j < inlink->h; j++) {
-        for (i = 0; i < inlink->w; i++) {
-            hist[0*256 + p[i*3    ]]++;
-            hist[1*256 + p[i*3 + 1]]++;
-            hist[2*256 + p[i*3 + 2]]++;
-        }
-        p += frame->linesize[0];
+    ctx->internal->execute(ctx, do_slice, frame, NULL, nb_jobs);
+    memset(hist, 0, sizeof(cur->histogram));
+    for (j = 0; j < nb_jobs; j++) {
+        const int *thread_hist = s->thread_hist + HIST_SIZE * j;
+        for (i = 0; i < HIST_SIZE; i++)
+            hist[i] += thread_hist[i];
     }
 
+    if (s->low_memory)
+        update_best_frame(s);
+
     // no selection until the buffer of N frames is filled up
     s->n++;
     if (s->n < s->n_frames)
@@ -162,9 +239,10 @@ static av_cold void uninit(AVFilterContext *ctx)
 {
     int i;
     ThumbContext *s = ctx->priv;
-    for (i = 0; i < s->n_frames && s->frames && s->frames[i].buf; i++)
+    for (i = 0; i < (s->low_memory ? 2 : s->n_frames) && s->frames && s->frames[i].buf; i++)
         av_frame_free(&s->frames[i].buf);
     av_freep(&s->frames);
+    av_freep(&s->thread_hist);
 }
 
 static int request_frame(AVFilterLink *link)
@@ -190,6 +268,10 @@ static int config_props(AVFilterLink *inlink)
     ThumbContext *s = ctx->priv;
 
     s->tb = inlink->time_base;
+    s->nb_threads = ff_filter_get_nb_threads(ctx);
+    s->thread_hist = av_calloc(s->nb_threads, HIST_SIZE * sizeof(*s->thread_hist));
+    if (!s->thread_hist)
+        return AVERROR(ENOMEM);
     return 0;
 }
 
@@ -234,5 +316,5 @@ AVFilter ff_vf_thumbnail = {
     .inputs        = thumbnail_inputs,
     .outputs       = thumbnail_outputs,
     .priv_class    = &thumbnail_class,
-    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC,
+    .flags         = AVFILTER_FLAG_SUPPORT_TIMELINE_GENERIC | AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -22,6 +22,7 @@
 #include "libavutil/avstring.h"
 #include "libavutil/dict.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "libavutil/avassert.h"
 #include "os_support.h"
@@ -58,6 +59,8 @@ static const AVOption options[] = {
     {"protocol_whitelist", "List of protocols that are allowed to be used", OFFSET(protocol_whitelist), AV_OPT_TYPE_STRING, { .str = NULL },  0, 0, D },
     {"protocol_blacklist", "List of protocols that are not allowed to be used", OFFSET(protocol_blacklist), AV_OPT_TYPE_STRING, { .str = NULL },  0, 0, D },
     {"rw_timeout", "Timeout for IO operations (in microseconds)", offsetof(URLContext, rw_timeout), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, AV_OPT_FLAG_ENCODING_PARAM | AV_OPT_FLAG_DECODING_PARAM },
+    {"prefetch_size", "Size of the read-ahead buffer filled in the background (0 disables it)", OFFSET(prefetch_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, D },
+    {"prefetch_low_watermark", "Resume reading ahead once less than this many bytes are buffered (-1 is half of the buffer)", OFFSET(prefetch_low_watermark), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, INT_MAX, D },
     { NULL }
 };
 
@@ -406,10 +409,315 @@ static inline int retry_transfer_wrapper(URLContext *h, uint8_t *buf,
     return len;
 }
 
+/** @name Read-ahead. */
+/*@{*/
+#if HAVE_THREADS
+
+#define PREFETCH_BLOCK_SIZE (256 * 1024)
+
+/**
+ * Ring buffer filled by a background thread, which is the only one calling
+ * into the protocol once prefetching has started. The ring keeps the most
+ * recently returned data in front of the read position, so that short seeks
+ * in either direction are served without touching the protocol.
+ */
+typedef struct URLPrefetch {
+    uint8_t *buf;
+    int size;
+    int low_watermark;
+
+    int rpos;               ///< ring index of the next byte to return
+    int unread;             ///< bytes available at rpos
+    int back;               ///< bytes already returned still kept before rpos
+    int64_t pos;            ///< logical position of rpos
+    int filling;
+    int eof;
+    int error;
+
+    int seek_request;
+    int64_t seek_pos;
+    int seek_whence;
+    int64_t seek_ret;
+
+    int abort_request;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_mutex_t prot_mutex; ///< held around every call into the protocol
+    pthread_cond_t cond_main;
+    pthread_cond_t cond_worker;
+} URLPrefetch;
+
+static void *prefetch_worker(void *arg)
+{
+    URLContext *h   = arg;
+    URLPrefetch *p  = h->prefetch;
+
+    pthread_mutex_lock(&p->mutex);
+    while (!p->abort_request) {
+        int idx, len, ret;
+
+        if (p->seek_request) {
+            int64_t pos = p->seek_pos;
+            int whence  = p->seek_whence;
+            int64_t ret64;
+
+            pthread_mutex_unlock(&p->mutex);
+            pthread_mutex_lock(&p->prot_mutex);
+            ret64 = h->prot->url_seek ? h->prot->url_seek(h, pos, whence) :
+                                        AVERROR(ENOSYS);
+            pthread_mutex_unlock(&p->prot_mutex);
+            pthread_mutex_lock(&p->mutex);
+            if (ret64 >= 0 && whence != AVSEEK_SIZE) {
+                p->pos     = ret64;
+                p->unread  = 0;
+                p->back    = 0;
+                p->filling = 1;
+                p->eof     = 0;
+                p->error   = 0;
+            }
+            p->seek_ret     = ret64;
+            p->seek_request = 0;
+            pthread_cond_signal(&p->cond_main);
+            continue;
+        }
+
+        if (p->unread == p->size)
+            p->filling = 0;
+        if (!p->filling || p->eof || p->error) {
+            pthread_cond_wait(&p->cond_worker, &p->mutex);
+            continue;
+        }
+
+        idx = (p->rpos + p->unread) % p->size;
+        len = FFMIN(p->size - p->unread, p->size - idx);
+        len = FFMIN(len, PREFETCH_BLOCK_SIZE);
+        /* The area about to be written no longer counts as seekback data. */
+        p->back = FFMIN(p->back, p->size - p->unread - len);
+        pthread_mutex_unlock(&p->mutex);
+
+        pthread_mutex_lock(&p->prot_mutex);
+        ret = retry_transfer_wrapper(h, p->buf + idx, len, 1, h->prot->url_read);
+        pthread_mutex_unlock(&p->prot_mutex);
+
+        pthread_mutex_lock(&p->mutex);
+        if (ret == AVERROR_EOF)
+            p->eof = 1;
+        else if (ret < 0)
+            p->error = ret;
+        else
+            p->unread += ret;
+        pthread_cond_signal(&p->cond_main);
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    return NULL;
+}
+
+static int prefetch_read(URLContext *h, unsigned char *buf, int size)
+{
+    URLPrefetch *p = h->prefetch;
+    int ret, len;
+
+    pthread_mutex_lock(&p->mutex);
+    while (!p->unread && !p->eof && !p->error) {
+        if (h->flags & AVIO_FLAG_NONBLOCK) {
+            pthread_mutex_unlock(&p->mutex);
+            return AVERROR(EAGAIN);
+        }
+        if (!p->filling) {
+            p->filling = 1;
+            pthread_cond_signal(&p->cond_worker);
+        }
+        pthread_cond_wait(&p->cond_main, &p->mutex);
+    }
+    if (!p->unread) {
+        ret = p->error ? p->error : AVERROR_EOF;
+        pthread_mutex_unlock(&p->mutex);
+        return ret;
+    }
+
+    len = FFMIN(size, p->unread);
+    ret = FFMIN(len, p->size - p->rpos);
+    memcpy(buf, p->buf + p->rpos, ret);
+    memcpy(buf + ret, p->buf, len - ret);
+    p->rpos    = (p->rpos + len) % p->size;
+    p->unread -= len;
+    p->back   += len;
+    p->pos    += len;
+
+    if (!p->filling && p->unread <= p->low_watermark) {
+        p->filling = 1;
+        pthread_cond_signal(&p->cond_worker);
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    return len;
+}
+
+static int64_t prefetch_seek(URLContext *h, int64_t pos, int whence)
+{
+    URLPrefetch *p = h->prefetch;
+    int64_t ret;
+
+    whence &= ~AVSEEK_FORCE;
+
+    pthread_mutex_lock(&p->mutex);
+    if (whence == SEEK_CUR) {
+        pos   += p->pos;
+        whence = SEEK_SET;
+    }
+    if (whence == SEEK_SET &&
+        pos - p->pos >= -p->back && pos - p->pos <= p->unread) {
+        int delta  = pos - p->pos;
+        p->rpos    = (p->rpos + delta + p->size) % p->size;
+        p->unread -= delta;
+        p->back   += delta;
+        p->pos     = pos;
+        pthread_mutex_unlock(&p->mutex);
+        return pos;
+    }
+
+    p->seek_request = 1;
+    p->seek_pos     = pos;
+    p->seek_whence  = whence;
+    pthread_cond_signal(&p->cond_worker);
+    while (p->seek_request)
+        pthread_cond_wait(&p->cond_main, &p->mutex);
+    ret = p->seek_ret;
+    pthread_mutex_unlock(&p->mutex);
+
+    return ret;
+}
+
+static void prefetch_uninit(URLContext *h)
+{
+    URLPrefetch *p = h->prefetch;
+
+    pthread_mutex_lock(&p->mutex);
+    p->abort_request = 1;
+    pthread_cond_signal(&p->cond_worker);
+    pthread_mutex_unlock(&p->mutex);
+    pthread_join(p->thread, NULL);
+
+    pthread_cond_destroy(&p->cond_worker);
+    pthread_cond_destroy(&p->cond_main);
+    pthread_mutex_destroy(&p->prot_mutex);
+    pthread_mutex_destroy(&p->mutex);
+    av_freep(&p->buf);
+    av_freep(&h->prefetch);
+}
+
+/* The worker calls into the protocol without holding p->mutex, so anything
+ * else calling into it while prefetching must take prot_mutex. */
+static void prefetch_lock_protocol(URLContext *h)
+{
+    if (h->prefetch)
+        pthread_mutex_lock(&h->prefetch->prot_mutex);
+}
+
+static void prefetch_unlock_protocol(URLContext *h)
+{
+    if (h->prefetch)
+        pthread_mutex_unlock(&h->prefetch->prot_mutex);
+}
+
+int ffurl_start_prefetch(URLContext *h)
+{
+    URLPrefetch *p;
+    int ret;
+
+    if (h->prefetch || !h->prefetch_size || !(h->flags & AVIO_FLAG_READ) ||
+        h->flags & AVIO_FLAG_WRITE)
+        return 0;
+    if (h->prot->url_read_seek) {
+        av_log(h, AV_LOG_WARNING, "Prefetching is not supported by this protocol\n");
+        return 0;
+    }
+
+    p = av_mallocz(sizeof(*p));
+    if (!p)
+        return AVERROR(ENOMEM);
+    p->buf = av_malloc(h->prefetch_size);
+    if (!p->buf) {
+        av_free(p);
+        return AVERROR(ENOMEM);
+    }
+    p->size          = h->prefetch_size;
+    p->low_watermark = h->prefetch_low_watermark < 0 ? p->size / 2 :
+                       FFMIN(h->prefetch_low_watermark, p->size - 1);
+    p->filling       = 1;
+    if (!h->is_streamed && h->prot->url_seek)
+        p->pos = FFMAX(h->prot->url_seek(h, 0, SEEK_CUR), 0);
+
+    if ((ret = pthread_mutex_init(&p->mutex, NULL))) {
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    if ((ret = pthread_mutex_init(&p->prot_mutex, NULL))) {
+        pthread_mutex_destroy(&p->mutex);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    if ((ret = pthread_cond_init(&p->cond_main, NULL))) {
+        pthread_mutex_destroy(&p->prot_mutex);
+        pthread_mutex_destroy(&p->mutex);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    if ((ret = pthread_cond_init(&p->cond_worker, NULL))) {
+        pthread_cond_destroy(&p->cond_main);
+        pthread_mutex_destroy(&p->prot_mutex);
+        pthread_mutex_destroy(&p->mutex);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+
+    h->prefetch = p;
+    if ((ret = pthread_create(&p->thread, NULL, prefetch_worker, h))) {
+        h->prefetch = NULL;
+        pthread_cond_destroy(&p->cond_worker);
+        pthread_cond_destroy(&p->cond_main);
+        pthread_mutex_destroy(&p->prot_mutex);
+        pthread_mutex_destroy(&p->mutex);
+        ret = AVERROR(ret);
+        goto fail;
+    }
+
+    return 0;
+fail:
+    av_free(p->buf);
+    av_free(p);
+    return ret;
+}
+
+#else
+
+int ffurl_start_prefetch(URLContext *h)
+{
+    if (h->prefetch_size)
+        av_log(h, AV_LOG_WARNING, "Prefetching requires threading support\n");
+    return 0;
+}
+
+static void prefetch_lock_protocol(URLContext *h)
+{
+}
+
+static void prefetch_unlock_protocol(URLContext *h)
+{
+}
+
+#endif /* HAVE_THREADS */
+/*@}*/
+
 int ffurl_read(URLContext *h, unsigned char *buf, int size)
 {
     if (!(h->flags & AVIO_FLAG_READ))
         return AVERROR(EIO);
+#if HAVE_THREADS
+    if (h->prefetch)
+        return prefetch_read(h, buf, size);
+#endif
     return retry_transfer_wrapper(h, buf, size, 1, h->prot->url_read);
 }
 
@@ -417,6 +725,20 @@ int ffurl_read_complete(URLContext *h, unsigned char *buf, int size)
 {
     if (!(h->flags & AVIO_FLAG_READ))
         return AVERROR(EIO);
+#if HAVE_THREADS
+    if (h->prefetch) {
+        int ret, len = 0;
+        while (len < size) {
+            ret = prefetch_read(h, buf + len, size - len);
+            if (ret == AVERROR_EOF)
+                return len > 0 ? len : AVERROR_EOF;
+            if (ret < 0)
+                return ret;
+            len += ret;
+        }
+        return len;
+    }
+#endif
     return retry_transfer_wrapper(h, buf, size, size, h->prot->url_read);
 }
 
@@ -437,6 +759,10 @@ int64_t ffurl_seek(URLContext *h, int64_t pos, int whence)
 {
     int64_t ret;
 
+#if HAVE_THREADS
+    if (h->prefetch)
+        return prefetch_seek(h, pos, whence);
+#endif
     if (!h->prot->url_seek)
         return AVERROR(ENOSYS);
     ret = h->prot->url_seek(h, pos, whence & ~AVSEEK_FORCE);
@@ -450,6 +776,10 @@ int ffurl_closep(URLContext **hh)
     if (!h)
         return 0;     /* can happen when ffurl_open fails */
 
+#if HAVE_THREADS
+    if (h->prefetch)
+        prefetch_uninit(h);
+#endif
     if (h->is_connected && h->prot->url_close)
         ret = h->prot->url_close(h);
 #if CONFIG_NETWORK
@@ -627,13 +957,20 @@ int64_t ffurl_size(URLContext *h)
 
 int ffurl_get_file_handle(URLContext *h)
 {
+    int ret;
+
     if (!h || !h->prot || !h->prot->url_get_file_handle)
         return -1;
-    return h->prot->url_get_file_handle(h);
+    prefetch_lock_protocol(h);
+    ret = h->prot->url_get_file_handle(h);
+    prefetch_unlock_protocol(h);
+    return ret;
 }
 
 int ffurl_get_multi_file_handle(URLContext *h, int **handles, int *numhandles)
 {
+    int ret;
+
     if (!h || !h->prot)
         return AVERROR(ENOSYS);
     if (!h->prot->url_get_multi_file_handle) {
@@ -643,17 +980,25 @@ int ffurl_get_multi_file_handle(URLContext *h, int **handles, int *numhandles)
         if (!*handles)
             return AVERROR(ENOMEM);
         *numhandles = 1;
-        *handles[0] = h->prot->url_get_file_handle(h);
+        *handles[0] = ffurl_get_file_handle(h);
         return 0;
     }
-    return h->prot->url_get_multi_file_handle(h, handles, numhandles);
+    prefetch_lock_protocol(h);
+    ret = h->prot->url_get_multi_file_handle(h, handles, numhandles);
+    prefetch_unlock_protocol(h);
+    return ret;
 }
 
 int ffurl_get_short_seek(URLContext *h)
 {
+    int ret;
+
     if (!h || !h->prot || !h->prot->url_get_short_seek)
         return AVERROR(ENOSYS);
-    return h->prot->url_get_short_seek(h);
+    prefetch_lock_protocol(h);
+    ret = h->prot->url_get_short_seek(h);
+    prefetch_unlock_protocol(h);
+    return ret;
 }
 
 int ffurl_shutdown(URLContext *h, int flags)
@@ -222,6 +222,25 @@ void ffio_fill(AVIOContext *s, int b, int count)
     }
 }
 
+static int dyn_buf_write(void *opaque, uint8_t *buf, int buf_size);
+
+/**
+ * Return whether data can be written out directly, bypassing the buffer.
+ * This is only done for lavf's own write callbacks, as user callbacks may
+ * expect to never be called with more than buffer_size bytes, and not for
+ * packet-based protocols, which rely on the buffer to split the data.
+ * The file protocol sets min_packet_size to max_packet_size only to get a
+ * larger buffer, so it does not count as packet-based.
+ */
+static int write_bypass_allowed(AVIOContext *s)
+{
+    return !s->update_checksum &&
+           (!s->max_packet_size || s->min_packet_size >= s->max_packet_size) &&
+           s->buf_ptr == s->buffer && s->buf_ptr_max == s->buffer &&
+           (s->write_packet == dyn_buf_write ||
+            s->write_packet == (int (*)(void *, uint8_t *, int))ffurl_write);
+}
+
 void avio_write(AVIOContext *s, const unsigned char *buf, int size)
 {
     if (s->direct && !s->update_checksum) {
@@ -230,7 +249,19 @@ void avio_write(AVIOContext *s, const unsigned char *buf, int size)
         return;
     }
     while (size > 0) {
-        int len = FFMIN(s->buf_end - s->buf_ptr, size);
+        int len;
+
+        /* Writing at least a full buffer on an empty buffer: pass the data
+         * on as is instead of copying it into the buffer first. */
+        if (size >= s->buffer_size && write_bypass_allowed(s)) {
+            len = s->max_packet_size ? FFMIN(size, s->max_packet_size) : size;
+            writeout(s, buf, len);
+            buf  += len;
+            size -= len;
+            continue;
+        }
+
+        len = FFMIN(s->buf_end - s->buf_ptr, size);
         memcpy(s->buf_ptr, buf, len);
         s->buf_ptr += len;
 
@@ -930,7 +961,10 @@ uint64_t ffio_read_varlen(AVIOContext *bc){
 int ffio_fdopen(AVIOContext **s, URLContext *h)
 {
     uint8_t *buffer = NULL;
-    int buffer_size, max_packet_size;
+    int buffer_size, max_packet_size, ret;
+
+    if ((ret = ffurl_start_prefetch(h)) < 0)
+        return ret;
 
     max_packet_size = h->max_packet_size;
     if (max_packet_size) {
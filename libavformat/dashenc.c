@@ -33,6 +33,8 @@
 #include "libavutil/opt.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/rational.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadmessage.h"
 #include "libavutil/time.h"
 #include "libavutil/time_internal.h"
 
@@ -69,6 +71,28 @@ enum {
 #define MPD_PROFILE_DASH 1
 #define MPD_PROFILE_DVB  2
 
+/* packets are handed to the mux threads in batches, to limit wakeups */
+#define MUX_BATCH_SIZE 32
+#define MUX_QUEUE_SIZE 4
+
+enum MuxJobType {
+    MUX_JOB_PACKETS,
+    MUX_JOB_FLUSH,
+};
+
+typedef struct MuxPacket {
+    AVPacket *pkt;
+    int flush_fragment; /* end the current fragment before writing pkt */
+    int open_segment;   /* open the segment file after writing pkt */
+} MuxPacket;
+
+/* Work for the thread muxing a representation */
+typedef struct MuxJob {
+    enum MuxJobType type;
+    MuxPacket *pkts;
+    int nb_pkts;
+} MuxJob;
+
 typedef struct Segment {
     char file[1024];
     int64_t start_pos;
@@ -77,8 +101,27 @@ typedef struct Segment {
     double prog_date_time;
     int64_t duration;
     int n;
+    int hls_entry_size;
 } Segment;
 
+/* Serialized manifest or playlist entries of consecutive segments */
+typedef struct EntryBuffer {
+    uint8_t *buf;
+    unsigned int buf_size;
+    size_t start;           /* offset of the first entry still in use */
+    size_t end;
+} EntryBuffer;
+
+/* Contiguous segments of equal duration, written as one S element */
+typedef struct TimelineRun {
+    int64_t time;       /* time of the first segment */
+    int64_t duration;   /* duration of each segment */
+    int start;          /* index of the first segment, counting removed ones */
+    int count;
+    int write_time;     /* not contiguous with the previous run */
+    int size;           /* size of the serialized S element, once complete */
+} TimelineRun;
+
 typedef struct AdaptationSet {
     int id;
     char *descriptor;
@@ -138,6 +181,42 @@ typedef struct OutputStream {
     int64_t gop_size;
     AVRational sar;
     int coding_dependency;
+
+    int nb_removed_segments;
+    /* SegmentTimeline state, so that manifest updates only have to
+     * serialize the new segments */
+    TimelineRun *runs;
+    unsigned int runs_size;
+    int first_run, nb_runs;
+    int nb_timeline_segments;   /* segments added to runs */
+    EntryBuffer timeline;       /* S elements of the complete runs */
+    EntryBuffer hls_entries;    /* HLS playlist entries of the segments */
+    int hls_first_entry;        /* segment of the first entry, counting removed ones */
+    int nb_hls_entries;         /* segments with an entry, counting removed ones */
+    double hls_prog_date_time;  /* of the segment after the last entry */
+    int hls_written_segments;   /* segments in the playlist when last written */
+
+    /* mux thread, taking over ctx and out once the init segment is written */
+    AVFormatContext *parent;
+    AVThreadMessageQueue *mux_queue;
+    AVThreadMessageQueue *mux_reply;    /* sizes of the flushed segments */
+    MuxPacket *mux_batch;               /* packets not sent yet */
+    int nb_mux_batch;
+#if HAVE_THREADS
+    pthread_t mux_thread;
+#endif
+    int mux_err;
+    int flush_pending;
+
+    /* direct_chunks: media segments bypass the dynamic buffer */
+    int direct;
+    int64_t seg_written;        /* bytes of the current segment written to out */
+    int chunk_started;          /* the muxer began writing a chunk */
+    int64_t chunk_start;        /* arrival time of the oldest packet not written out */
+    int64_t chunk_io_time;      /* time spent writing the current chunk */
+    int nb_chunks;
+    int64_t chunk_latency, max_chunk_latency;
+    int64_t chunk_write_time, max_chunk_write_time;
 } OutputStream;
 
 typedef struct DASHContext {
@@ -199,6 +278,8 @@ typedef struct DASHContext {
     AVRational min_playback_rate;
     AVRational max_playback_rate;
     int64_t update_period;
+    int mux_workers;
+    int direct_chunks;
 } DASHContext;
 
 static struct codec_string {
@@ -454,6 +535,101 @@ static void set_codec_str(AVFormatContext *s, AVCodecParameters *par,
     }
 }
 
+static int write_chunk_data(void *opaque, uint8_t *buf, int buf_size,
+                            enum AVIODataMarkerType type, int64_t time)
+{
+    OutputStream *os = opaque;
+    int64_t start = av_gettime_relative();
+
+    // movenc marks the start of each moof
+    if (type == AVIO_DATA_MARKER_SYNC_POINT ||
+        type == AVIO_DATA_MARKER_BOUNDARY_POINT)
+        os->chunk_started = 1;
+    if (os->out)
+        avio_write(os->out, buf, buf_size);
+    os->seg_written += buf_size;
+    os->chunk_io_time += av_gettime_relative() - start;
+    return 0;
+}
+
+#define DIRECT_IO_BUF_SIZE 32768
+#define DIRECT_MOOF_SAMPLE_SIZE 32
+
+static int open_direct_io(OutputStream *os)
+{
+    uint8_t *buf = av_malloc(DIRECT_IO_BUF_SIZE);
+    if (!buf)
+        return AVERROR(ENOMEM);
+    os->ctx->pb = avio_alloc_context(buf, DIRECT_IO_BUF_SIZE, 1, os, NULL, NULL, NULL);
+    if (!os->ctx->pb) {
+        av_free(buf);
+        return AVERROR(ENOMEM);
+    }
+    os->ctx->pb->write_data_type = write_chunk_data;
+    os->direct      = 1;
+    os->chunk_start = AV_NOPTS_VALUE;
+    return 0;
+}
+
+/**
+ * The mp4 muxer seeks back to fill in the box sizes of a moof, which only
+ * works on the non-seekable direct output while the whole moof is still in
+ * the IO buffer. A moof never spans segments and takes at most
+ * DIRECT_MOOF_SAMPLE_SIZE bytes per sample besides its fixed size boxes,
+ * so grow the buffer for the packets of the segment and the next one.
+ * Must be called while the buffer is empty, i.e. after a flush.
+ */
+static int reserve_direct_moof(OutputStream *os)
+{
+    int64_t size = DIRECT_IO_BUF_SIZE +
+                   (os->packets_written + 1LL) * DIRECT_MOOF_SAMPLE_SIZE;
+
+    if (!os->direct || size <= os->ctx->pb->buffer_size)
+        return 0;
+    if (size > INT_MAX / 2)
+        return AVERROR(ENOMEM);
+    return ffio_set_buf_size(os->ctx->pb, FFMAX(size, 2LL * os->ctx->pb->buffer_size));
+}
+
+/**
+ * Push the chunks the muxer produced for the packet that arrived at time
+ * arrival through the segment output, and account their latency.
+ * At the end of a segment, arrival is AV_NOPTS_VALUE.
+ */
+static void flush_direct_chunks(OutputStream *os, int64_t arrival)
+{
+    DASHContext *c = os->parent->priv_data;
+    int64_t start = av_gettime_relative(), end, latency, write_time;
+
+    avio_flush(os->ctx->pb);
+    if (os->out)
+        avio_flush(os->out);
+    end = av_gettime_relative();
+    os->chunk_io_time += end - start;
+
+    if (!os->chunk_started) {
+        if (os->chunk_start == AV_NOPTS_VALUE)
+            os->chunk_start = arrival;
+        return;
+    }
+
+    latency    = os->chunk_start != AV_NOPTS_VALUE ? end - os->chunk_start : 0;
+    write_time = os->chunk_io_time;
+    os->nb_chunks++;
+    os->chunk_latency       += latency;
+    os->chunk_write_time    += write_time;
+    os->max_chunk_latency    = FFMAX(os->max_chunk_latency, latency);
+    os->max_chunk_write_time = FFMAX(os->max_chunk_write_time, write_time);
+    av_log(os->parent, AV_LOG_DEBUG, "Representation %d chunk %d: latency %"PRId64" us, "
+           "write %"PRId64" us, segment size %"PRId64"\n", (int)(os - c->streams),
+           os->nb_chunks, latency, write_time, os->seg_written);
+
+    // The current packet is held by the muxer until the next chunk
+    os->chunk_start   = arrival;
+    os->chunk_started = 0;
+    os->chunk_io_time = 0;
+}
+
 static int flush_dynbuf(DASHContext *c, OutputStream *os, int *range_length)
 {
     uint8_t *buffer;
@@ -462,8 +638,22 @@ static int flush_dynbuf(DASHContext *c, OutputStream *os, int *range_length)
         return AVERROR(EINVAL);
     }
 
+    if (os->direct) {
+        int ret = reserve_direct_moof(os);
+        if (ret < 0)
+            return ret;
+    }
+
     // flush
     av_write_frame(os->ctx, NULL);
+
+    if (os->direct) {
+        flush_direct_chunks(os, AV_NOPTS_VALUE);
+        *range_length = os->seg_written;
+        os->seg_written = 0;
+        return 0;
+    }
+
     avio_flush(os->ctx->pb);
 
     if (!c->single_file) {
@@ -514,6 +704,95 @@ static void get_start_index_number(OutputStream *os, DASHContext *c,
     }
 }
 
+/* Move the entries serialized in *pb to the end of b. */
+static int entry_buffer_append(EntryBuffer *b, AVIOContext **pb)
+{
+    uint8_t *data, *buf;
+    int size = avio_close_dyn_buf(*pb, &data);
+
+    *pb = NULL;
+    if (size < 0)
+        return size;
+    if (b->start > b->end - b->start) {
+        memmove(b->buf, b->buf + b->start, b->end - b->start);
+        b->end  -= b->start;
+        b->start = 0;
+    }
+    buf = av_fast_realloc(b->buf, &b->buf_size, b->end + size);
+    if (!buf) {
+        av_free(data);
+        return AVERROR(ENOMEM);
+    }
+    b->buf = buf;
+    memcpy(b->buf + b->end, data, size);
+    b->end += size;
+    av_free(data);
+    return 0;
+}
+
+static void reset_hls_entries(OutputStream *os)
+{
+    os->hls_first_entry = os->nb_hls_entries = os->nb_removed_segments;
+    os->hls_entries.start = os->hls_entries.end = 0;
+}
+
+/* Forget the entry of a segment leaving the list. */
+static void drop_hls_entry(OutputStream *os, const Segment *seg)
+{
+    if (os->hls_first_entry >= os->nb_hls_entries)
+        return;
+    os->hls_entries.start += seg->hls_entry_size;
+    os->hls_first_entry++;
+}
+
+/* Format the playlist entries of the segments added since the last update.
+ * Entries never change once written, except for leaving the window. */
+static int update_hls_entries(OutputStream *os, DASHContext *c, int timescale)
+{
+    AVIOContext *pb = NULL;
+    int i, ret = 0;
+
+    if (os->hls_first_entry < os->nb_removed_segments ||
+        os->nb_hls_entries > os->nb_removed_segments + os->nb_segments)
+        reset_hls_entries(os);
+    if (os->nb_hls_entries == os->nb_removed_segments + os->nb_segments)
+        return 0;
+
+    if ((ret = avio_open_dyn_buf(&pb)) < 0)
+        return ret;
+    i = os->nb_hls_entries - os->nb_removed_segments;
+    if (!i)
+        os->hls_prog_date_time = 0;
+    for (; i < os->nb_segments; i++) {
+        Segment *seg = os->segments[i];
+        int64_t pos = avio_tell(pb);
+
+        if (os->hls_prog_date_time == 0) {
+            if (os->nb_segments == 1)
+                os->hls_prog_date_time = c->start_time_s;
+            else
+                os->hls_prog_date_time = seg->prog_date_time;
+        }
+        seg->prog_date_time = os->hls_prog_date_time;
+        ret = ff_hls_write_file_entry(pb, 0, c->single_file,
+                                (double) seg->duration / timescale, 0,
+                                seg->range_length, seg->start_pos, NULL,
+                                c->single_file ? os->initfile : seg->file,
+                                &os->hls_prog_date_time, 0, 0, 0);
+        if (ret < 0) {
+            av_log(os->ctx, AV_LOG_WARNING, "ff_hls_write_file_entry get error\n");
+        }
+        seg->hls_entry_size = avio_tell(pb) - pos;
+    }
+
+    if ((ret = entry_buffer_append(&os->hls_entries, &pb)) < 0) {
+        reset_hls_entries(os);
+        return ret;
+    }
+    os->nb_hls_entries = os->nb_removed_segments + os->nb_segments;
+    return 0;
+}
+
 static void write_hls_media_playlist(OutputStream *os, AVFormatContext *s,
                                      int representation_id, int final,
                                      char *prefetch_url) {
@@ -527,7 +806,6 @@ static void write_hls_media_playlist(OutputStream *os, AVFormatContext *s,
     const char *proto = avio_find_protocol_name(c->dirname);
     int use_rename = proto && !strcmp(proto, "file");
     int i, start_index, start_number;
-    double prog_date_time = 0;
 
     get_start_index_number(os, c, &start_index, &start_number);
 
@@ -535,6 +813,18 @@ static void write_hls_media_playlist(OutputStream *os, AVFormatContext *s,
         os->segment_type != SEGMENT_TYPE_MP4)
         return;
 
+    // The manifest is written whenever any representation ends a segment,
+    // only rewrite the playlists that changed.
+    if (!final && !prefetch_url &&
+        os->hls_written_segments == os->nb_removed_segments + os->nb_segments)
+        return;
+
+    if ((ret = update_hls_entries(os, c, timescale)) < 0) {
+        av_log(s, AV_LOG_ERROR, "Error updating the HLS playlist of representation %d\n",
+               representation_id);
+        return;
+    }
+
     get_hls_playlist_name(filename_hls, sizeof(filename_hls),
                           c->dirname, representation_id);
 
@@ -560,26 +850,11 @@ static void write_hls_media_playlist(OutputStream *os, AVFormatContext *s,
     ff_hls_write_init_file(c->m3u8_out, os->initfile, c->single_file,
                            os->init_range_length, os->init_start_pos);
 
-    for (i = start_index; i < os->nb_segments; i++) {
-        Segment *seg = os->segments[i];
-
-        if (prog_date_time == 0) {
-            if (os->nb_segments == 1)
-                prog_date_time = c->start_time_s;
-            else
-                prog_date_time = seg->prog_date_time;
-        }
-        seg->prog_date_time = prog_date_time;
-
-        ret = ff_hls_write_file_entry(c->m3u8_out, 0, c->single_file,
-                                (double) seg->duration / timescale, 0,
-                                seg->range_length, seg->start_pos, NULL,
-                                c->single_file ? os->initfile : seg->file,
-                                &prog_date_time, 0, 0, 0);
-        if (ret < 0) {
-            av_log(os->ctx, AV_LOG_WARNING, "ff_hls_write_file_entry get error\n");
-        }
-    }
+    // skip the entries of the segments kept only for extra_window_size
+    while (os->hls_first_entry < os->nb_removed_segments + start_index)
+        drop_hls_entry(os, os->segments[os->hls_first_entry - os->nb_removed_segments]);
+    avio_write(c->m3u8_out, os->hls_entries.buf + os->hls_entries.start,
+               os->hls_entries.end - os->hls_entries.start);
 
     if (prefetch_url)
         avio_printf(c->m3u8_out, "#EXT-X-PREFETCH:%s\n", prefetch_url);
@@ -591,6 +866,8 @@ static void write_hls_media_playlist(OutputStream *os, AVFormatContext *s,
 
     if (use_rename)
         ff_rename(temp_filename_hls, filename_hls, os->ctx);
+
+    os->hls_written_segments = prefetch_url ? -1 : os->nb_removed_segments + os->nb_segments;
 }
 
 static int flush_init_segment(AVFormatContext *s, OutputStream *os)
@@ -608,9 +885,69 @@ static int flush_init_segment(AVFormatContext *s, OutputStream *os)
         snprintf(filename, sizeof(filename), "%s%s", c->dirname, os->initfile);
         dashenc_io_close(s, &os->out, filename);
     }
+    if (c->direct_chunks && os->segment_type == SEGMENT_TYPE_MP4) {
+        ffio_free_dyn_buf(&os->ctx->pb);
+        return open_direct_io(os);
+    }
     return 0;
 }
 
+static void free_mux_job(void *msg)
+{
+    MuxJob *job = msg;
+
+    for (int i = 0; i < job->nb_pkts; i++)
+        av_packet_free(&job->pkts[i].pkt);
+    av_freep(&job->pkts);
+    job->nb_pkts = 0;
+}
+
+static int mux_send_batch(OutputStream *os)
+{
+    MuxJob job = {
+        .type    = MUX_JOB_PACKETS,
+        .pkts    = os->mux_batch,
+        .nb_pkts = os->nb_mux_batch,
+    };
+    int ret;
+
+    if (!job.nb_pkts)
+        return 0;
+    os->mux_batch    = NULL;
+    os->nb_mux_batch = 0;
+    ret = av_thread_message_queue_send(os->mux_queue, &job, 0);
+    if (ret < 0)
+        free_mux_job(&job);
+    return ret;
+}
+
+/* Wait for the queued packets to be muxed, or drop them if discard is set,
+ * and give ctx and out back to the calling thread. */
+static int mux_stop(OutputStream *os, int discard)
+{
+    MuxJob batch = { .pkts = os->mux_batch, .nb_pkts = os->nb_mux_batch };
+
+    if (!os->mux_queue)
+        return 0;
+    if (discard) {
+        free_mux_job(&batch);
+        os->mux_batch    = NULL;
+        os->nb_mux_batch = 0;
+    } else {
+        mux_send_batch(os);
+    }
+#if HAVE_THREADS
+    if (discard)
+        av_thread_message_flush(os->mux_queue);
+    av_thread_message_queue_set_err_recv(os->mux_queue, AVERROR_EOF);
+    av_thread_message_queue_set_err_send(os->mux_reply, AVERROR_EOF);
+    pthread_join(os->mux_thread, NULL);
+#endif
+    av_thread_message_queue_free(&os->mux_queue);
+    av_thread_message_queue_free(&os->mux_reply);
+    return os->mux_err;
+}
+
 static void dash_free(AVFormatContext *s)
 {
     DASHContext *c = s->priv_data;
@@ -629,8 +966,13 @@ static void dash_free(AVFormatContext *s)
         return;
     for (i = 0; i < s->nb_streams; i++) {
         OutputStream *os = &c->streams[i];
+        mux_stop(os, 1);
         if (os->ctx && os->ctx->pb) {
-            if (!c->single_file)
+            if (os->direct) {
+                av_freep(&os->ctx->pb->buffer);
+                avio_context_free(&os->ctx->pb);
+            }
+            else if (!c->single_file)
                 ffio_free_dyn_buf(&os->ctx->pb);
             else
                 avio_close(os->ctx->pb);
@@ -642,6 +984,9 @@ static void dash_free(AVFormatContext *s)
         for (j = 0; j < os->nb_segments; j++)
             av_free(os->segments[j]);
         av_free(os->segments);
+        av_freep(&os->runs);
+        av_freep(&os->timeline.buf);
+        av_freep(&os->hls_entries.buf);
         av_freep(&os->single_file_name);
         av_freep(&os->init_seg_name);
         av_freep(&os->media_seg_name);
@@ -652,6 +997,131 @@ static void dash_free(AVFormatContext *s)
     ff_format_io_close(s, &c->m3u8_out);
 }
 
+static void write_timeline_entry(AVIOContext *out, int write_time, int64_t time,
+                                 int64_t duration, int repeat)
+{
+    avio_printf(out, "\t\t\t\t\t\t<S ");
+    if (write_time)
+        avio_printf(out, "t=\"%"PRId64"\" ", time);
+    avio_printf(out, "d=\"%"PRId64"\" ", duration);
+    if (repeat > 0)
+        avio_printf(out, "r=\"%d\" ", repeat);
+    avio_printf(out, "/>\n");
+}
+
+static int64_t run_end_time(const TimelineRun *run)
+{
+    return run->time + run->count * run->duration;
+}
+
+static void reset_timeline(OutputStream *os)
+{
+    os->first_run = os->nb_runs = 0;
+    os->nb_timeline_segments = os->nb_removed_segments;
+    os->timeline.start = os->timeline.end = 0;
+}
+
+static int add_timeline_run(OutputStream *os, const Segment *seg, int start)
+{
+    TimelineRun *runs, *last = os->nb_runs ? &os->runs[os->nb_runs - 1] : NULL;
+    int write_time = !last || seg->time != run_end_time(last);
+
+    if (os->first_run > os->nb_runs - os->first_run) {
+        memmove(os->runs, os->runs + os->first_run,
+                (os->nb_runs - os->first_run) * sizeof(*os->runs));
+        os->nb_runs  -= os->first_run;
+        os->first_run = 0;
+    }
+    runs = av_fast_realloc(os->runs, &os->runs_size,
+                           (os->nb_runs + 1) * sizeof(*os->runs));
+    if (!runs)
+        return AVERROR(ENOMEM);
+    os->runs = runs;
+    os->runs[os->nb_runs++] = (TimelineRun) {
+        .time       = seg->time,
+        .duration   = seg->duration,
+        .start      = start,
+        .count      = 1,
+        .write_time = write_time,
+    };
+    return 0;
+}
+
+/* Add the segments added since the last manifest update to the runs, and
+ * serialize the runs they complete. */
+static int update_timeline(OutputStream *os)
+{
+    AVIOContext *pb = NULL;
+    int i, ret;
+
+    if (os->nb_timeline_segments < os->nb_removed_segments ||
+        os->nb_timeline_segments > os->nb_removed_segments + os->nb_segments)
+        reset_timeline(os);
+    if (os->nb_timeline_segments == os->nb_removed_segments + os->nb_segments)
+        return 0;
+
+    if ((ret = avio_open_dyn_buf(&pb)) < 0)
+        return ret;
+    for (i = os->nb_timeline_segments - os->nb_removed_segments; i < os->nb_segments; i++) {
+        const Segment *seg = os->segments[i];
+        TimelineRun *run = os->nb_runs ? &os->runs[os->nb_runs - 1] : NULL;
+
+        if (run && seg->duration == run->duration && seg->time == run_end_time(run)) {
+            run->count++;
+            continue;
+        }
+        if (run) {
+            int64_t pos = avio_tell(pb);
+            write_timeline_entry(pb, run->write_time, run->time, run->duration,
+                                 run->count - 1);
+            run->size = avio_tell(pb) - pos;
+        }
+        if ((ret = add_timeline_run(os, seg, os->nb_removed_segments + i)) < 0)
+            goto fail;
+    }
+
+    if ((ret = entry_buffer_append(&os->timeline, &pb)) < 0)
+        goto fail;
+    os->nb_timeline_segments = os->nb_removed_segments + os->nb_segments;
+    return 0;
+
+fail:
+    ffio_free_dyn_buf(&pb);
+    reset_timeline(os);
+    return ret;
+}
+
+static void write_timeline(OutputStream *os, AVIOContext *out, int start_index)
+{
+    int start = os->nb_removed_segments + start_index;
+    const Segment *seg;
+    TimelineRun *run, *last;
+    size_t pos;
+
+    if (start_index >= os->nb_segments)
+        return;
+
+    /* skip the runs that left the window */
+    while (os->runs[os->first_run].start + os->runs[os->first_run].count <= start) {
+        os->timeline.start += os->runs[os->first_run].size;
+        os->first_run++;
+    }
+    run  = &os->runs[os->first_run];
+    last = &os->runs[os->nb_runs - 1];
+
+    /* The first run may start before the window, and the last one is
+     * still growing, so these are written on the fly. */
+    seg = os->segments[start_index];
+    write_timeline_entry(out, 1, seg->time, seg->duration,
+                         run->start + run->count - start - 1);
+    if (run != last) {
+        pos = os->timeline.start + run->size;
+        avio_write(out, os->timeline.buf + pos, os->timeline.end - pos);
+        write_timeline_entry(out, last->write_time, last->time, last->duration,
+                             last->count - 1);
+    }
+}
+
 static void output_segment_list(OutputStream *os, AVIOContext *out, AVFormatContext *s,
                                 int representation_id, int final)
 {
@@ -678,24 +1148,21 @@ static void output_segment_list(OutputStream *os, AVIOContext *out, AVFormatCont
         if (c->use_timeline) {
             int64_t cur_time = 0;
             avio_printf(out, "\t\t\t\t\t<SegmentTimeline>\n");
-            for (i = start_index; i < os->nb_segments; ) {
-                Segment *seg = os->segments[i];
-                int repeat = 0;
-                avio_printf(out, "\t\t\t\t\t\t<S ");
-                if (i == start_index || seg->time != cur_time) {
-                    cur_time = seg->time;
-                    avio_printf(out, "t=\"%"PRId64"\" ", seg->time);
+            if (update_timeline(os) >= 0) {
+                write_timeline(os, out, start_index);
+            } else {
+                for (i = start_index; i < os->nb_segments; ) {
+                    Segment *seg = os->segments[i];
+                    int repeat = 0;
+                    int write_time = i == start_index || seg->time != cur_time;
+                    while (i + repeat + 1 < os->nb_segments &&
+                           os->segments[i + repeat + 1]->duration == seg->duration &&
+                           os->segments[i + repeat + 1]->time == os->segments[i + repeat]->time + os->segments[i + repeat]->duration)
+                        repeat++;
+                    write_timeline_entry(out, write_time, seg->time, seg->duration, repeat);
+                    i += 1 + repeat;
+                    cur_time = seg->time + (1 + repeat) * seg->duration;
                 }
-                avio_printf(out, "d=\"%"PRId64"\" ", seg->duration);
-                while (i + repeat + 1 < os->nb_segments &&
-                       os->segments[i + repeat + 1]->duration == seg->duration &&
-                       os->segments[i + repeat + 1]->time == os->segments[i + repeat]->time + os->segments[i + repeat]->duration)
-                    repeat++;
-                if (repeat > 0)
-                    avio_printf(out, "r=\"%d\" ", repeat);
-                avio_printf(out, "/>\n");
-                i += 1 + repeat;
-                cur_time += (1 + repeat) * seg->duration;
             }
             avio_printf(out, "\t\t\t\t\t</SegmentTimeline>\n");
         }
@@ -1436,6 +1903,22 @@ static int dash_init(AVFormatContext *s)
         c->write_prft = 0;
     }
 
+    if (c->mux_workers && (c->single_file || c->streaming)) {
+        av_log(s, AV_LOG_WARNING, "mux_workers option will be ignored as single_file or streaming is enabled\n");
+        c->mux_workers = 0;
+    }
+    if (c->direct_chunks && (c->single_file || !c->streaming)) {
+        av_log(s, AV_LOG_WARNING, "direct_chunks option will be ignored as single_file is enabled or streaming is not enabled\n");
+        c->direct_chunks = 0;
+    }
+
+#if !HAVE_THREADS
+    if (c->mux_workers) {
+        av_log(s, AV_LOG_WARNING, "mux_workers option will be ignored as thread support is not available\n");
+        c->mux_workers = 0;
+    }
+#endif
+
     if (c->ldash && !c->write_prft) {
         av_log(s, AV_LOG_WARNING, "Low Latency mode enabled without Producer Reference Time element option! Resulting manifest may not be complaint\n");
     }
@@ -1527,6 +2010,7 @@ static int dash_init(AVFormatContext *s)
             }
         }
 
+        os->parent = s;
         os->ctx = ctx = avformat_alloc_context();
         if (!ctx)
             return AVERROR(ENOMEM);
@@ -1886,15 +2370,186 @@ static inline void dashenc_delete_media_segments(AVFormatContext *s, OutputStrea
 {
     for (int i = 0; i < remove_count; ++i) {
         dashenc_delete_segment_file(s, os->segments[i]->file);
+        if (os->hls_first_entry == os->nb_removed_segments + i)
+            drop_hls_entry(os, os->segments[i]);
 
         // Delete the segment regardless of whether the file was successfully deleted
         av_free(os->segments[i]);
     }
 
     os->nb_segments -= remove_count;
+    os->nb_removed_segments += remove_count;
     memmove(os->segments, os->segments + remove_count, os->nb_segments * sizeof(*os->segments));
 }
 
+static void set_segment_paths(AVFormatContext *s, OutputStream *os, int stream_index)
+{
+    DASHContext *c = s->priv_data;
+    const char *proto = avio_find_protocol_name(s->url);
+    int use_rename = proto && !strcmp(proto, "file");
+
+    os->filename[0] = os->full_path[0] = os->temp_path[0] = '\0';
+    ff_dash_fill_tmpl_params(os->filename, sizeof(os->filename),
+                             os->media_seg_name, stream_index,
+                             os->segment_index, os->bit_rate, os->start_pts);
+    snprintf(os->full_path, sizeof(os->full_path), "%s%s", c->dirname,
+             os->filename);
+    snprintf(os->temp_path, sizeof(os->temp_path),
+             use_rename ? "%s.tmp" : "%s", os->full_path);
+}
+
+static int mux_open_segment(AVFormatContext *s, OutputStream *os)
+{
+    DASHContext *c = s->priv_data;
+    AVDictionary *opts = NULL;
+    int ret;
+
+    if (os->segment_type == SEGMENT_TYPE_MP4)
+        write_styp(os->ctx->pb);
+    set_http_options(&opts, c);
+    ret = dashenc_io_open(s, &os->out, os->temp_path, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return handle_io_open_error(s, ret, os->temp_path);
+    return 0;
+}
+
+static int mux_flush_segment(AVFormatContext *s, OutputStream *os)
+{
+    DASHContext *c = s->priv_data;
+    const char *proto = avio_find_protocol_name(s->url);
+    int use_rename = proto && !strcmp(proto, "file");
+    int ret, range_length;
+
+    ret = flush_dynbuf(c, os, &range_length);
+    if (ret < 0)
+        return ret;
+    dashenc_io_close(s, &os->out, os->temp_path);
+    if (use_rename) {
+        ret = ff_rename(os->temp_path, os->full_path, os->ctx);
+        if (ret < 0)
+            return ret;
+    }
+    return range_length;
+}
+
+static void *mux_worker(void *arg)
+{
+    OutputStream *os = arg;
+    AVFormatContext *s = os->parent;
+    MuxJob job;
+    int ret = 0;
+
+    while (av_thread_message_queue_recv(os->mux_queue, &job, 0) >= 0) {
+        if (job.type == MUX_JOB_FLUSH) {
+            int reply = ret < 0 ? ret : mux_flush_segment(s, os);
+            if (reply < 0)
+                ret = reply;
+            av_thread_message_queue_send(os->mux_reply, &reply, 0);
+        } else {
+            for (int i = 0; i < job.nb_pkts && ret >= 0; i++) {
+                MuxPacket *mp = &job.pkts[i];
+                if (mp->flush_fragment)
+                    ret = av_write_frame(os->ctx, NULL);
+                if (ret >= 0)
+                    ret = ff_write_chained(os->ctx, 0, mp->pkt, s, 0);
+                if (ret >= 0 && mp->open_segment)
+                    ret = mux_open_segment(s, os);
+            }
+        }
+        free_mux_job(&job);
+
+        if (ret < 0 && !os->mux_err) {
+            os->mux_err = ret;
+            av_thread_message_queue_set_err_send(os->mux_queue, ret);
+        }
+    }
+    return NULL;
+}
+
+static int mux_start(AVFormatContext *s, OutputStream *os)
+{
+#if HAVE_THREADS
+    int ret;
+
+    os->mux_err = 0;
+    if ((ret = av_thread_message_queue_alloc(&os->mux_queue, MUX_QUEUE_SIZE,
+                                             sizeof(MuxJob))) < 0 ||
+        (ret = av_thread_message_queue_alloc(&os->mux_reply, 1, sizeof(int))) < 0)
+        goto fail;
+    av_thread_message_queue_set_free_func(os->mux_queue, free_mux_job);
+
+    ret = pthread_create(&os->mux_thread, NULL, mux_worker, os);
+    if (ret) {
+        ret = AVERROR(ret);
+        av_log(s, AV_LOG_ERROR, "Failed to start mux thread: %s\n", av_err2str(ret));
+        goto fail;
+    }
+    return 0;
+fail:
+    av_thread_message_queue_free(&os->mux_queue);
+    av_thread_message_queue_free(&os->mux_reply);
+    return ret;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+static int mux_queue_packet(AVFormatContext *s, OutputStream *os, AVPacket *pkt,
+                            int flush_fragment)
+{
+    MuxPacket *mp;
+    int ret;
+
+    if (!os->mux_batch) {
+        os->mux_batch = av_malloc_array(MUX_BATCH_SIZE, sizeof(*os->mux_batch));
+        if (!os->mux_batch)
+            return AVERROR(ENOMEM);
+    }
+    mp = &os->mux_batch[os->nb_mux_batch];
+    mp->pkt = av_packet_clone(pkt);
+    if (!mp->pkt)
+        return AVERROR(ENOMEM);
+    mp->flush_fragment = flush_fragment;
+    mp->open_segment   = !os->packets_written;
+    if (mp->open_segment)
+        set_segment_paths(s, os, pkt->stream_index);
+    if (++os->nb_mux_batch == MUX_BATCH_SIZE && (ret = mux_send_batch(os)) < 0)
+        return ret;
+
+    os->packets_written++;
+    os->total_pkt_size += pkt->size;
+    os->total_pkt_duration += pkt->duration;
+    os->last_flags = pkt->flags;
+    return 0;
+}
+
+static void segment_flushed(AVFormatContext *s, int i, int range_length,
+                            int index_length, int next_exp_index)
+{
+    DASHContext *c = s->priv_data;
+    OutputStream *os = &c->streams[i];
+    AVStream *st = s->streams[i];
+    int64_t duration;
+
+    duration = av_rescale_q(os->max_pts - os->start_pts, st->time_base, AV_TIME_BASE_Q);
+    os->last_duration = FFMAX(os->last_duration, duration);
+
+    if (!os->muxer_overhead && os->max_pts > os->start_pts)
+        os->muxer_overhead = ((int64_t) (range_length - os->total_pkt_size) *
+                              8 * AV_TIME_BASE) / duration;
+    os->total_pkt_size = 0;
+    os->total_pkt_duration = 0;
+
+    if (!os->bit_rate && !os->first_segment_bit_rate) {
+        os->first_segment_bit_rate = (int64_t) range_length * 8 * AV_TIME_BASE / duration;
+    }
+    add_segment(os, os->filename, os->start_pts, os->max_pts - os->start_pts, os->pos, range_length, index_length, next_exp_index);
+    av_log(s, AV_LOG_VERBOSE, "Representation %d media segment %d written to: %s\n", i, os->segment_index, os->full_path);
+
+    os->pos += range_length;
+}
+
 static int dash_flush(AVFormatContext *s, int final, int stream)
 {
     DASHContext *c = s->priv_data;
@@ -1919,11 +2574,16 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
         }
     }
 
+    if (final) {
+        for (i = 0; i < s->nb_streams; i++) {
+            if ((ret = mux_stop(&c->streams[i], 0)) < 0)
+                return ret;
+        }
+    }
+
     for (i = 0; i < s->nb_streams; i++) {
         OutputStream *os = &c->streams[i];
-        AVStream *st = s->streams[i];
         int range_length, index_length = 0;
-        int64_t duration;
 
         if (!os->packets_written)
             continue;
@@ -1943,6 +2603,18 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
                 continue;
         }
 
+        // Let the mux thread write the segment while the other
+        // representations are flushed.
+        if (os->mux_queue) {
+            MuxJob job = { .type = MUX_JOB_FLUSH };
+            if ((ret = mux_send_batch(os)) < 0 ||
+                (ret = av_thread_message_queue_send(os->mux_queue, &job, 0)) < 0)
+                break;
+            os->packets_written = 0;
+            os->flush_pending = 1;
+            continue;
+        }
+
         if (c->single_file)
             snprintf(os->full_path, sizeof(os->full_path), "%s%s", c->dirname, os->initfile);
 
@@ -1963,22 +2635,24 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
             }
         }
 
-        duration = av_rescale_q(os->max_pts - os->start_pts, st->time_base, AV_TIME_BASE_Q);
-        os->last_duration = FFMAX(os->last_duration, duration);
+        segment_flushed(s, i, range_length, index_length, next_exp_index);
+    }
 
-        if (!os->muxer_overhead && os->max_pts > os->start_pts)
-            os->muxer_overhead = ((int64_t) (range_length - os->total_pkt_size) *
-                                  8 * AV_TIME_BASE) / duration;
-        os->total_pkt_size = 0;
-        os->total_pkt_duration = 0;
+    for (i = 0; i < s->nb_streams; i++) {
+        OutputStream *os = &c->streams[i];
+        int range_length, err;
 
-        if (!os->bit_rate && !os->first_segment_bit_rate) {
-            os->first_segment_bit_rate = (int64_t) range_length * 8 * AV_TIME_BASE / duration;
+        if (!os->flush_pending)
+            continue;
+        os->flush_pending = 0;
+        err = av_thread_message_queue_recv(os->mux_reply, &range_length, 0);
+        if (err >= 0 && range_length < 0)
+            err = range_length;
+        if (err < 0) {
+            ret = err;
+            continue;
         }
-        add_segment(os, os->filename, os->start_pts, os->max_pts - os->start_pts, os->pos, range_length, index_length, next_exp_index);
-        av_log(s, AV_LOG_VERBOSE, "Representation %d media segment %d written to: %s\n", i, os->segment_index, os->full_path);
-
-        os->pos += range_length;
+        segment_flushed(s, i, range_length, 0, next_exp_index);
     }
 
     if (c->window_size) {
@@ -2059,8 +2733,17 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
     OutputStream *os = &c->streams[pkt->stream_index];
     AdaptationSet *as = &c->as[os->as_idx - 1];
     int64_t seg_end_duration, elapsed_duration;
+    int64_t arrival = av_gettime_relative();
+    int flush_fragment = 0;
     int ret;
 
+    // The inner muxer may be reading the parameters.
+    if (os->mux_queue && !os->ctx->streams[0]->codecpar->extradata_size &&
+        av_packet_get_side_data(pkt, AV_PKT_DATA_NEW_EXTRADATA, NULL)) {
+        if ((ret = mux_stop(os, 0)) < 0)
+            return ret;
+    }
+
     ret = update_stream_extradata(s, os, pkt, &st->avg_frame_rate);
     if (ret < 0)
         return ret;
@@ -2189,6 +2872,9 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
     else
         os->max_pts = FFMAX(os->max_pts, pkt->pts + pkt->duration);
 
+    if ((ret = reserve_direct_moof(os)) < 0)
+        return ret;
+
     if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
         os->frag_type == FRAG_TYPE_PFRAMES &&
         os->packets_written) {
@@ -2197,9 +2883,13 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
              st->codecpar->video_delay &&
              !(os->last_flags & AV_PKT_FLAG_KEY)) ||
             pkt->flags & AV_PKT_FLAG_KEY) {
-            ret = av_write_frame(os->ctx, NULL);
-            if (ret < 0)
-                return ret;
+            if (os->mux_queue) {
+                flush_fragment = 1;
+            } else {
+                ret = av_write_frame(os->ctx, NULL);
+                if (ret < 0)
+                    return ret;
+            }
 
             if (!os->availability_time_offset) {
                 int64_t frag_duration = av_rescale_q(os->total_pkt_duration, st->time_base,
@@ -2216,6 +2906,9 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
         c->max_gop_size = FFMAX(c->max_gop_size, os->gop_size);
     }
 
+    if (os->mux_queue)
+        return mux_queue_packet(s, os, pkt, flush_fragment);
+
     if ((ret = ff_write_chained(os->ctx, 0, pkt, s, 0)) < 0)
         return ret;
 
@@ -2224,8 +2917,11 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
     os->total_pkt_duration += pkt->duration;
     os->last_flags = pkt->flags;
 
-    if (!os->init_range_length)
-        flush_init_segment(s, os);
+    if (!os->init_range_length) {
+        ret = flush_init_segment(s, os);
+        if (ret < 0)
+            return ret;
+    }
 
     //open the output context when the first frame of a segment is ready
     if (!c->single_file && os->packets_written == 1) {
@@ -2234,14 +2930,7 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
         int use_rename = proto && !strcmp(proto, "file");
         if (os->segment_type == SEGMENT_TYPE_MP4)
             write_styp(os->ctx->pb);
-        os->filename[0] = os->full_path[0] = os->temp_path[0] = '\0';
-        ff_dash_fill_tmpl_params(os->filename, sizeof(os->filename),
-                                 os->media_seg_name, pkt->stream_index,
-                                 os->segment_index, os->bit_rate, os->start_pts);
-        snprintf(os->full_path, sizeof(os->full_path), "%s%s", c->dirname,
-                 os->filename);
-        snprintf(os->temp_path, sizeof(os->temp_path),
-                 use_rename ? "%s.tmp" : "%s", os->full_path);
+        set_segment_paths(s, os, pkt->stream_index);
         set_http_options(&opts, c);
         ret = dashenc_io_open(s, &os->out, os->temp_path, &opts);
         av_dict_free(&opts);
@@ -2255,7 +2944,9 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
     }
 
     //write out the data immediately in streaming mode
-    if (c->streaming && os->segment_type == SEGMENT_TYPE_MP4) {
+    if (os->direct) {
+        flush_direct_chunks(os, arrival);
+    } else if (c->streaming && os->segment_type == SEGMENT_TYPE_MP4) {
         int len = 0;
         uint8_t *buf = NULL;
         avio_flush(os->ctx->pb);
@@ -2267,6 +2958,9 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
         os->written_len = len;
     }
 
+    if (c->mux_workers && !os->mux_queue && os->init_range_length && ret >= 0)
+        ret = mux_start(s, os);
+
     return ret;
 }
 
@@ -2289,6 +2983,16 @@ static int dash_write_trailer(AVFormatContext *s)
     }
     dash_flush(s, 1, -1);
 
+    for (i = 0; i < s->nb_streams; i++) {
+        OutputStream *os = &c->streams[i];
+        if (!os->nb_chunks)
+            continue;
+        av_log(s, AV_LOG_VERBOSE, "Representation %d: %d chunks, latency avg %.3f max %.3f ms, "
+               "write avg %.3f max %.3f ms\n", i, os->nb_chunks,
+               os->chunk_latency / (os->nb_chunks * 1000.0), os->max_chunk_latency / 1000.0,
+               os->chunk_write_time / (os->nb_chunks * 1000.0), os->max_chunk_write_time / 1000.0);
+    }
+
     if (c->remove_at_exit) {
         for (i = 0; i < s->nb_streams; ++i) {
             OutputStream *os = &c->streams[i];
@@ -2384,6 +3088,8 @@ static const AVOption options[] = {
     { "min_playback_rate", "Set desired minimum playback rate", OFFSET(min_playback_rate), AV_OPT_TYPE_RATIONAL, { .dbl = 1.0 }, 0.5, 1.5, E },
     { "max_playback_rate", "Set desired maximum playback rate", OFFSET(max_playback_rate), AV_OPT_TYPE_RATIONAL, { .dbl = 1.0 }, 0.5, 1.5, E },
     { "update_period", "Set the mpd update interval", OFFSET(update_period), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E},
+    { "mux_workers", "Mux and write each representation in its own thread", OFFSET(mux_workers), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
+    { "direct_chunks", "Write each chunk straight to the segment output in streaming mode, without buffering the segment", OFFSET(direct_chunks), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     { NULL },
 };
 
@@ -41,6 +41,8 @@
 #include "libavutil/random_seed.h"
 #include "libavutil/opt.h"
 #include "libavutil/log.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadmessage.h"
 #include "libavutil/time.h"
 #include "libavutil/time_internal.h"
 
@@ -86,9 +88,21 @@ typedef struct HLSSegment {
     char key_uri[LINE_BUFFER_SIZE + 1];
     char iv_string[KEYSIZE*2 + 1];
 
+    int entry_size;     /* size of the serialized playlist entry */
+    int entry_key_size; /* size of the EXT-X-KEY line it starts with */
+    int sub_entry_size; /* size of the serialized subtitle playlist entry */
+
     struct HLSSegment *next;
 } HLSSegment;
 
+/* Serialized playlist entries of consecutive segments */
+typedef struct HLSEntryCache {
+    uint8_t *buf;
+    unsigned int buf_size;
+    size_t start;           /* offset of the first entry in the window */
+    size_t end;
+} HLSEntryCache;
+
 typedef enum HLSFlags {
     // Generate a single media file and use byte ranges in the playlist.
     HLS_SINGLE_FILE = (1 << 0),
@@ -151,6 +165,19 @@ typedef struct VariantStream {
     HLSSegment *last_segment;
     HLSSegment *old_segments;
 
+    /* playlist entries of the segments up to pl_last, so that playlist
+     * updates only have to serialize the new segments */
+    HLSEntryCache pl_cache;
+    HLSEntryCache sub_pl_cache;
+    HLSSegment *pl_last;
+    double pl_prog_date_time; /* program date time following pl_last */
+
+    /* segments that are the longest of the window from them on, from the
+     * longest to the last one, to track the target duration */
+    HLSSegment **td_queue;
+    unsigned int td_queue_size;
+    int td_head, td_tail;
+
     char *basename_tmp;
     char *basename;
     char *vtt_basename;
@@ -183,6 +210,25 @@ typedef struct VariantStream {
     const char *varname;  /* variant name */
 } VariantStream;
 
+typedef enum HLSAsyncJobType {
+    HLS_ASYNC_WRITE,
+    HLS_ASYNC_RENAME,
+    HLS_ASYNC_DELETE,
+} HLSAsyncJobType;
+
+/* I/O operation deferred to the background thread */
+typedef struct HLSAsyncJob {
+    HLSAsyncJobType type;
+    char *url;
+    char *new_url;          /* rename target */
+    AVDictionary *options;  /* options for opening url */
+    uint8_t *data;          /* file contents */
+    int size;
+    int styp;               /* prepend a styp box to data */
+    AVFormatContext *avf;   /* context to delete url through */
+    const char *proto;
+} HLSAsyncJob;
+
 typedef struct ClosedCaptionsStream {
     const char *ccgroup;    /* closed caption group name */
     const char *instreamid; /* closed captions INSTREAM-ID */
@@ -256,6 +302,14 @@ typedef struct HLSContext {
     char *headers;
     int has_default_key; /* has DEFAULT field of var_stream_map */
     int has_video_m3u8; /* has video stream m3u8 list */
+
+    int async_io;          /* max number of queued background I/O operations */
+    AVThreadMessageQueue *async_queue;
+#if HAVE_THREADS
+    pthread_t async_thread;
+#endif
+    AVIOContext *async_out;
+    int async_err;
 } HLSContext;
 
 static int hlsenc_io_open(AVFormatContext *s, AVIOContext **pb, char *filename,
@@ -516,6 +570,221 @@ static int hls_delete_file(HLSContext *hls, AVFormatContext *avf,
     return 0;
 }
 
+static void hls_async_job_free(void *msg)
+{
+    HLSAsyncJob *job = msg;
+
+    av_freep(&job->url);
+    av_freep(&job->new_url);
+    av_freep(&job->data);
+    av_dict_free(&job->options);
+}
+
+static int hls_async_send(HLSContext *hls, HLSAsyncJob *job)
+{
+    int ret;
+
+    if (!job->url || (job->type == HLS_ASYNC_RENAME && !job->new_url)) {
+        hls_async_job_free(job);
+        return AVERROR(ENOMEM);
+    }
+    ret = av_thread_message_queue_send(hls->async_queue, job, 0);
+    if (ret < 0)
+        hls_async_job_free(job);
+    return ret;
+}
+
+/* Queue writing data (of which ownership is taken) to url. */
+static int hls_async_write(HLSContext *hls, const char *url, AVDictionary **options,
+                           uint8_t *data, int size, int styp)
+{
+    HLSAsyncJob job = {
+        .type = HLS_ASYNC_WRITE,
+        .url  = av_strdup(url),
+        .data = data,
+        .size = size,
+        .styp = styp,
+    };
+    int ret = av_dict_copy(&job.options, *options, 0);
+
+    if (ret < 0) {
+        hls_async_job_free(&job);
+        return ret;
+    }
+    return hls_async_send(hls, &job);
+}
+
+static int hls_async_write_file(AVFormatContext *s, HLSAsyncJob *job)
+{
+    HLSContext *hls = s->priv_data;
+    AVDictionary *options = NULL;
+    int retried = 0;
+    int ret;
+
+    for (;;) {
+        av_dict_copy(&options, job->options, 0);
+        ret = hlsenc_io_open(s, &hls->async_out, job->url, &options);
+        av_dict_free(&options);
+        if (ret < 0) {
+            av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
+                   "Failed to open file '%s'\n", job->url);
+            return ret;
+        }
+        if (job->styp)
+            write_styp(hls->async_out);
+        avio_write(hls->async_out, job->data, job->size);
+        ret = hlsenc_io_close(s, &hls->async_out, job->url);
+        if (ret >= 0 || retried++)
+            return ret;
+        av_log(s, AV_LOG_WARNING, "upload of '%s' failed,"
+               " will retry with a new http session.\n", job->url);
+        ff_format_io_close(s, &hls->async_out);
+    }
+}
+
+static void *hls_async_worker(void *arg)
+{
+    AVFormatContext *s = arg;
+    HLSContext *hls = s->priv_data;
+    HLSAsyncJob job;
+    int ret;
+
+    while (av_thread_message_queue_recv(hls->async_queue, &job, 0) >= 0) {
+        switch (job.type) {
+        case HLS_ASYNC_WRITE:
+            ret = hls_async_write_file(s, &job);
+            break;
+        case HLS_ASYNC_RENAME:
+            /* rename failures are logged but not fatal, as when synchronous */
+            ff_rename(job.url, job.new_url, s);
+            ret = 0;
+            break;
+        case HLS_ASYNC_DELETE:
+            ret = hls_delete_file(hls, job.avf, job.url, job.proto);
+            break;
+        default:
+            ret = AVERROR_BUG;
+        }
+        if (ret < 0 && hls->ignore_io_errors) {
+            av_log(s, AV_LOG_WARNING, "Ignoring I/O error on '%s': %s\n",
+                   job.url, av_err2str(ret));
+        } else if (ret < 0) {
+            hls->async_err = ret;
+            av_thread_message_queue_set_err_send(hls->async_queue, ret);
+            hls_async_job_free(&job);
+            break;
+        }
+        hls_async_job_free(&job);
+    }
+    return NULL;
+}
+
+static int hls_async_start(AVFormatContext *s)
+{
+#if HAVE_THREADS
+    HLSContext *hls = s->priv_data;
+    int ret;
+
+    ret = av_thread_message_queue_alloc(&hls->async_queue, hls->async_io,
+                                        sizeof(HLSAsyncJob));
+    if (ret < 0)
+        return ret;
+    av_thread_message_queue_set_free_func(hls->async_queue, hls_async_job_free);
+
+    ret = pthread_create(&hls->async_thread, NULL, hls_async_worker, s);
+    if (ret) {
+        av_log(s, AV_LOG_ERROR, "Failed to start I/O thread: %s\n",
+               av_err2str(AVERROR(ret)));
+        av_thread_message_queue_free(&hls->async_queue);
+        return AVERROR(ret);
+    }
+#else
+    av_log(s, AV_LOG_WARNING, "hls_async_io requires thread support, "
+           "writing synchronously\n");
+#endif
+    return 0;
+}
+
+/* Wait for the queued operations to complete, or drop them if discard is set,
+ * and stop the background thread. Returns the first error it encountered. */
+static int hls_async_stop(AVFormatContext *s, int discard)
+{
+    HLSContext *hls = s->priv_data;
+
+    if (!hls->async_queue)
+        return 0;
+#if HAVE_THREADS
+    if (discard)
+        av_thread_message_flush(hls->async_queue);
+    av_thread_message_queue_set_err_recv(hls->async_queue, AVERROR_EOF);
+    pthread_join(hls->async_thread, NULL);
+#endif
+    av_thread_message_queue_free(&hls->async_queue);
+    ff_format_io_close(s, &hls->async_out);
+    return hls->async_err;
+}
+
+static int hlsenc_rename(HLSContext *hls, const char *oldpath,
+                         const char *newpath, void *logctx)
+{
+    if (hls->async_queue) {
+        HLSAsyncJob job = {
+            .type    = HLS_ASYNC_RENAME,
+            .url     = av_strdup(oldpath),
+            .new_url = av_strdup(newpath),
+        };
+        return hls_async_send(hls, &job);
+    }
+    return ff_rename(oldpath, newpath, logctx);
+}
+
+static int hlsenc_delete_file(HLSContext *hls, AVFormatContext *avf,
+                              const char *path, const char *proto)
+{
+    if (hls->async_queue) {
+        HLSAsyncJob job = {
+            .type  = HLS_ASYNC_DELETE,
+            .url   = av_strdup(path),
+            .avf   = avf,
+            .proto = proto,
+        };
+        return hls_async_send(hls, &job);
+    }
+    return hls_delete_file(hls, avf, path, proto);
+}
+
+/* Playlists are built in memory and written by the background thread
+ * when it is running. */
+static int hlsenc_pl_open(AVFormatContext *s, AVIOContext **pb, char *filename,
+                          AVDictionary **options)
+{
+    HLSContext *hls = s->priv_data;
+
+    if (hls->async_queue) {
+        ff_format_io_close(s, pb);
+        return avio_open_dyn_buf(pb);
+    }
+    return hlsenc_io_open(s, pb, filename, options);
+}
+
+static int hlsenc_pl_close(AVFormatContext *s, AVIOContext **pb, char *filename)
+{
+    HLSContext *hls = s->priv_data;
+    AVDictionary *options = NULL;
+    uint8_t *buf = NULL;
+    int size, ret;
+
+    if (!hls->async_queue || !*pb)
+        return hlsenc_io_close(s, pb, filename);
+
+    size = avio_close_dyn_buf(*pb, &buf);
+    *pb = NULL;
+    set_http_options(s, &options, hls);
+    ret = hls_async_write(hls, filename, &options, buf, size, 0);
+    av_dict_free(&options);
+    return ret;
+}
+
 static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
                                    VariantStream *vs)
 {
@@ -593,7 +862,7 @@ static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
         }
 
         proto = avio_find_protocol_name(s->url);
-        if (ret = hls_delete_file(hls, vs->avf, path.str, proto))
+        if (ret = hlsenc_delete_file(hls, vs->avf, path.str, proto))
             goto fail;
 
         if ((segment->sub_filename[0] != '\0')) {
@@ -610,7 +879,7 @@ static int hls_delete_old_segments(AVFormatContext *s, HLSContext *hls,
                 goto fail;
             }
 
-            if (ret = hls_delete_file(hls, vs->vtt_avf, path.str, proto))
+            if (ret = hlsenc_delete_file(hls, vs->vtt_avf, path.str, proto))
                 goto fail;
         }
         av_bprint_clear(&path);
@@ -984,7 +1253,7 @@ static int sls_flag_check_duration_size(HLSContext *hls, VariantStream *vs)
 static void sls_flag_file_rename(HLSContext *hls, VariantStream *vs, char *old_filename) {
     if ((hls->flags & (HLS_SECOND_LEVEL_SEGMENT_SIZE | HLS_SECOND_LEVEL_SEGMENT_DURATION)) &&
         strlen(vs->current_segment_final_filename_fmt)) {
-        ff_rename(old_filename, vs->avf->url, hls);
+        hlsenc_rename(hls, old_filename, vs->avf->url, hls);
     }
 }
 
@@ -1035,6 +1304,151 @@ static int sls_flag_use_localtime_filename(AVFormatContext *oc, HLSContext *c, V
     return 0;
 }
 
+/* Queue en for the target duration, dropping the queued segments that are not
+ * longer than en: the head of the queue is then the longest in the window. */
+static int td_queue_push(VariantStream *vs, HLSSegment *en)
+{
+    HLSSegment **queue;
+
+    while (vs->td_tail > vs->td_head &&
+           vs->td_queue[vs->td_tail - 1]->duration <= en->duration)
+        vs->td_tail--;
+    if (vs->td_head > vs->td_tail - vs->td_head) {
+        memmove(vs->td_queue, vs->td_queue + vs->td_head,
+                (vs->td_tail - vs->td_head) * sizeof(*vs->td_queue));
+        vs->td_tail -= vs->td_head;
+        vs->td_head  = 0;
+    }
+    queue = av_fast_realloc(vs->td_queue, &vs->td_queue_size,
+                            (vs->td_tail + 1) * sizeof(*vs->td_queue));
+    if (!queue)
+        return AVERROR(ENOMEM);
+    vs->td_queue = queue;
+    vs->td_queue[vs->td_tail++] = en;
+    return 0;
+}
+
+static void hls_reset_entry_cache(VariantStream *vs)
+{
+    vs->pl_last = NULL;
+    vs->pl_cache.start = vs->pl_cache.end = 0;
+    vs->sub_pl_cache.start = vs->sub_pl_cache.end = 0;
+}
+
+/* Remove the first segment of the window from the playlist state. */
+static void hls_window_drop_segment(VariantStream *vs, HLSSegment *en)
+{
+    if (vs->td_tail > vs->td_head && vs->td_queue[vs->td_head] == en)
+        vs->td_head++;
+    if (!vs->pl_last)
+        return;
+    if (vs->pl_last == en) {
+        hls_reset_entry_cache(vs);
+    } else {
+        vs->pl_cache.start += en->entry_size;
+        vs->sub_pl_cache.start += en->sub_entry_size;
+    }
+}
+
+static int entry_cache_append(HLSEntryCache *c, AVIOContext **pb)
+{
+    uint8_t *data, *buf;
+    int size = avio_close_dyn_buf(*pb, &data);
+
+    *pb = NULL;
+    if (size < 0)
+        return size;
+    if (c->start > c->end - c->start) {
+        memmove(c->buf, c->buf + c->start, c->end - c->start);
+        c->end  -= c->start;
+        c->start = 0;
+    }
+    buf = av_fast_realloc(c->buf, &c->buf_size, c->end + size);
+    if (!buf) {
+        av_free(data);
+        return AVERROR(ENOMEM);
+    }
+    c->buf = buf;
+    memcpy(c->buf + c->end, data, size);
+    c->end += size;
+    av_free(data);
+    return 0;
+}
+
+static void write_key_line(AVIOContext *pb, HLSSegment *en)
+{
+    avio_printf(pb, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"", en->key_uri);
+    if (*en->iv_string)
+        avio_printf(pb, ",IV=0x%s", en->iv_string);
+    avio_printf(pb, "\n");
+}
+
+/* Serialize the playlist entries of the segments added since the last
+ * update. */
+static int hls_update_entry_cache(HLSContext *hls, VariantStream *vs)
+{
+    HLSSegment *prev = vs->pl_last;
+    HLSSegment *en = prev ? prev->next : vs->segments;
+    AVIOContext *pb = NULL, *sub_pb = NULL;
+    double *prog_date_time_p = (hls->flags & HLS_PROGRAM_DATE_TIME) ? &vs->pl_prog_date_time : NULL;
+    int byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
+    int64_t pos;
+    int ret;
+
+    if (!en)
+        return 0;
+    if (!prev)
+        vs->pl_prog_date_time = vs->initial_prog_date_time;
+
+    if ((ret = avio_open_dyn_buf(&pb)) < 0)
+        return ret;
+    if (vs->vtt_m3u8_name && (ret = avio_open_dyn_buf(&sub_pb)) < 0) {
+        ffio_free_dyn_buf(&pb);
+        return ret;
+    }
+
+    for (; en; prev = en, en = en->next) {
+        pos = avio_tell(pb);
+        if ((hls->encrypt || hls->key_info_file) && (!prev || strcmp(en->key_uri, prev->key_uri) ||
+                                    av_strcasecmp(en->iv_string, prev->iv_string)))
+            write_key_line(pb, en);
+        en->entry_key_size = avio_tell(pb) - pos;
+
+        ret = ff_hls_write_file_entry(pb, en->discont, byterange_mode,
+                                      en->duration, hls->flags & HLS_ROUND_DURATIONS,
+                                      en->size, en->pos, hls->baseurl,
+                                      en->filename, prog_date_time_p, en->keyframe_size, en->keyframe_pos, hls->flags & HLS_I_FRAMES_ONLY);
+        if (ret < 0) {
+            av_log(hls, AV_LOG_WARNING, "ff_hls_write_file_entry get error\n");
+        }
+        en->entry_size = avio_tell(pb) - pos;
+
+        if (sub_pb) {
+            pos = avio_tell(sub_pb);
+            ret = ff_hls_write_file_entry(sub_pb, 0, byterange_mode,
+                                          en->duration, 0, en->size, en->pos,
+                                          hls->baseurl, en->sub_filename, NULL, 0, 0, 0);
+            if (ret < 0) {
+                av_log(hls, AV_LOG_WARNING, "ff_hls_write_file_entry get error\n");
+            }
+            en->sub_entry_size = avio_tell(sub_pb) - pos;
+        }
+    }
+    vs->pl_last = prev;
+
+    ret = entry_cache_append(&vs->pl_cache, &pb);
+    if (sub_pb) {
+        if (ret >= 0)
+            ret = entry_cache_append(&vs->sub_pl_cache, &sub_pb);
+        else
+            ffio_free_dyn_buf(&sub_pb);
+    }
+    /* start over from the whole window next time */
+    if (ret < 0)
+        hls_reset_entry_cache(vs);
+    return ret;
+}
+
 /* Create a new segment and append it to the segment list */
 static int hls_append_segment(struct AVFormatContext *s, HLSContext *hls,
                               VariantStream *vs, double duration, int64_t pos,
@@ -1096,12 +1510,16 @@ static int hls_append_segment(struct AVFormatContext *s, HLSContext *hls,
 
     vs->last_segment = en;
 
+    if ((ret = td_queue_push(vs, en)) < 0)
+        return ret;
+
     // EVENT or VOD playlists imply sliding window cannot be used
     if (hls->pl_type != PLAYLIST_TYPE_NONE)
         hls->max_nb_segments = 0;
 
     if (hls->max_nb_segments && vs->nb_entries >= hls->max_nb_segments) {
         en = vs->segments;
+        hls_window_drop_segment(vs, en);
         vs->initial_prog_date_time += en->duration;
         vs->segments = en->next;
         if (en && hls->flags & HLS_DELETE_SEGMENTS &&
@@ -1238,7 +1656,7 @@ static int hls_rename_temp_file(AVFormatContext *s, AVFormatContext *oc)
     if (!final_filename)
         return AVERROR(ENOMEM);
     final_filename[len-4] = '\0';
-    ret = ff_rename(oc->url, final_filename, s);
+    ret = hlsenc_rename(s->priv_data, oc->url, final_filename, s);
     oc->url[len-4] = '\0';
     av_freep(&final_filename);
     return ret;
@@ -1314,7 +1732,7 @@ static int create_master_playlist(AVFormatContext *s,
 
     set_http_options(s, &options, hls);
     snprintf(temp_filename, sizeof(temp_filename), use_temp_file ? "%s.tmp" : "%s", hls->master_m3u8_url);
-    ret = hlsenc_io_open(s, &hls->m3u8_out, temp_filename, &options);
+    ret = hlsenc_pl_open(s, &hls->m3u8_out, temp_filename, &options);
     av_dict_free(&options);
     if (ret < 0) {
         av_log(s, AV_LOG_ERROR, "Failed to open master play list file '%s'\n",
@@ -1439,9 +1857,9 @@ static int create_master_playlist(AVFormatContext *s,
 fail:
     if (ret >=0)
         hls->master_m3u8_created = 1;
-    hlsenc_io_close(s, &hls->m3u8_out, temp_filename);
+    hlsenc_pl_close(s, &hls->m3u8_out, temp_filename);
     if (use_temp_file)
-        ff_rename(temp_filename, hls->master_m3u8_url, s);
+        hlsenc_rename(hls, temp_filename, hls->master_m3u8_url, s);
 
     return ret;
 }
@@ -1449,7 +1867,7 @@ fail:
 static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
 {
     HLSContext *hls = s->priv_data;
-    HLSSegment *en;
+    HLSSegment *en = vs->segments;
     int target_duration = 0;
     int ret = 0;
     char temp_filename[MAX_URL_SIZE];
@@ -1459,11 +1877,9 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
     int is_file_proto = proto && !strcmp(proto, "file");
     int use_temp_file = is_file_proto && ((hls->flags & HLS_TEMP_FILE) || !(hls->pl_type == PLAYLIST_TYPE_VOD));
     static unsigned warned_non_file;
-    char *key_uri = NULL;
-    char *iv_string = NULL;
     AVDictionary *options = NULL;
-    double prog_date_time = vs->initial_prog_date_time;
-    double *prog_date_time_p = (hls->flags & HLS_PROGRAM_DATE_TIME) ? &prog_date_time : NULL;
+    AVIOContext *out;
+    size_t pos;
     int byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
 
     hls->version = 3;
@@ -1483,75 +1899,63 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
     if (!is_file_proto && (hls->flags & HLS_TEMP_FILE) && !warned_non_file++)
         av_log(s, AV_LOG_ERROR, "Cannot use rename on non file protocol, this may lead to races and temporary partial files\n");
 
+    if ((ret = hls_update_entry_cache(hls, vs)) < 0)
+        return ret;
+
     set_http_options(s, &options, hls);
     snprintf(temp_filename, sizeof(temp_filename), use_temp_file ? "%s.tmp" : "%s", vs->m3u8_name);
-    if ((ret = hlsenc_io_open(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename, &options)) < 0) {
+    if ((ret = hlsenc_pl_open(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename, &options)) < 0) {
         if (hls->ignore_io_errors)
             ret = 0;
         goto fail;
     }
 
-    for (en = vs->segments; en; en = en->next) {
-        if (target_duration <= en->duration)
-            target_duration = lrint(en->duration);
-    }
+    out = byterange_mode ? hls->m3u8_out : vs->out;
+
+    if (vs->td_tail > vs->td_head)
+        target_duration = FFMAX(lrint(vs->td_queue[vs->td_head]->duration), 0);
 
     vs->discontinuity_set = 0;
-    ff_hls_write_playlist_header(byterange_mode ? hls->m3u8_out : vs->out, hls->version, hls->allowcache,
+    ff_hls_write_playlist_header(out, hls->version, hls->allowcache,
                                  target_duration, sequence, hls->pl_type, hls->flags & HLS_I_FRAMES_ONLY);
 
     if ((hls->flags & HLS_DISCONT_START) && sequence==hls->start_sequence && vs->discontinuity_set==0) {
-        avio_printf(byterange_mode ? hls->m3u8_out : vs->out, "#EXT-X-DISCONTINUITY\n");
+        avio_printf(out, "#EXT-X-DISCONTINUITY\n");
         vs->discontinuity_set = 1;
     }
     if (vs->has_video && (hls->flags & HLS_INDEPENDENT_SEGMENTS)) {
-        avio_printf(byterange_mode ? hls->m3u8_out : vs->out, "#EXT-X-INDEPENDENT-SEGMENTS\n");
+        avio_printf(out, "#EXT-X-INDEPENDENT-SEGMENTS\n");
     }
-    for (en = vs->segments; en; en = en->next) {
-        if ((hls->encrypt || hls->key_info_file) && (!key_uri || strcmp(en->key_uri, key_uri) ||
-                                    av_strcasecmp(en->iv_string, iv_string))) {
-            avio_printf(byterange_mode ? hls->m3u8_out : vs->out, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"", en->key_uri);
-            if (*en->iv_string)
-                avio_printf(byterange_mode ? hls->m3u8_out : vs->out, ",IV=0x%s", en->iv_string);
-            avio_printf(byterange_mode ? hls->m3u8_out : vs->out, "\n");
-            key_uri = en->key_uri;
-            iv_string = en->iv_string;
-        }
+    if (en) {
+        /* The first segment always gets its key, and the init file goes
+         * between the key and the segment entry. */
+        pos = vs->pl_cache.start;
+        if ((hls->encrypt || hls->key_info_file) && !en->entry_key_size)
+            write_key_line(out, en);
+        avio_write(out, vs->pl_cache.buf + pos, en->entry_key_size);
+        pos += en->entry_key_size;
 
-        if ((hls->segment_type == SEGMENT_TYPE_FMP4) && (en == vs->segments)) {
-            ff_hls_write_init_file(byterange_mode ? hls->m3u8_out : vs->out, (hls->flags & HLS_SINGLE_FILE) ? en->filename : vs->fmp4_init_filename,
+        if (hls->segment_type == SEGMENT_TYPE_FMP4) {
+            ff_hls_write_init_file(out, (hls->flags & HLS_SINGLE_FILE) ? en->filename : vs->fmp4_init_filename,
                                    hls->flags & HLS_SINGLE_FILE, vs->init_range_length, 0);
         }
-
-        ret = ff_hls_write_file_entry(byterange_mode ? hls->m3u8_out : vs->out, en->discont, byterange_mode,
-                                      en->duration, hls->flags & HLS_ROUND_DURATIONS,
-                                      en->size, en->pos, hls->baseurl,
-                                      en->filename, prog_date_time_p, en->keyframe_size, en->keyframe_pos, hls->flags & HLS_I_FRAMES_ONLY);
-        if (ret < 0) {
-            av_log(s, AV_LOG_WARNING, "ff_hls_write_file_entry get error\n");
-        }
+        avio_write(out, vs->pl_cache.buf + pos, vs->pl_cache.end - pos);
     }
 
     if (last && (hls->flags & HLS_OMIT_ENDLIST)==0)
-        ff_hls_write_end_list(byterange_mode ? hls->m3u8_out : vs->out);
+        ff_hls_write_end_list(out);
 
     if (vs->vtt_m3u8_name) {
         snprintf(temp_vtt_filename, sizeof(temp_vtt_filename), use_temp_file ? "%s.tmp" : "%s", vs->vtt_m3u8_name);
-        if ((ret = hlsenc_io_open(s, &hls->sub_m3u8_out, temp_vtt_filename, &options)) < 0) {
+        if ((ret = hlsenc_pl_open(s, &hls->sub_m3u8_out, temp_vtt_filename, &options)) < 0) {
             if (hls->ignore_io_errors)
                 ret = 0;
             goto fail;
         }
         ff_hls_write_playlist_header(hls->sub_m3u8_out, hls->version, hls->allowcache,
                                      target_duration, sequence, PLAYLIST_TYPE_NONE, 0);
-        for (en = vs->segments; en; en = en->next) {
-            ret = ff_hls_write_file_entry(hls->sub_m3u8_out, 0, byterange_mode,
-                                          en->duration, 0, en->size, en->pos,
-                                          hls->baseurl, en->sub_filename, NULL, 0, 0, 0);
-            if (ret < 0) {
-                av_log(s, AV_LOG_WARNING, "ff_hls_write_file_entry get error\n");
-            }
-        }
+        avio_write(hls->sub_m3u8_out, vs->sub_pl_cache.buf + vs->sub_pl_cache.start,
+                   vs->sub_pl_cache.end - vs->sub_pl_cache.start);
 
         if (last)
             ff_hls_write_end_list(hls->sub_m3u8_out);
@@ -1560,15 +1964,15 @@ static int hls_window(AVFormatContext *s, int last, VariantStream *vs)
 
 fail:
     av_dict_free(&options);
-    ret = hlsenc_io_close(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename);
+    ret = hlsenc_pl_close(s, byterange_mode ? &hls->m3u8_out : &vs->out, temp_filename);
     if (ret < 0) {
         return ret;
     }
-    hlsenc_io_close(s, &hls->sub_m3u8_out, vs->vtt_m3u8_name);
+    hlsenc_pl_close(s, &hls->sub_m3u8_out, vs->vtt_m3u8_name ? temp_vtt_filename : NULL);
     if (use_temp_file) {
-        ff_rename(temp_filename, vs->m3u8_name, s);
+        hlsenc_rename(hls, temp_filename, vs->m3u8_name, s);
         if (vs->vtt_m3u8_name)
-            ff_rename(temp_vtt_filename, vs->vtt_m3u8_name, s);
+            hlsenc_rename(hls, temp_vtt_filename, vs->vtt_m3u8_name, s);
     }
     if (ret >= 0 && hls->master_pl_name)
         if (create_master_playlist(s, vs) < 0)
@@ -2470,31 +2874,51 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
 
                 set_http_options(s, &options, hls);
 
-                ret = hlsenc_io_open(s, &vs->out, filename, &options);
-                if (ret < 0) {
-                    av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
-                           "Failed to open file '%s'\n", filename);
-                    av_freep(&filename);
-                    av_dict_free(&options);
-                    return hls->ignore_io_errors ? 0 : ret;
-                }
-                if (hls->segment_type == SEGMENT_TYPE_FMP4) {
-                    write_styp(vs->out);
-                }
-                ret = flush_dynbuf(vs, &range_length);
-                if (ret < 0) {
-                    av_freep(&filename);
-                    av_dict_free(&options);
-                    return ret;
-                }
-                ret = hlsenc_io_close(s, &vs->out, filename);
-                if (ret < 0) {
-                    av_log(s, AV_LOG_WARNING, "upload segment failed,"
-                           " will retry with a new http session.\n");
-                    ff_format_io_close(s, &vs->out);
+                if (hls->async_queue) {
+                    uint8_t *buffer = NULL;
+
+                    av_write_frame(oc, NULL); /* Flush any buffered data */
+                    range_length = avio_close_dyn_buf(oc->pb, &buffer);
+                    oc->pb = NULL;
+                    ret = avio_open_dyn_buf(&oc->pb);
+                    if (ret < 0) {
+                        av_free(buffer);
+                    } else {
+                        ret = hls_async_write(hls, filename, &options, buffer, range_length,
+                                              hls->segment_type == SEGMENT_TYPE_FMP4);
+                    }
+                    if (ret < 0) {
+                        av_freep(&filename);
+                        av_dict_free(&options);
+                        return ret;
+                    }
+                } else {
                     ret = hlsenc_io_open(s, &vs->out, filename, &options);
-                    reflush_dynbuf(vs, &range_length);
+                    if (ret < 0) {
+                        av_log(s, hls->ignore_io_errors ? AV_LOG_WARNING : AV_LOG_ERROR,
+                               "Failed to open file '%s'\n", filename);
+                        av_freep(&filename);
+                        av_dict_free(&options);
+                        return hls->ignore_io_errors ? 0 : ret;
+                    }
+                    if (hls->segment_type == SEGMENT_TYPE_FMP4) {
+                        write_styp(vs->out);
+                    }
+                    ret = flush_dynbuf(vs, &range_length);
+                    if (ret < 0) {
+                        av_freep(&filename);
+                        av_dict_free(&options);
+                        return ret;
+                    }
                     ret = hlsenc_io_close(s, &vs->out, filename);
+                    if (ret < 0) {
+                        av_log(s, AV_LOG_WARNING, "upload segment failed,"
+                               " will retry with a new http session.\n");
+                        ff_format_io_close(s, &vs->out);
+                        ret = hlsenc_io_open(s, &vs->out, filename, &options);
+                        reflush_dynbuf(vs, &range_length);
+                        ret = hlsenc_io_close(s, &vs->out, filename);
+                    }
                 }
                 av_dict_free(&options);
                 av_freep(&vs->temp_buffer);
@@ -2592,6 +3016,8 @@ static void hls_deinit(AVFormatContext *s)
     int i = 0;
     VariantStream *vs = NULL;
 
+    hls_async_stop(s, 1);
+
     for (i = 0; i < hls->nb_varstreams; i++) {
         vs = &hls->var_streams[i];
 
@@ -2607,6 +3033,9 @@ static void hls_deinit(AVFormatContext *s)
             av_freep(&vs->init_buffer);
         hls_free_segments(vs->segments);
         hls_free_segments(vs->old_segments);
+        av_freep(&vs->pl_cache.buf);
+        av_freep(&vs->sub_pl_cache.buf);
+        av_freep(&vs->td_queue);
         av_freep(&vs->m3u8_name);
         av_freep(&vs->streams);
     }
@@ -2633,6 +3062,12 @@ static int hls_write_trailer(struct AVFormatContext *s)
     AVDictionary *options = NULL;
     int range_length, byterange_mode;
 
+    /* Let the queued segments and playlists be written out before the
+     * final ones, which are written synchronously. */
+    ret = hls_async_stop(s, 0);
+    if (ret < 0)
+        return ret;
+
     for (i = 0; i < hls->nb_varstreams; i++) {
         char *filename = NULL;
         vs = &hls->var_streams[i];
@@ -2993,6 +3428,9 @@ static int hls_init(AVFormatContext *s)
         vs->number++;
     }
 
+    if (hls->async_io)
+        ret = hls_async_start(s);
+
     return ret;
 }
 
@@ -3066,6 +3504,7 @@ static const AVOption options[] = {
     {"timeout", "set timeout for socket I/O operations", OFFSET(timeout), AV_OPT_TYPE_DURATION, { .i64 = -1 }, -1, INT_MAX, .flags = E },
     {"ignore_io_errors", "Ignore IO errors for stable long-duration runs with network output", OFFSET(ignore_io_errors), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     {"headers", "set custom HTTP headers, can override built in default headers", OFFSET(headers), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
+    {"hls_async_io", "write segments and playlists from a background thread, queueing at most this many operations", OFFSET(async_io), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, E },
     { NULL },
 };
 
@@ -193,6 +193,7 @@ typedef struct MOVStreamContext {
     int64_t current_index;
     MOVIndexRange* index_ranges;
     MOVIndexRange* current_index_range;
+    struct MOVIndexCursor *index_cursor; ///< sample tables position when the index is built lazily
     unsigned int bytes_per_frame;
     unsigned int samples_per_frame;
     int dv_audio_container;
@@ -235,6 +236,7 @@ typedef struct MOVStreamContext {
     uint32_t format;
 
     int has_sidx;  // If there is an sidx entry for this stream.
+    int has_frag_scan;  // If the fragment scan found this stream.
     struct {
         struct AVAESCTR* aes_ctr;
         unsigned int per_sample_iv_size;  // Either 0, 8, or 16.
@@ -291,6 +293,11 @@ typedef struct MOVContext {
     int decryption_key_len;
     int enable_drefs;
     int32_t movie_display_matrix[3][3]; ///< display matrix from mvhd
+    char *index_cache_path;
+    struct MOVIndexCache *index_cache;
+    int lazy_index;
+    int scan_fragments;
+    int has_scanned_fragments;
 } MOVContext;
 
 int ff_mp4_read_descr_len(AVIOContext *pb);
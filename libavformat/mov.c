@@ -59,6 +59,7 @@
 #include "libavcodec/get_bits.h"
 #include "id3v1.h"
 #include "mov_chan.h"
+#include "mov_index_cache.h"
 #include "replaygain.h"
 
 #if CONFIG_ZLIB
@@ -1235,7 +1236,7 @@ static int64_t get_stream_info_time(MOVFragmentStreamInfo * frag_stream_info)
 }
 
 static int64_t get_frag_time(MOVFragmentIndex *frag_index,
-                             int index, int track_id)
+                             int index, int track_id, int frag_scan)
 {
     MOVFragmentStreamInfo * frag_stream_info;
     int64_t timestamp;
@@ -1243,6 +1244,9 @@ static int64_t get_frag_time(MOVFragmentIndex *frag_index,
 
     if (track_id >= 0) {
         frag_stream_info = get_frag_stream_info(frag_index, index, track_id);
+        // Fragments found by the scan are not necessarily referenced by a sidx
+        if (frag_scan)
+            return get_stream_info_time(frag_stream_info);
         return frag_stream_info->sidx_pts;
     }
 
@@ -1260,14 +1264,15 @@ static int search_frag_timestamp(MOVFragmentIndex *frag_index,
 {
     int a, b, m, m0;
     int64_t frag_time;
-    int id = -1;
+    int id = -1, frag_scan = 0;
 
     if (st) {
-        // If the stream is referenced by any sidx, limit the search
-        // to fragments that referenced this stream in the sidx
+        // If the stream is referenced by any sidx or was found by the
+        // fragment scan, limit the search to fragments containing it
         MOVStreamContext *sc = st->priv_data;
-        if (sc->has_sidx)
+        if (sc->has_sidx || sc->has_frag_scan)
             id = st->id;
+        frag_scan = sc->has_frag_scan;
     }
 
     a = -1;
@@ -1277,7 +1282,7 @@ static int search_frag_timestamp(MOVFragmentIndex *frag_index,
         m0 = m = (a + b) >> 1;
 
         while (m < b &&
-               (frag_time = get_frag_time(frag_index, m, id)) == AV_NOPTS_VALUE)
+               (frag_time = get_frag_time(frag_index, m, id, frag_scan)) == AV_NOPTS_VALUE)
             m++;
 
         if (m < b && frag_time <= timestamp)
@@ -1362,15 +1367,206 @@ static void fix_frag_index_entries(MOVFragmentIndex *frag_index, int index,
     }
 }
 
+/**
+ * Read the header of the atom at the current position of pb, which must
+ * end before end. On success, atom->size is set to the size of its payload.
+ */
+static int mov_scan_atom_header(AVIOContext *pb, int64_t end, MOVAtom *atom)
+{
+    int64_t size, header_size = 8;
+
+    if (end - avio_tell(pb) < 8)
+        return AVERROR_INVALIDDATA;
+    size       = avio_rb32(pb);
+    atom->type = avio_rl32(pb);
+    if (size == 1) {
+        if (end - avio_tell(pb) < 8)
+            return AVERROR_INVALIDDATA;
+        size        = avio_rb64(pb);
+        header_size = 16;
+    } else if (!size) {
+        size = end - avio_tell(pb) + header_size;
+    }
+    if (size < header_size || size - header_size > end - avio_tell(pb))
+        return AVERROR_INVALIDDATA;
+    atom->size = size - header_size;
+    return 0;
+}
+
+typedef struct MOVFragmentScan {
+    int found;          ///< the stream has track fragments
+    int64_t data_size;  ///< size of the samples in the track fragments
+} MOVFragmentScan;
+
+/**
+ * Add the fragment of the moof atom at moof_offset to the fragment index.
+ * Its start time is taken from the tfdt of its track fragments and the
+ * stream durations are updated from the sample durations of its trun atoms.
+ */
+static int mov_scan_moof(MOVContext *c, AVIOContext *pb, MOVFragmentScan *scan,
+                         int64_t moof_offset, int64_t moof_end)
+{
+    int index = update_frag_index(c, moof_offset);
+    MOVAtom traf, a;
+    int i, ret;
+
+    if (index < 0)
+        return AVERROR_INVALIDDATA;
+
+    while ((ret = mov_scan_atom_header(pb, moof_end, &traf)) >= 0) {
+        int64_t traf_end = avio_tell(pb) + traf.size;
+        int64_t base_dts = AV_NOPTS_VALUE, duration = 0, data_size = 0;
+        unsigned track_id = 0, default_duration = 0, default_size = 0;
+        MOVFragmentStreamInfo *frag_stream_info;
+        AVStream *st = NULL;
+
+        if (traf.type != MKTAG('t','r','a','f')) {
+            avio_skip(pb, traf.size);
+            continue;
+        }
+        while ((ret = mov_scan_atom_header(pb, traf_end, &a)) >= 0) {
+            int64_t end = avio_tell(pb) + a.size;
+            unsigned entries, entry_size;
+            int version, flags;
+
+            if (a.type != MKTAG('t','f','h','d') &&
+                a.type != MKTAG('t','f','d','t') &&
+                a.type != MKTAG('t','r','u','n')) {
+                avio_skip(pb, a.size);
+                continue;
+            }
+            version = avio_r8(pb);
+            flags   = avio_rb24(pb);
+
+            if (a.type == MKTAG('t','f','h','d')) {
+                track_id = avio_rb32(pb);
+                for (i = 0; i < c->trex_count; i++)
+                    if (c->trex_data[i].track_id == track_id) {
+                        default_duration = c->trex_data[i].duration;
+                        default_size     = c->trex_data[i].size;
+                    }
+                if (flags & MOV_TFHD_BASE_DATA_OFFSET) avio_rb64(pb);
+                if (flags & MOV_TFHD_STSD_ID)          avio_rb32(pb);
+                if (flags & MOV_TFHD_DEFAULT_DURATION) default_duration = avio_rb32(pb);
+                if (flags & MOV_TFHD_DEFAULT_SIZE)     default_size     = avio_rb32(pb);
+            } else if (a.type == MKTAG('t','f','d','t')) {
+                base_dts = version ? avio_rb64(pb) : avio_rb32(pb);
+            } else if (a.type == MKTAG('t','r','u','n')) {
+                entries = avio_rb32(pb);
+                if (flags & MOV_TRUN_DATA_OFFSET)        avio_rb32(pb);
+                if (flags & MOV_TRUN_FIRST_SAMPLE_FLAGS) avio_rb32(pb);
+                entry_size = 4 * !!(flags & MOV_TRUN_SAMPLE_DURATION) +
+                             4 * !!(flags & MOV_TRUN_SAMPLE_SIZE) +
+                             4 * !!(flags & MOV_TRUN_SAMPLE_FLAGS) +
+                             4 * !!(flags & MOV_TRUN_SAMPLE_CTS);
+                if ((uint64_t)entries * entry_size > end - avio_tell(pb))
+                    return AVERROR_INVALIDDATA;
+                if (!(flags & MOV_TRUN_SAMPLE_DURATION))
+                    duration  += (int64_t)entries * default_duration;
+                if (!(flags & MOV_TRUN_SAMPLE_SIZE))
+                    data_size += (int64_t)entries * default_size;
+                if (flags & (MOV_TRUN_SAMPLE_DURATION | MOV_TRUN_SAMPLE_SIZE)) {
+                    for (i = 0; i < entries; i++) {
+                        if (flags & MOV_TRUN_SAMPLE_DURATION) duration  += avio_rb32(pb);
+                        if (flags & MOV_TRUN_SAMPLE_SIZE)     data_size += avio_rb32(pb);
+                        if (flags & MOV_TRUN_SAMPLE_FLAGS)    avio_rb32(pb);
+                        if (flags & MOV_TRUN_SAMPLE_CTS)      avio_rb32(pb);
+                    }
+                }
+            }
+            if (avio_tell(pb) > end)
+                return AVERROR_INVALIDDATA;
+            avio_skip(pb, end - avio_tell(pb));
+        }
+        if (avio_tell(pb) != traf_end)
+            return AVERROR_INVALIDDATA;
+
+        for (i = 0; i < c->fc->nb_streams; i++)
+            if (c->fc->streams[i]->id == track_id) {
+                st = c->fc->streams[i];
+                break;
+            }
+        if (!st)
+            continue;
+        /* fragments can only be located in time with a tfdt */
+        if (base_dts == AV_NOPTS_VALUE)
+            return AVERROR_INVALIDDATA;
+
+        frag_stream_info = get_frag_stream_info(&c->frag_index, index, track_id);
+        if (frag_stream_info && frag_stream_info->tfdt_dts == AV_NOPTS_VALUE)
+            frag_stream_info->tfdt_dts = base_dts;
+        scan[i].found      = 1;
+        scan[i].data_size += data_size;
+        /* mov_read_trun() subtracts time_offset from the tfdt for the sample
+         * timestamps and adds it back for the track end, so the track end
+         * is in the same tfdt time base as base_dts */
+        if (st->duration < base_dts + duration)
+            st->duration = base_dts + duration;
+    }
+    return avio_tell(pb) == moof_end ? 0 : AVERROR_INVALIDDATA;
+}
+
+/**
+ * Build the fragment index from the moof atoms following the current one,
+ * seeking over the media data in between. Returns 1 if all the fragments up
+ * to the end of the file could be indexed, in which case the index can be
+ * marked complete and their headers are read only when needed.
+ */
+static int mov_scan_fragments(MOVContext *c, AVIOContext *pb)
+{
+    int64_t pos = avio_tell(pb);
+    int64_t file_size = avio_size(pb);
+    int64_t offset = c->fragment.moof_offset;
+    int nb_fragments = 0, complete = 0, i;
+    MOVFragmentScan *scan;
+    MOVAtom a;
+
+    if (!(scan = av_calloc(c->fc->nb_streams, sizeof(*scan))))
+        return 0;
+
+    while (offset < file_size) {
+        int64_t end;
+        if (avio_seek(pb, offset, SEEK_SET) != offset ||
+            mov_scan_atom_header(pb, file_size, &a) < 0)
+            break;
+        end = avio_tell(pb) + a.size;
+        if (a.type == MKTAG('m','o','o','f')) {
+            if (mov_scan_moof(c, pb, scan, offset, end) < 0)
+                break;
+            nb_fragments++;
+        }
+        offset = end;
+    }
+
+    if (offset == file_size) {
+        /* the sample sizes are not summed up again when reading the truns */
+        for (i = 0; i < c->fc->nb_streams; i++) {
+            MOVStreamContext *sc = c->fc->streams[i]->priv_data;
+            if (scan[i].found) {
+                sc->has_frag_scan = 1;
+                sc->data_size    += scan[i].data_size;
+            }
+        }
+        complete = 1;
+        av_log(c->fc, AV_LOG_VERBOSE, "indexed %d fragments\n", nb_fragments);
+    } else {
+        av_log(c->fc, AV_LOG_VERBOSE, "fragment scan stopped at offset %"PRId64"\n", offset);
+    }
+    av_free(scan);
+    avio_seek(pb, pos, SEEK_SET);
+    return complete;
+}
+
 static int mov_read_moof(MOVContext *c, AVIOContext *pb, MOVAtom atom)
 {
+    int ret, complete = 0;
+
     // Set by mov_read_tfhd(). mov_read_trun() will reject files missing tfhd.
     c->fragment.found_tfhd = 0;
 
     if (!c->has_looked_for_mfra && c->use_mfra_for > 0) {
         c->has_looked_for_mfra = 1;
         if (pb->seekable & AVIO_SEEKABLE_NORMAL) {
-            int ret;
             av_log(c->fc, AV_LOG_VERBOSE, "stream has moof boxes, will look "
                     "for a mfra\n");
             if ((ret = mov_read_mfra(c, pb)) < 0) {
@@ -1385,7 +1581,18 @@ static int mov_read_moof(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     c->fragment.moof_offset = c->fragment.implicit_offset = avio_tell(pb) - 8;
     av_log(c->fc, AV_LOG_TRACE, "moof offset %"PRIx64"\n", c->fragment.moof_offset);
     c->frag_index.current = update_frag_index(c, c->fragment.moof_offset);
-    return mov_read_default(c, pb, atom);
+    if (c->scan_fragments && !c->has_scanned_fragments && !c->frag_index.complete &&
+        (pb->seekable & AVIO_SEEKABLE_NORMAL)) {
+        c->has_scanned_fragments = 1;
+        complete = mov_scan_fragments(c, pb);
+    }
+    ret = mov_read_default(c, pb, atom);
+    /* Marked only now, as mov_read_default() stops reading the header after
+     * the current atom once the index is complete: this moof must be read
+     * up to its end first. */
+    if (complete)
+        c->frag_index.complete = 1;
+    return ret;
 }
 
 static void mov_metadata_creation_time(AVDictionary **metadata, int64_t time, void *logctx)
@@ -3755,19 +3962,254 @@ static void mov_fix_index(MOVContext *mov, AVStream *st)
     msc->current_index = msc->index_ranges[0].start;
 }
 
+/**
+ * Position in the sample tables of a track while its index is being built.
+ * Kept in MOVStreamContext.index_cursor between calls when the index is
+ * built lazily.
+ */
+typedef struct MOVIndexCursor {
+    unsigned int chunk;            ///< current chunk
+    unsigned int chunk_sample;     ///< next sample in the current chunk
+    int chunk_started;             ///< current chunk has been set up
+    unsigned int sample;           ///< next sample of the track
+    unsigned int stts_index;
+    unsigned int stts_sample;
+    unsigned int stsc_index;
+    unsigned int stss_index;
+    unsigned int stps_index;
+    unsigned int rap_group_index;
+    unsigned int rap_group_sample;
+    unsigned int distance;         ///< samples since the last keyframe
+    int key_off;
+    int64_t offset;
+    int64_t dts;
+    int64_t last_dts;
+    int64_t dts_correction;
+    uint64_t stream_size;
+} MOVIndexCursor;
+
+/* number of index entries appended at a time when the index is built lazily */
+#define MOV_LAZY_INDEX_ENTRIES 1024
+
+/**
+ * Expand the ctts entries such that there is a 1-1 mapping with samples.
+ */
+static int mov_expand_ctts(MOVStreamContext *sc)
+{
+    MOVStts *ctts_data_old = sc->ctts_data;
+    unsigned int ctts_count_old = sc->ctts_count;
+    unsigned int i, j;
+
+    if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
+        return AVERROR(EINVAL);
+    sc->ctts_count = 0;
+    sc->ctts_allocated_size = 0;
+    sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
+                            sc->sample_count * sizeof(*sc->ctts_data));
+    if (!sc->ctts_data) {
+        av_free(ctts_data_old);
+        return AVERROR(ENOMEM);
+    }
+
+    memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
+
+    for (i = 0; i < ctts_count_old &&
+                sc->ctts_count < sc->sample_count; i++)
+        for (j = 0; j < ctts_data_old[i].count &&
+                    sc->ctts_count < sc->sample_count; j++)
+            add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
+                           &sc->ctts_allocated_size, 1,
+                           ctts_data_old[i].duration);
+    av_free(ctts_data_old);
+    return 0;
+}
+
+/**
+ * Append at most nb_entries index entries for the samples following the
+ * cursor position.
+ *
+ * @return 1 if all samples have been indexed, 0 if there are samples left,
+ *         a negative AVERROR code on invalid sample tables
+ */
+static int mov_build_index_entries(MOVContext *mov, AVStream *st,
+                                   MOVIndexCursor *cur, unsigned int nb_entries)
+{
+    MOVStreamContext *sc = st->priv_data;
+    unsigned int max_entries = st->nb_index_entries + (sc->sample_count - cur->sample);
+    unsigned int end = st->nb_index_entries + FFMIN(nb_entries, sc->sample_count - cur->sample);
+    int rap_group_present = sc->rap_group_count && sc->rap_group;
+    unsigned int sample_size;
+
+    if (end > st->index_entries_allocated_size / sizeof(*st->index_entries)) {
+        unsigned int size = FFMIN(FFMAX(end, 2 * st->nb_index_entries), max_entries);
+        if (av_reallocp_array(&st->index_entries, size, sizeof(*st->index_entries)) < 0) {
+            st->index_entries_allocated_size = 0;
+            st->nb_index_entries = 0;
+            return AVERROR(ENOMEM);
+        }
+        st->index_entries_allocated_size = size * sizeof(*st->index_entries);
+    }
+
+    while (cur->chunk < sc->chunk_count) {
+        int keyframe = 0;
+
+        if (!cur->chunk_started) {
+            int64_t next_offset = cur->chunk + 1 < sc->chunk_count ? sc->chunk_offsets[cur->chunk + 1] : INT64_MAX;
+            cur->offset = sc->chunk_offsets[cur->chunk];
+            while (mov_stsc_index_valid(cur->stsc_index, sc->stsc_count) &&
+                cur->chunk + 1 == sc->stsc_data[cur->stsc_index + 1].first)
+                cur->stsc_index++;
+
+            if (next_offset > cur->offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
+                sc->stsc_data[cur->stsc_index].count * (int64_t)sc->stsz_sample_size > next_offset - cur->offset) {
+                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
+                sc->stsz_sample_size = sc->sample_size;
+            }
+            if (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size) {
+                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
+                sc->stsz_sample_size = sc->sample_size;
+            }
+            cur->chunk_started = 1;
+        }
+
+        if (cur->chunk_sample >= sc->stsc_data[cur->stsc_index].count) {
+            cur->chunk++;
+            cur->chunk_sample  = 0;
+            cur->chunk_started = 0;
+            continue;
+        }
+        if (cur->sample >= sc->sample_count) {
+            av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
+            return AVERROR_INVALIDDATA;
+        }
+        if (st->nb_index_entries >= end)
+            return 0;
+
+        if (!sc->keyframe_absent && (!sc->keyframe_count || cur->sample+cur->key_off == sc->keyframes[cur->stss_index])) {
+            keyframe = 1;
+            if (cur->stss_index + 1 < sc->keyframe_count)
+                cur->stss_index++;
+        } else if (sc->stps_count && cur->sample+cur->key_off == sc->stps_data[cur->stps_index]) {
+            keyframe = 1;
+            if (cur->stps_index + 1 < sc->stps_count)
+                cur->stps_index++;
+        }
+        if (rap_group_present && cur->rap_group_index < sc->rap_group_count) {
+            if (sc->rap_group[cur->rap_group_index].index > 0)
+                keyframe = 1;
+            if (++cur->rap_group_sample == sc->rap_group[cur->rap_group_index].count) {
+                cur->rap_group_sample = 0;
+                cur->rap_group_index++;
+            }
+        }
+        if (sc->keyframe_absent
+            && !sc->stps_count
+            && !rap_group_present
+            && (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || (cur->chunk==0 && cur->chunk_sample==0)))
+             keyframe = 1;
+        if (keyframe)
+            cur->distance = 0;
+        sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[cur->sample];
+        if (sc->pseudo_stream_id == -1 ||
+           sc->stsc_data[cur->stsc_index].id - 1 == sc->pseudo_stream_id) {
+            AVIndexEntry *e;
+            if (sample_size > 0x3FFFFFFF) {
+                av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sample_size);
+                return AVERROR_INVALIDDATA;
+            }
+            e = &st->index_entries[st->nb_index_entries++];
+            e->pos = cur->offset;
+            e->timestamp = cur->dts;
+            e->size = sample_size;
+            e->min_distance = cur->distance;
+            e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
+            av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, sample %u, offset %"PRIx64", dts %"PRId64", "
+                    "size %u, distance %u, keyframe %d\n", st->index, cur->sample,
+                    cur->offset, cur->dts, sample_size, cur->distance, keyframe);
+            if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && st->nb_index_entries < 100)
+                ff_rfps_add_frame(mov->fc, st, cur->dts);
+        }
+
+        cur->offset += sample_size;
+        cur->stream_size += sample_size;
+
+        /* A negative sample duration is invalid based on the spec,
+         * but some samples need it to correct the DTS. */
+        if (sc->stts_data[cur->stts_index].duration < 0) {
+            av_log(mov->fc, AV_LOG_WARNING,
+                   "Invalid SampleDelta %d in STTS, at %d st:%d\n",
+                   sc->stts_data[cur->stts_index].duration, cur->stts_index,
+                   st->index);
+            cur->dts_correction += sc->stts_data[cur->stts_index].duration - 1;
+            sc->stts_data[cur->stts_index].duration = 1;
+        }
+        cur->dts += sc->stts_data[cur->stts_index].duration;
+        if (!cur->dts_correction || cur->dts + cur->dts_correction > cur->last_dts) {
+            cur->dts += cur->dts_correction;
+            cur->dts_correction = 0;
+        } else {
+            /* Avoid creating non-monotonous DTS */
+            cur->dts_correction += cur->dts - cur->last_dts - 1;
+            cur->dts = cur->last_dts + 1;
+        }
+        cur->last_dts = cur->dts;
+        cur->distance++;
+        cur->stts_sample++;
+        cur->sample++;
+        cur->chunk_sample++;
+        if (cur->stts_index + 1 < sc->stts_count && cur->stts_sample == sc->stts_data[cur->stts_index].count) {
+            cur->stts_sample = 0;
+            cur->stts_index++;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Check whether the index of a lazily indexed track contains a keyframe at
+ * or after timestamp, so that seeking to timestamp can be done on it.
+ */
+static int mov_lazy_index_covers(AVStream *st, int64_t timestamp)
+{
+    int i;
+
+    for (i = st->nb_index_entries - 1; i >= 0 && st->index_entries[i].timestamp >= timestamp; i--)
+        if (st->index_entries[i].flags & AVINDEX_KEYFRAME)
+            return 1;
+    return 0;
+}
+
+/**
+ * Extend the index of a lazily indexed track until it has more than
+ * min_entries entries and, unless timestamp is AV_NOPTS_VALUE, covers
+ * timestamp, or until all samples have been indexed.
+ */
+static void mov_lazy_index_expand(MOVContext *mov, AVStream *st,
+                                  unsigned int min_entries, int64_t timestamp)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int ret;
+
+    while (sc->index_cursor &&
+           (st->nb_index_entries <= min_entries ||
+            (timestamp != AV_NOPTS_VALUE && !mov_lazy_index_covers(st, timestamp)))) {
+        ret = mov_build_index_entries(mov, st, sc->index_cursor, MOV_LAZY_INDEX_ENTRIES);
+        if (ret) {
+            if (ret < 0)
+                av_log(mov->fc, AV_LOG_WARNING, "stream %d: index truncated at %d entries\n",
+                       st->index, st->nb_index_entries);
+            av_freep(&sc->index_cursor);
+        }
+    }
+}
+
 static void mov_build_index(MOVContext *mov, AVStream *st)
 {
     MOVStreamContext *sc = st->priv_data;
     int64_t current_offset;
     int64_t current_dts = 0;
-    unsigned int stts_index = 0;
     unsigned int stsc_index = 0;
-    unsigned int stss_index = 0;
-    unsigned int stps_index = 0;
-    unsigned int i, j;
-    uint64_t stream_size = 0;
-    MOVStts *ctts_data_old = sc->ctts_data;
-    unsigned int ctts_count_old = sc->ctts_count;
+    unsigned int i;
 
     if (sc->elst_count) {
         int i, edit_start_index = 0, multiple_edits = 0;
@@ -3811,160 +4253,51 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     /* only use old uncompressed audio chunk demuxing when stts specifies it */
     if (!(st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
           sc->stts_count == 1 && sc->stts_data[0].duration == 1)) {
-        unsigned int current_sample = 0;
-        unsigned int stts_sample = 0;
-        unsigned int sample_size;
-        unsigned int distance = 0;
-        unsigned int rap_group_index = 0;
-        unsigned int rap_group_sample = 0;
-        int64_t last_dts = 0;
-        int64_t dts_correction = 0;
-        int rap_group_present = sc->rap_group_count && sc->rap_group;
-        int key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
+        MOVIndexCursor cursor = { 0 }, *cur = &cursor;
+        /* edit lists are applied to the complete index */
+        int lazy = mov->lazy_index &&
+                   (!sc->elst_count || mov->ignore_editlist || !mov->advanced_editlist);
 
         current_dts -= sc->dts_shift;
-        last_dts     = current_dts;
 
         if (!sc->sample_count || st->nb_index_entries)
             return;
         if (sc->sample_count >= UINT_MAX / sizeof(*st->index_entries) - st->nb_index_entries)
             return;
-        if (av_reallocp_array(&st->index_entries,
-                              st->nb_index_entries + sc->sample_count,
-                              sizeof(*st->index_entries)) < 0) {
-            st->nb_index_entries = 0;
-            return;
-        }
-        st->index_entries_allocated_size = (st->nb_index_entries + sc->sample_count) * sizeof(*st->index_entries);
 
-        if (ctts_data_old) {
-            // Expand ctts entries such that we have a 1-1 mapping with samples
-            if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
+        if (lazy) {
+            if (!(sc->index_cursor = av_mallocz(sizeof(*sc->index_cursor))))
                 return;
-            sc->ctts_count = 0;
-            sc->ctts_allocated_size = 0;
-            sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
-                                    sc->sample_count * sizeof(*sc->ctts_data));
-            if (!sc->ctts_data) {
-                av_free(ctts_data_old);
+            cur = sc->index_cursor;
+        } else {
+            if (av_reallocp_array(&st->index_entries,
+                                  st->nb_index_entries + sc->sample_count,
+                                  sizeof(*st->index_entries)) < 0) {
+                st->nb_index_entries = 0;
                 return;
             }
+            st->index_entries_allocated_size = (st->nb_index_entries + sc->sample_count) * sizeof(*st->index_entries);
 
-            memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
-
-            for (i = 0; i < ctts_count_old &&
-                        sc->ctts_count < sc->sample_count; i++)
-                for (j = 0; j < ctts_data_old[i].count &&
-                            sc->ctts_count < sc->sample_count; j++)
-                    add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
-                                   &sc->ctts_allocated_size, 1,
-                                   ctts_data_old[i].duration);
-            av_free(ctts_data_old);
+            if (sc->ctts_data && mov_expand_ctts(sc) < 0)
+                return;
         }
 
-        for (i = 0; i < sc->chunk_count; i++) {
-            int64_t next_offset = i+1 < sc->chunk_count ? sc->chunk_offsets[i+1] : INT64_MAX;
-            current_offset = sc->chunk_offsets[i];
-            while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
-                i + 1 == sc->stsc_data[stsc_index + 1].first)
-                stsc_index++;
-
-            if (next_offset > current_offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
-                sc->stsc_data[stsc_index].count * (int64_t)sc->stsz_sample_size > next_offset - current_offset) {
-                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
-                sc->stsz_sample_size = sc->sample_size;
-            }
-            if (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size) {
-                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
-                sc->stsz_sample_size = sc->sample_size;
-            }
-
-            for (j = 0; j < sc->stsc_data[stsc_index].count; j++) {
-                int keyframe = 0;
-                if (current_sample >= sc->sample_count) {
-                    av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
-                    return;
-                }
-
-                if (!sc->keyframe_absent && (!sc->keyframe_count || current_sample+key_off == sc->keyframes[stss_index])) {
-                    keyframe = 1;
-                    if (stss_index + 1 < sc->keyframe_count)
-                        stss_index++;
-                } else if (sc->stps_count && current_sample+key_off == sc->stps_data[stps_index]) {
-                    keyframe = 1;
-                    if (stps_index + 1 < sc->stps_count)
-                        stps_index++;
-                }
-                if (rap_group_present && rap_group_index < sc->rap_group_count) {
-                    if (sc->rap_group[rap_group_index].index > 0)
-                        keyframe = 1;
-                    if (++rap_group_sample == sc->rap_group[rap_group_index].count) {
-                        rap_group_sample = 0;
-                        rap_group_index++;
-                    }
-                }
-                if (sc->keyframe_absent
-                    && !sc->stps_count
-                    && !rap_group_present
-                    && (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || (i==0 && j==0)))
-                     keyframe = 1;
-                if (keyframe)
-                    distance = 0;
-                sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[current_sample];
-                if (sc->pseudo_stream_id == -1 ||
-                   sc->stsc_data[stsc_index].id - 1 == sc->pseudo_stream_id) {
-                    AVIndexEntry *e;
-                    if (sample_size > 0x3FFFFFFF) {
-                        av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sample_size);
-                        return;
-                    }
-                    e = &st->index_entries[st->nb_index_entries++];
-                    e->pos = current_offset;
-                    e->timestamp = current_dts;
-                    e->size = sample_size;
-                    e->min_distance = distance;
-                    e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
-                    av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, sample %u, offset %"PRIx64", dts %"PRId64", "
-                            "size %u, distance %u, keyframe %d\n", st->index, current_sample,
-                            current_offset, current_dts, sample_size, distance, keyframe);
-                    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && st->nb_index_entries < 100)
-                        ff_rfps_add_frame(mov->fc, st, current_dts);
-                }
+        cur->dts      = current_dts;
+        cur->last_dts = current_dts;
+        cur->key_off  = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
 
-                current_offset += sample_size;
-                stream_size += sample_size;
-
-                /* A negative sample duration is invalid based on the spec,
-                 * but some samples need it to correct the DTS. */
-                if (sc->stts_data[stts_index].duration < 0) {
-                    av_log(mov->fc, AV_LOG_WARNING,
-                           "Invalid SampleDelta %d in STTS, at %d st:%d\n",
-                           sc->stts_data[stts_index].duration, stts_index,
-                           st->index);
-                    dts_correction += sc->stts_data[stts_index].duration - 1;
-                    sc->stts_data[stts_index].duration = 1;
-                }
-                current_dts += sc->stts_data[stts_index].duration;
-                if (!dts_correction || current_dts + dts_correction > last_dts) {
-                    current_dts += dts_correction;
-                    dts_correction = 0;
-                } else {
-                    /* Avoid creating non-monotonous DTS */
-                    dts_correction += current_dts - last_dts - 1;
-                    current_dts = last_dts + 1;
-                }
-                last_dts = current_dts;
-                distance++;
-                stts_sample++;
-                current_sample++;
-                if (stts_index + 1 < sc->stts_count && stts_sample == sc->stts_data[stts_index].count) {
-                    stts_sample = 0;
-                    stts_index++;
-                }
-            }
+        if (lazy) {
+            mov_lazy_index_expand(mov, st, 0, AV_NOPTS_VALUE);
+            /* the sample sizes have been summed up when reading stsz */
+            if (sc->stsz_sample_size > 0)
+                cur->stream_size = (uint64_t)sc->stsz_sample_size * sc->sample_count;
+            else
+                cur->stream_size = sc->data_size;
+        } else if (mov_build_index_entries(mov, st, cur, UINT_MAX) < 0) {
+            return;
         }
         if (st->duration > 0)
-            st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+            st->codecpar->bit_rate = cur->stream_size*8*sc->time_scale/st->duration;
     } else {
         unsigned chunk_samples, total = 0;
 
@@ -4311,14 +4644,16 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         && sc->time_scale == st->codecpar->sample_rate) {
             st->need_parsing = AVSTREAM_PARSE_FULL;
     }
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stts_data);
-    av_freep(&sc->stps_data);
-    av_freep(&sc->elst_data);
-    av_freep(&sc->rap_group);
+    /* Do not need those anymore, unless the index is still being built. */
+    if (!sc->index_cursor) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stts_data);
+        av_freep(&sc->stps_data);
+        av_freep(&sc->elst_data);
+        av_freep(&sc->rap_group);
+    }
 
     return 0;
 }
@@ -4741,7 +5076,7 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     unsigned entries, first_sample_flags = frag->flags;
     int flags, distance, i;
     int64_t prev_dts = AV_NOPTS_VALUE;
-    int next_frag_index = -1, index_entry_pos;
+    int next_frag_index = -1, index_entry_pos, ret;
     size_t requested_size;
     size_t old_ctts_allocated_size;
     AVIndexEntry *new_entries;
@@ -4766,6 +5101,13 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     if (sc->pseudo_stream_id+1 != frag->stsd_id && sc->pseudo_stream_id != -1)
         return 0;
 
+    // Fragment samples are inserted into the complete index.
+    if (sc->index_cursor) {
+        mov_lazy_index_expand(c, st, UINT_MAX, AV_NOPTS_VALUE);
+        if (sc->ctts_data && (ret = mov_expand_ctts(sc)) < 0)
+            return ret;
+    }
+
     // Find the next frag_index index that has a valid index_entry for
     // the current track_id.
     //
@@ -4948,7 +5290,8 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         distance++;
         dts += sample_duration;
         offset += sample_size;
-        sc->data_size += sample_size;
+        if (!sc->has_frag_scan)
+            sc->data_size += sample_size;
 
         if (sample_duration <= INT64_MAX - sc->duration_for_fps &&
             1 <= INT_MAX - sc->nb_frames_for_fps
@@ -7005,7 +7348,12 @@ static int mov_read_default(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         } else {
             int64_t start_pos = avio_tell(pb);
             int64_t left;
-            int err = parse(c, pb, a);
+            int err = c->index_cache ? ff_mov_index_cache_load(c, pb, a) : 0;
+            if (!err) {
+                err = parse(c, pb, a);
+                if (err >= 0 && c->index_cache)
+                    err = ff_mov_index_cache_add(c, pb, a);
+            }
             if (err < 0) {
                 c->atom_depth --;
                 return err;
@@ -7148,6 +7496,7 @@ static void mov_read_chapters(AVFormatContext *s)
 
         sc = st->priv_data;
         cur_pos = avio_tell(sc->pb);
+        mov_lazy_index_expand(mov, st, UINT_MAX, AV_NOPTS_VALUE);
 
         if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
             st->disposition |= AV_DISPOSITION_ATTACHED_PIC | AV_DISPOSITION_TIMED_THUMBNAILS;
@@ -7307,6 +7656,8 @@ static int mov_read_close(AVFormatContext *s)
     MOVContext *mov = s->priv_data;
     int i, j;
 
+    ff_mov_index_cache_free(mov);
+
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *st = s->streams[i];
         MOVStreamContext *sc = st->priv_data;
@@ -7338,6 +7689,7 @@ static int mov_read_close(AVFormatContext *s)
         av_freep(&sc->rap_group);
         av_freep(&sc->display_matrix);
         av_freep(&sc->index_ranges);
+        av_freep(&sc->index_cursor);
 
         if (sc->extradata)
             for (j = 0; j < sc->stsd_count; j++)
@@ -7540,6 +7892,10 @@ static int mov_read_header(AVFormatContext *s)
     else
         atom.size = INT64_MAX;
 
+    if (mov->index_cache_path && (pb->seekable & AVIO_SEEKABLE_NORMAL) &&
+        (err = ff_mov_index_cache_init(mov, atom.size)) < 0)
+        goto fail;
+
     /* check MOV header */
     do {
         if (mov->moov_retry)
@@ -7554,6 +7910,10 @@ static int mov_read_header(AVFormatContext *s)
         err = AVERROR_INVALIDDATA;
         goto fail;
     }
+    if (mov->index_cache) {
+        ff_mov_index_cache_write(mov);
+        ff_mov_index_cache_free(mov);
+    }
     av_log(mov->fc, AV_LOG_TRACE, "on_parse_exit_offset=%"PRId64"\n", avio_tell(pb));
 
     if (pb->seekable & AVIO_SEEKABLE_NORMAL) {
@@ -7736,6 +8096,10 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
         MOVStreamContext *msc = avst->priv_data;
+        /* make sure the sample after the current one is indexed as well,
+         * its timestamp may be used for the packet duration */
+        if (msc->index_cursor && msc->current_sample + 1 >= avst->nb_index_entries)
+            mov_lazy_index_expand(s->priv_data, avst, msc->current_sample + 1, AV_NOPTS_VALUE);
         if (msc->pb && msc->current_sample < avst->nb_index_entries) {
             AVIndexEntry *current_sample = &avst->index_entries[msc->current_sample];
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
@@ -7990,11 +8354,16 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
 static int mov_seek_fragment(AVFormatContext *s, AVStream *st, int64_t timestamp)
 {
     MOVContext *mov = s->priv_data;
+    MOVStreamContext *sc = st->priv_data;
     int index;
 
     if (!mov->frag_index.complete)
         return 0;
 
+    // tfdt times found by the fragment scan are media times
+    if (sc->has_frag_scan)
+        timestamp += sc->time_offset;
+
     index = search_frag_timestamp(&mov->frag_index, st, timestamp);
     if (index < 0)
         index = 0;
@@ -8006,6 +8375,31 @@ static int mov_seek_fragment(AVFormatContext *s, AVStream *st, int64_t timestamp
     return 0;
 }
 
+/**
+ * Read the header of the first fragment at or after timestamp that has not
+ * been read yet, for forward seeks in streams found by the fragment scan.
+ * Returns 1 if a header was read, 0 if there is none left to read.
+ */
+static int mov_seek_next_fragment(AVFormatContext *s, AVStream *st, int64_t timestamp)
+{
+    MOVContext *mov = s->priv_data;
+    MOVStreamContext *sc = st->priv_data;
+    int index, ret;
+
+    if (!mov->frag_index.complete || !sc->has_frag_scan)
+        return 0;
+
+    index = search_frag_timestamp(&mov->frag_index, st, timestamp + sc->time_offset);
+    for (index = FFMAX(index, 0); index < mov->frag_index.nb_items; index++) {
+        if (mov->frag_index.item[index].headers_read)
+            continue;
+        if ((ret = mov_switch_root(s, -1, index)) < 0)
+            return ret;
+        return 1;
+    }
+    return 0;
+}
+
 static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp, int flags)
 {
     MOVStreamContext *sc = st->priv_data;
@@ -8020,7 +8414,14 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     if (ret < 0)
         return ret;
 
+    mov_lazy_index_expand(s->priv_data, st, 0, timestamp);
     sample = av_index_search_timestamp(st, timestamp, flags);
+    /* the next keyframe can be in a fragment whose header was not read yet */
+    while (sample < 0 && !(flags & AVSEEK_FLAG_BACKWARD) &&
+           (ret = mov_seek_next_fragment(s, st, timestamp)) > 0)
+        sample = av_index_search_timestamp(st, timestamp, flags);
+    if (ret < 0)
+        return ret;
     av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
     if (sample < 0 && st->nb_index_entries && timestamp < st->index_entries[0].timestamp)
         sample = 0;
@@ -8076,20 +8477,41 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
         return sample;
 
     if (mc->seek_individually) {
-        /* adjust seek timestamp to found sample timestamp */
-        int64_t seek_timestamp = st->index_entries[sample].timestamp;
+        for (;;) {
+            /* adjust seek timestamp to found sample timestamp */
+            int64_t seek_timestamp = s->streams[stream_index]->index_entries[sample].timestamp;
+            int64_t nb_index_entries = 0;
 
-        for (i = 0; i < s->nb_streams; i++) {
-            int64_t timestamp;
-            MOVStreamContext *sc = s->streams[i]->priv_data;
-            st = s->streams[i];
-            st->skip_samples = (sample_time <= 0) ? sc->start_pad : 0;
+            for (i = 0; i < s->nb_streams; i++)
+                nb_index_entries += s->streams[i]->nb_index_entries;
 
-            if (stream_index == i)
-                continue;
+            for (i = 0; i < s->nb_streams; i++) {
+                int64_t timestamp;
+                MOVStreamContext *sc = s->streams[i]->priv_data;
+                st = s->streams[i];
+                st->skip_samples = (sample_time <= 0) ? sc->start_pad : 0;
+
+                if (stream_index == i)
+                    continue;
+
+                timestamp = av_rescale_q(seek_timestamp, s->streams[stream_index]->time_base, st->time_base);
+                mov_seek_stream(s, st, timestamp, flags);
+            }
+
+            /* Reading the headers of earlier fragments while seeking the other
+             * streams moves the index entries of the streams already positioned,
+             * so seek again until no more fragment headers are read. This ends
+             * as every fragment header is only read once. */
+            if (!mc->frag_index.complete)
+                break;
+            for (i = 0; i < s->nb_streams; i++)
+                nb_index_entries -= s->streams[i]->nb_index_entries;
+            if (!nb_index_entries)
+                break;
 
-            timestamp = av_rescale_q(seek_timestamp, s->streams[stream_index]->time_base, st->time_base);
-            mov_seek_stream(s, st, timestamp, flags);
+            sample = mov_seek_stream(s, s->streams[stream_index], sample_time, flags);
+            if (sample < 0)
+                return sample;
         }
     } else {
         for (i = 0; i < s->nb_streams; i++) {
@@ -8155,6 +8577,12 @@ static const AVOption mov_options[] = {
     { "decryption_key", "The media decryption key (hex)", OFFSET(decryption_key), AV_OPT_TYPE_BINARY, .flags = AV_OPT_FLAG_DECODING_PARAM },
     { "enable_drefs", "Enable external track support.", OFFSET(enable_drefs), AV_OPT_TYPE_BOOL,
         {.i64 = 0}, 0, 1, FLAGS },
+    { "index_cache", "Load the sample tables from this file, create it if missing or stale",
+        OFFSET(index_cache_path), AV_OPT_TYPE_STRING, {.str = NULL}, .flags = FLAGS },
+    { "lazy_index", "Build the sample index on demand while demuxing",
+        OFFSET(lazy_index), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, FLAGS },
+    { "scan_fragments", "Index the fragments of fragmented input by scanning their moof atoms",
+        OFFSET(scan_fragments), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, FLAGS },
 
     { NULL },
 };
@@ -0,0 +1,536 @@
+/*
+ * MOV demuxer sample table cache
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/avstring.h"
+#include "libavutil/crc.h"
+#include "libavutil/file.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem.h"
+#include "avformat.h"
+#include "internal.h"
+#include "mov_index_cache.h"
+
+#define CACHE_MAGIC     "FFMOVIDX"
+#define CACHE_VERSION   2
+#define CACHE_CRC_BYTES 64
+#define CACHE_MVHD_BYTES 128
+#define CACHE_PARAMS    6
+
+typedef struct CacheHeader {
+    uint8_t  magic[8];
+    uint32_t version;
+    uint32_t layout;        ///< sizes of the cached structures, detects ABI changes
+    int64_t  file_size;
+    int64_t  moov_pos;      ///< position of the moov payload
+    int64_t  moov_size;
+    uint32_t mvhd_crc;      ///< CRC of the mvhd payload, holds the modification time
+    uint32_t reserved;
+} CacheHeader;
+
+typedef struct CacheRecord {
+    uint32_t type;
+    uint32_t crc;
+    int64_t  pos;           ///< position of the atom payload
+    int64_t  size;          ///< size of the atom payload
+    int64_t  param[CACHE_PARAMS];
+    uint32_t nb_entries;
+    uint32_t entry_size;
+    uint32_t has_data;
+    uint32_t reserved;
+    /* nb_entries * entry_size bytes of table data follow, padded to 8 bytes */
+} CacheRecord;
+
+/* Record of the mapped cache to be copied to the new one */
+typedef struct CacheSpan {
+    size_t offset;
+    size_t size;
+} CacheSpan;
+
+typedef struct MOVIndexCache {
+    uint8_t *map;
+    size_t map_size;
+    size_t cursor;          ///< offset of the next record in map
+    int64_t lookup_pos;     ///< position of the last atom looked up
+    int valid;              ///< the moov and mvhd matched the mapped cache
+
+    CacheHeader hdr;        ///< header of the new cache
+    int found_mvhd;
+
+    uint32_t last_type;
+    int64_t last_pos;
+    uint32_t last_crc;
+
+    /* The new cache is only written if the file has tables the mapped cache
+     * did not provide. Records are written as their atoms are parsed, so
+     * that no copy of the tables is kept in memory; the records loaded
+     * before the first parsed one are only remembered. */
+    AVIOContext *out;
+    char *out_path;
+    int64_t out_pos;        ///< position of the last record written
+    CacheSpan *loaded;
+    int nb_loaded;
+    int nb_restored;
+    int nb_added;
+    int failed;
+} MOVIndexCache;
+
+#define CACHE_LAYOUT (sizeof(CacheRecord) | sizeof(MOVStts) << 8 | \
+                      sizeof(MOVStsc) << 16 | (AV_NE(1, 0) << 24))
+
+static int is_cached_table(uint32_t type)
+{
+    switch (type) {
+    case MKTAG('s','t','c','o'):
+    case MKTAG('c','o','6','4'):
+    case MKTAG('s','t','s','c'):
+    case MKTAG('s','t','s','z'):
+    case MKTAG('s','t','z','2'):
+    case MKTAG('s','t','t','s'):
+    case MKTAG('c','t','t','s'):
+    case MKTAG('s','t','s','s'):
+    case MKTAG('s','t','p','s'):
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Get the table filled by an atom and its number of entries.
+ */
+static void get_table(MOVStreamContext *sc, uint32_t type,
+                      void **data, unsigned **count, int *entry_size)
+{
+    switch (type) {
+    case MKTAG('s','t','c','o'):
+    case MKTAG('c','o','6','4'):
+        *data       = &sc->chunk_offsets;
+        *count      = &sc->chunk_count;
+        *entry_size = sizeof(*sc->chunk_offsets);
+        break;
+    case MKTAG('s','t','s','c'):
+        *data       = &sc->stsc_data;
+        *count      = &sc->stsc_count;
+        *entry_size = sizeof(*sc->stsc_data);
+        break;
+    case MKTAG('s','t','s','z'):
+    case MKTAG('s','t','z','2'):
+        *data       = &sc->sample_sizes;
+        *count      = &sc->sample_count;
+        *entry_size = sizeof(*sc->sample_sizes);
+        break;
+    case MKTAG('s','t','t','s'):
+        *data       = &sc->stts_data;
+        *count      = &sc->stts_count;
+        *entry_size = sizeof(*sc->stts_data);
+        break;
+    case MKTAG('c','t','t','s'):
+        *data       = &sc->ctts_data;
+        *count      = &sc->ctts_count;
+        *entry_size = sizeof(*sc->ctts_data);
+        break;
+    case MKTAG('s','t','s','s'):
+        *data       = &sc->keyframes;
+        *count      = &sc->keyframe_count;
+        *entry_size = sizeof(*sc->keyframes);
+        break;
+    case MKTAG('s','t','p','s'):
+        *data       = &sc->stps_data;
+        *count      = &sc->stps_count;
+        *entry_size = sizeof(*sc->stps_data);
+        break;
+    }
+}
+
+/**
+ * Copy the scalar state set while parsing an atom to or from the record.
+ */
+static void sync_params(AVStream *st, CacheRecord *rec, int restore)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int64_t *p = rec->param;
+
+#define SYNC(i, field) do { if (restore) field = p[i]; else p[i] = field; } while (0)
+    switch (rec->type) {
+    case MKTAG('s','t','s','z'):
+    case MKTAG('s','t','z','2'):
+        SYNC(0, sc->sample_size);
+        SYNC(1, sc->stsz_sample_size);
+        SYNC(2, sc->sample_count);
+        SYNC(3, sc->data_size);
+        break;
+    case MKTAG('s','t','t','s'):
+        SYNC(0, sc->duration_for_fps);
+        SYNC(1, sc->nb_frames_for_fps);
+        SYNC(2, st->nb_frames);
+        SYNC(3, st->duration);
+        SYNC(4, sc->track_end);
+        break;
+    case MKTAG('c','t','t','s'):
+        SYNC(0, sc->dts_shift);
+        break;
+    case MKTAG('s','t','s','s'):
+        SYNC(0, sc->keyframe_absent);
+        SYNC(1, st->need_parsing);
+        break;
+    }
+#undef SYNC
+}
+
+static const CacheRecord *next_record(MOVIndexCache *ic, const uint8_t **data)
+{
+    const CacheRecord *rec;
+    uint64_t data_size;
+
+    if (ic->map_size - ic->cursor < sizeof(*rec))
+        return NULL;
+    rec = (const CacheRecord *)(ic->map + ic->cursor);
+    data_size = FFALIGN((uint64_t)rec->nb_entries * rec->entry_size, 8);
+    if (data_size > ic->map_size - ic->cursor - sizeof(*rec))
+        return NULL;
+    *data = (const uint8_t *)(rec + 1);
+    return rec;
+}
+
+static const CacheRecord *find_record(MOVIndexCache *ic, int64_t pos,
+                                      const uint8_t **data)
+{
+    const CacheRecord *rec;
+
+    if (!ic->map)
+        return NULL;
+    /* Records are stored in file order, restart if the header is reparsed. */
+    if (pos < ic->lookup_pos)
+        ic->cursor = sizeof(CacheHeader);
+    ic->lookup_pos = pos;
+
+    while ((rec = next_record(ic, data)) && rec->pos <= pos) {
+        if (rec->pos == pos)
+            return rec;
+        ic->cursor += sizeof(*rec) + FFALIGN((size_t)rec->nb_entries * rec->entry_size, 8);
+    }
+    return NULL;
+}
+
+static void unmap_cache(MOVIndexCache *ic)
+{
+    if (ic->map)
+        av_file_unmap(ic->map, ic->map_size);
+    ic->map      = NULL;
+    ic->map_size = 0;
+    ic->valid    = 0;
+    ic->nb_loaded = 0;
+}
+
+static void write_span(MOVIndexCache *ic, const CacheSpan *span)
+{
+    avio_write(ic->out, ic->map + span->offset, span->size);
+}
+
+/**
+ * Open the new cache on the first table that has to be parsed, and write the
+ * records loaded from the mapped cache so far.
+ */
+static int open_output(MOVContext *c)
+{
+    MOVIndexCache *ic = c->index_cache;
+    AVFormatContext *s = c->fc;
+    int i, ret;
+
+    if (ic->out)
+        return 0;
+    if (!(ic->out_path = av_asprintf("%s.tmp", c->index_cache_path)))
+        return AVERROR(ENOMEM);
+    ret = s->io_open(s, &ic->out, ic->out_path, AVIO_FLAG_WRITE, NULL);
+    if (ret < 0) {
+        av_log(s, AV_LOG_WARNING, "Could not open index cache %s for writing\n",
+               ic->out_path);
+        av_freep(&ic->out_path);
+        return ret;
+    }
+    /* the header is written again once complete */
+    avio_write(ic->out, (const uint8_t *)&ic->hdr, sizeof(ic->hdr));
+    for (i = 0; i < ic->nb_loaded; i++)
+        write_span(ic, &ic->loaded[i]);
+    av_freep(&ic->loaded);
+    ic->nb_loaded = 0;
+    return 0;
+}
+
+static void close_output(MOVContext *c, int keep)
+{
+    MOVIndexCache *ic = c->index_cache;
+
+    if (!ic->out)
+        return;
+    ff_format_io_close(c->fc, &ic->out);
+    if (!keep)
+        avpriv_io_delete(ic->out_path);
+    av_freep(&ic->out_path);
+}
+
+/* Records must follow each other in file order, which a second pass over
+ * the header breaks; the new cache is dropped in that case. */
+static int check_order(MOVIndexCache *ic, int64_t pos)
+{
+    if (pos <= ic->out_pos) {
+        ic->failed = 1;
+        return 0;
+    }
+    ic->out_pos = pos;
+    return 1;
+}
+
+/* Check the moov and mvhd atoms against the mapped cache and record them
+ * for the new one. */
+static void check_movie(MOVIndexCache *ic, AVIOContext *pb, MOVAtom atom, int64_t pos)
+{
+    const CacheHeader *hdr = (const CacheHeader *)ic->map;
+    uint8_t buf[CACHE_MVHD_BYTES];
+    int len;
+
+    if (atom.type == MKTAG('m','o','o','v')) {
+        ic->hdr.moov_pos  = pos;
+        ic->hdr.moov_size = atom.size;
+        ic->found_mvhd    = 0;
+        if (ic->map && (hdr->moov_pos != pos || hdr->moov_size != atom.size))
+            unmap_cache(ic);
+        return;
+    }
+
+    len = avio_read(pb, buf, FFMIN(atom.size, sizeof(buf)));
+    if (len < 0 || avio_seek(pb, pos, SEEK_SET) < 0) {
+        ic->failed = 1;
+        return;
+    }
+    ic->hdr.mvhd_crc = av_crc(av_crc_get_table(AV_CRC_32_IEEE_LE), 0, buf, len);
+    ic->found_mvhd   = 1;
+    if (ic->map) {
+        if (hdr->mvhd_crc == ic->hdr.mvhd_crc)
+            ic->valid = 1;
+        else
+            unmap_cache(ic);
+    }
+}
+
+int ff_mov_index_cache_init(MOVContext *c, int64_t file_size)
+{
+    MOVIndexCache *ic;
+    const CacheHeader *hdr;
+    int ret;
+
+    ic = av_mallocz(sizeof(*ic));
+    if (!ic)
+        return AVERROR(ENOMEM);
+    memcpy(ic->hdr.magic, CACHE_MAGIC, sizeof(ic->hdr.magic));
+    ic->hdr.version   = CACHE_VERSION;
+    ic->hdr.layout    = CACHE_LAYOUT;
+    ic->hdr.file_size = file_size;
+    ic->out_pos       = -1;
+    c->index_cache = ic;
+
+    /* the cache is keyed by the file size */
+    if (file_size < 0) {
+        ic->failed = 1;
+        return 0;
+    }
+    if (avio_check(c->index_cache_path, AVIO_FLAG_READ) < 0)
+        return 0;
+
+    ret = av_file_map(c->index_cache_path, &ic->map, &ic->map_size, 0, c->fc);
+    if (ret < 0)
+        return 0;
+
+    hdr = (const CacheHeader *)ic->map;
+    if (ic->map_size < sizeof(*hdr) ||
+        memcmp(hdr->magic, CACHE_MAGIC, sizeof(hdr->magic)) ||
+        hdr->version != CACHE_VERSION || hdr->layout != CACHE_LAYOUT ||
+        hdr->file_size != file_size) {
+        av_log(c->fc, AV_LOG_VERBOSE, "Ignoring stale index cache %s\n",
+               c->index_cache_path);
+        unmap_cache(ic);
+        return 0;
+    }
+    /* only used once the moov and mvhd atoms have been checked */
+    ic->cursor = sizeof(*hdr);
+
+    return 0;
+}
+
+int ff_mov_index_cache_load(MOVContext *c, AVIOContext *pb, MOVAtom atom)
+{
+    MOVIndexCache *ic = c->index_cache;
+    const CacheRecord *rec;
+    const uint8_t *data;
+    uint8_t buf[CACHE_CRC_BYTES];
+    int64_t pos = avio_tell(pb);
+    AVStream *st;
+    MOVStreamContext *sc;
+    CacheRecord tmp;
+    CacheSpan span;
+    void *table;
+    unsigned *count;
+    int entry_size, len;
+
+    ic->last_type = 0;
+    if (atom.type == MKTAG('m','o','o','v') || atom.type == MKTAG('m','v','h','d')) {
+        check_movie(ic, pb, atom, pos);
+        return 0;
+    }
+    if (!is_cached_table(atom.type) || c->trak_index < 0 || c->fc->nb_streams < 1)
+        return 0;
+
+    len = avio_read(pb, buf, FFMIN(atom.size, sizeof(buf)));
+    if (len < 0 || avio_seek(pb, pos, SEEK_SET) < 0)
+        return 0;
+    ic->last_type = atom.type;
+    ic->last_pos  = pos;
+    ic->last_crc  = av_crc(av_crc_get_table(AV_CRC_32_IEEE_LE), 0, buf, len);
+
+    if (!ic->valid)
+        return 0;
+    rec = find_record(ic, pos, &data);
+    if (!rec || rec->type != atom.type || rec->size != atom.size ||
+        rec->crc != ic->last_crc)
+        return 0;
+
+    st = c->fc->streams[c->fc->nb_streams - 1];
+    sc = st->priv_data;
+    get_table(sc, atom.type, &table, &count, &entry_size);
+    if (rec->entry_size != entry_size)
+        return 0;
+
+    av_freep(table);
+    *count = 0;
+    if (rec->has_data) {
+        size_t size = (size_t)rec->nb_entries * entry_size;
+        uint8_t *copy = av_malloc(FFMAX(size, 1));
+        if (!copy)
+            return AVERROR(ENOMEM);
+        memcpy(copy, data, size);
+        *(uint8_t **)table = copy;
+        *count = rec->nb_entries;
+        if (atom.type == MKTAG('c','t','t','s'))
+            sc->ctts_allocated_size = FFMAX(size, 1);
+    }
+    tmp = *rec;
+    sync_params(st, &tmp, 1);
+    ic->last_type = 0;
+    ic->nb_restored++;
+
+    span.offset = (const uint8_t *)rec - ic->map;
+    span.size   = sizeof(*rec) + FFALIGN((size_t)rec->nb_entries * entry_size, 8);
+    if (!ic->failed && check_order(ic, pos)) {
+        if (ic->out) {
+            write_span(ic, &span);
+        } else if (av_reallocp_array(&ic->loaded, ic->nb_loaded + 1,
+                                     sizeof(*ic->loaded)) < 0) {
+            ic->nb_loaded = 0;
+            ic->failed = 1;
+        } else {
+            ic->loaded[ic->nb_loaded++] = span;
+        }
+    }
+
+    avio_seek(pb, pos + atom.size, SEEK_SET);
+    return 1;
+}
+
+int ff_mov_index_cache_add(MOVContext *c, AVIOContext *pb, MOVAtom atom)
+{
+    MOVIndexCache *ic = c->index_cache;
+    AVStream *st;
+    MOVStreamContext *sc;
+    CacheRecord rec = { 0 };
+    static const uint8_t padding[8] = { 0 };
+    void *table;
+    unsigned *count;
+    int entry_size;
+    size_t data_size;
+
+    if (ic->last_type != atom.type || ic->failed || pb->eof_reached)
+        return 0;
+    ic->last_type = 0;
+    if (!check_order(ic, ic->last_pos) || open_output(c) < 0) {
+        ic->failed = 1;
+        return 0;
+    }
+
+    st = c->fc->streams[c->fc->nb_streams - 1];
+    sc = st->priv_data;
+    get_table(sc, atom.type, &table, &count, &entry_size);
+
+    data_size = *(void **)table ? (size_t)*count * entry_size : 0;
+    rec.type       = atom.type;
+    rec.crc        = ic->last_crc;
+    rec.pos        = ic->last_pos;
+    rec.size       = atom.size;
+    rec.nb_entries = data_size ? *count : 0;
+    rec.entry_size = entry_size;
+    rec.has_data   = !!*(void **)table;
+    sync_params(st, &rec, 0);
+
+    avio_write(ic->out, (const uint8_t *)&rec, sizeof(rec));
+    if (data_size) {
+        avio_write(ic->out, *(uint8_t **)table, data_size);
+        avio_write(ic->out, padding, FFALIGN(data_size, 8) - data_size);
+    }
+    ic->nb_added++;
+    return 0;
+}
+
+int ff_mov_index_cache_write(MOVContext *c)
+{
+    MOVIndexCache *ic = c->index_cache;
+    AVFormatContext *s = c->fc;
+    int ret;
+
+    av_log(s, AV_LOG_VERBOSE, "Index cache: %d sample tables loaded, %d parsed\n",
+           ic->nb_restored, ic->nb_added);
+    if (!ic->out)
+        return 0;
+    if (ic->failed || !ic->found_mvhd) {
+        close_output(c, 0);
+        return 0;
+    }
+
+    avio_seek(ic->out, 0, SEEK_SET);
+    avio_write(ic->out, (const uint8_t *)&ic->hdr, sizeof(ic->hdr));
+    avio_flush(ic->out);
+    ret = ic->out->error;
+    ff_format_io_close(s, &ic->out);
+    if (ret >= 0)
+        ret = ff_rename(ic->out_path, c->index_cache_path, s);
+    if (ret < 0)
+        avpriv_io_delete(ic->out_path);
+    av_freep(&ic->out_path);
+    return ret;
+}
+
+void ff_mov_index_cache_free(MOVContext *c)
+{
+    MOVIndexCache *ic = c->index_cache;
+
+    if (!ic)
+        return;
+    close_output(c, 0);
+    av_freep(&ic->loaded);
+    unmap_cache(ic);
+    av_freep(&c->index_cache);
+}
@@ -0,0 +1,72 @@
+/*
+ * MOV demuxer sample table cache
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Sidecar file caching the parsed sample tables (stts, stsc, stsz, stco,
+ * ctts, stss, stps) of a MOV/MP4 file, so that later opens can skip reading
+ * and parsing them.
+ *
+ * The cache is keyed by the size of the media file, the position and size of
+ * its moov atom and a CRC of its mvhd atom, which holds the modification
+ * time. Each cached table is further checked against the position, size,
+ * type and a CRC of the first bytes of its atom before it is used. The cache
+ * is native endian and memory mapped when loaded; a new one is written while
+ * parsing, so that the tables are not copied.
+ */
+
+#ifndef AVFORMAT_MOV_INDEX_CACHE_H
+#define AVFORMAT_MOV_INDEX_CACHE_H
+
+#include "avio.h"
+#include "isom.h"
+
+/**
+ * Map the cache file set with the index_cache option, if it exists and
+ * matches file_size. Its tables are used once the moov and mvhd atoms are
+ * found to match as well. Failing to load the cache is not an error.
+ */
+int ff_mov_index_cache_init(MOVContext *c, int64_t file_size);
+
+/**
+ * Restore the state resulting from parsing the sample table atom at the
+ * current position of pb from the cache. Must be called for every atom that
+ * is parsed, the moov and mvhd atoms are checked against the cache.
+ *
+ * @return 1 if the atom was restored and skipped, 0 if it has to be parsed,
+ *         a negative AVERROR code on failure
+ */
+int ff_mov_index_cache_load(MOVContext *c, AVIOContext *pb, MOVAtom atom);
+
+/**
+ * Record the state resulting from parsing a sample table atom the cache
+ * did not provide. Must follow ff_mov_index_cache_load() for the same atom.
+ */
+int ff_mov_index_cache_add(MOVContext *c, AVIOContext *pb, MOVAtom atom);
+
+/**
+ * Complete the new cache file if tables were parsed that the mapped one did
+ * not contain, and replace the mapped one with it.
+ */
+int ff_mov_index_cache_write(MOVContext *c);
+
+void ff_mov_index_cache_free(MOVContext *c);
+
+#endif /* AVFORMAT_MOV_INDEX_CACHE_H */
@@ -0,0 +1,607 @@
+/*
+ * io_uring based file I/O
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Regular file access through an io_uring submission queue.
+ *
+ * Reading keeps up to queue_depth blocks of read-ahead in flight, writing
+ * copies the data into one of queue_depth blocks and returns as soon as the
+ * request has been submitted. Write errors are reported by the next write,
+ * seek or close call.
+ *
+ * When the kernel does not provide io_uring or does not allow its use, the
+ * file is accessed with plain read(), write() and lseek() calls instead.
+ */
+
+#define _DEFAULT_SOURCE /* Needed for syscall() and MAP_POPULATE */
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/internal.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "avformat.h"
+#include "os_support.h"
+#include "url.h"
+
+typedef struct UringBlock {
+    uint8_t *buf;
+    struct iovec iov;
+    int64_t offset;         ///< file offset of buf[0]
+    int size;               ///< number of bytes requested
+    int pos;                ///< bytes consumed (read) or completed (write)
+    int res;                ///< result of the read request
+    int busy;               ///< request in flight
+} UringBlock;
+
+typedef struct UringContext {
+    const AVClass *class;
+    int trunc;
+    int queue_depth;
+    int block_size;
+
+    int fd;
+    int ring_fd;
+    int sync;               ///< io_uring unavailable, use synchronous calls
+
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned to_submit;
+    unsigned nb_inflight;
+
+    UringBlock *blocks;
+    int head;               ///< oldest read-ahead block, next write block
+    int nb_readahead;       ///< number of blocks queued for reading
+    int writing;
+    int64_t pos;            ///< logical position
+    int64_t read_pos;       ///< file offset of the next read-ahead request
+    int error;              ///< sticky write error
+} UringContext;
+
+#define OFFSET(x) offsetof(UringContext, x)
+static const AVOption uring_options[] = {
+    { "truncate", "truncate existing files on write", OFFSET(trunc), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, AV_OPT_FLAG_ENCODING_PARAM },
+    { "queue_depth", "set the number of requests kept in flight", OFFSET(queue_depth), AV_OPT_TYPE_INT, { .i64 = 4 }, 1, 64, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "block_size", "set the size of a single request", OFFSET(block_size), AV_OPT_TYPE_INT, { .i64 = 262144 }, 4096, INT_MAX / 2, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { NULL }
+};
+
+static const AVClass uring_class = {
+    .class_name = "uring",
+    .item_name  = av_default_item_name,
+    .option     = uring_options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
+static int uring_setup(UringContext *c)
+{
+    struct io_uring_params p = { 0 };
+    void *ptr;
+
+    c->ring_fd = syscall(__NR_io_uring_setup, c->queue_depth, &p);
+    if (c->ring_fd < 0)
+        return AVERROR(errno);
+
+    c->sq_size   = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    c->cq_size   = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+    c->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ptr = mmap(NULL, c->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+               c->ring_fd, IORING_OFF_SQ_RING);
+    if (ptr == MAP_FAILED)
+        return AVERROR(errno);
+    c->sq_ptr   = ptr;
+    c->sq_tail  = (unsigned *)((uint8_t *)ptr + p.sq_off.tail);
+    c->sq_mask  = (unsigned *)((uint8_t *)ptr + p.sq_off.ring_mask);
+    c->sq_array = (unsigned *)((uint8_t *)ptr + p.sq_off.array);
+
+    ptr = mmap(NULL, c->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+               c->ring_fd, IORING_OFF_CQ_RING);
+    if (ptr == MAP_FAILED)
+        return AVERROR(errno);
+    c->cq_ptr  = ptr;
+    c->cq_head = (unsigned *)((uint8_t *)ptr + p.cq_off.head);
+    c->cq_tail = (unsigned *)((uint8_t *)ptr + p.cq_off.tail);
+    c->cq_mask = (unsigned *)((uint8_t *)ptr + p.cq_off.ring_mask);
+    c->cqes    = (struct io_uring_cqe *)((uint8_t *)ptr + p.cq_off.cqes);
+
+    ptr = mmap(NULL, c->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+               c->ring_fd, IORING_OFF_SQES);
+    if (ptr == MAP_FAILED)
+        return AVERROR(errno);
+    c->sqes = ptr;
+
+    return 0;
+}
+
+static void uring_free_ring(UringContext *c)
+{
+    if (c->sqes)
+        munmap(c->sqes, c->sqes_size);
+    if (c->cq_ptr)
+        munmap(c->cq_ptr, c->cq_size);
+    if (c->sq_ptr)
+        munmap(c->sq_ptr, c->sq_size);
+    if (c->ring_fd >= 0)
+        close(c->ring_fd);
+    c->sqes   = NULL;
+    c->cq_ptr = c->sq_ptr = NULL;
+    c->ring_fd = -1;
+}
+
+static void uring_queue(UringContext *c, int idx, int opcode)
+{
+    UringBlock *b = &c->blocks[idx];
+    unsigned tail = *c->sq_tail;
+    unsigned i    = tail & *c->sq_mask;
+    struct io_uring_sqe *sqe = &c->sqes[i];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode    = opcode;
+    sqe->fd        = c->fd;
+    sqe->off       = b->offset + b->pos;
+    sqe->addr      = (uintptr_t)&b->iov;
+    sqe->len       = 1;
+    sqe->user_data = idx;
+    c->sq_array[i] = i;
+    atomic_store_explicit((_Atomic unsigned *)c->sq_tail, tail + 1,
+                          memory_order_release);
+
+    b->busy = 1;
+    c->to_submit++;
+    c->nb_inflight++;
+}
+
+static void uring_complete(UringContext *c, int idx, int res)
+{
+    UringBlock *b = &c->blocks[idx];
+
+    b->busy = 0;
+    c->nb_inflight--;
+
+    if (!c->writing) {
+        b->res = res;
+        return;
+    }
+
+    if (res <= 0) {
+        if (!c->error)
+            c->error = res < 0 ? res : AVERROR(EIO);
+        return;
+    }
+    b->pos += res;
+    if (b->pos < b->size) {
+        b->iov.iov_base = b->buf  + b->pos;
+        b->iov.iov_len  = b->size - b->pos;
+        uring_queue(c, idx, IORING_OP_WRITEV);
+    }
+}
+
+/**
+ * Submit all queued requests and process the available completions,
+ * waiting for at least one of them if wait is set.
+ */
+static int uring_run(UringContext *c, int wait)
+{
+    unsigned head;
+
+    while (c->to_submit || wait) {
+        int ret = syscall(__NR_io_uring_enter, c->ring_fd, c->to_submit,
+                          wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return AVERROR(errno);
+        }
+        c->to_submit -= ret;
+        if (!c->to_submit)
+            break;
+    }
+
+    head = *c->cq_head;
+    while (head != atomic_load_explicit((_Atomic unsigned *)c->cq_tail,
+                                        memory_order_acquire)) {
+        struct io_uring_cqe *cqe = &c->cqes[head & *c->cq_mask];
+        uring_complete(c, cqe->user_data, cqe->res);
+        head++;
+    }
+    atomic_store_explicit((_Atomic unsigned *)c->cq_head, head,
+                          memory_order_release);
+
+    return 0;
+}
+
+static int uring_wait_block(UringContext *c, UringBlock *b)
+{
+    while (b->busy) {
+        int ret = uring_run(c, 1);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+/**
+ * Wait for all requests in flight, dropping any read-ahead.
+ */
+static int uring_drain(UringContext *c)
+{
+    while (c->nb_inflight) {
+        int ret = uring_run(c, 1);
+        if (ret < 0)
+            return ret;
+    }
+    c->nb_readahead = 0;
+    c->read_pos     = c->pos;
+    return 0;
+}
+
+static void uring_fill_readahead(UringContext *c)
+{
+    while (c->nb_readahead < c->queue_depth) {
+        int idx = (c->head + c->nb_readahead) % c->queue_depth;
+        UringBlock *b = &c->blocks[idx];
+
+        b->offset       = c->read_pos;
+        b->size         = c->block_size;
+        b->pos          = 0;
+        b->res          = 0;
+        b->iov.iov_base = b->buf;
+        b->iov.iov_len  = b->size;
+        uring_queue(c, idx, IORING_OP_READV);
+
+        c->read_pos += b->size;
+        c->nb_readahead++;
+    }
+}
+
+static int uring_set_mode(UringContext *c, int writing)
+{
+    int ret;
+
+    if (c->writing == writing)
+        return 0;
+    if ((ret = uring_drain(c)) < 0)
+        return ret;
+    c->writing = writing;
+    c->head    = 0;
+    return 0;
+}
+
+static int uring_read(URLContext *h, unsigned char *buf, int size)
+{
+    UringContext *c = h->priv_data;
+    UringBlock *b;
+    int ret, len;
+
+    if (c->sync) {
+        ret = read(c->fd, buf, size);
+        if (ret == 0)
+            return AVERROR_EOF;
+        return ret < 0 ? AVERROR(errno) : ret;
+    }
+
+    if ((ret = uring_set_mode(c, 0)) < 0)
+        return ret;
+
+retry:
+    uring_fill_readahead(c);
+    b = &c->blocks[c->head];
+    if ((ret = uring_wait_block(c, b)) < 0)
+        return ret;
+
+    if (b->res < 0) {
+        ret = b->res;
+        uring_drain(c);
+        return ret;
+    }
+
+    len = FFMIN(size, b->res - b->pos);
+    if (len <= 0) {
+        /* A short read leaves the following blocks at the wrong offsets,
+         * restart the read-ahead from the current position. */
+        if ((ret = uring_drain(c)) < 0)
+            return ret;
+        if (!b->res)
+            return AVERROR_EOF;
+        goto retry;
+    }
+
+    memcpy(buf, b->buf + b->pos, len);
+    b->pos += len;
+    c->pos += len;
+
+    if (b->pos == b->size) {
+        c->head = (c->head + 1) % c->queue_depth;
+        c->nb_readahead--;
+        uring_fill_readahead(c);
+    }
+    if ((ret = uring_run(c, 0)) < 0)
+        return ret;
+
+    return len;
+}
+
+static int uring_write(URLContext *h, const unsigned char *buf, int size)
+{
+    UringContext *c = h->priv_data;
+    UringBlock *b;
+    int ret;
+
+    if (c->sync) {
+        ret = write(c->fd, buf, size);
+        return ret < 0 ? AVERROR(errno) : ret;
+    }
+
+    if ((ret = uring_set_mode(c, 1)) < 0)
+        return ret;
+
+    b = &c->blocks[c->head];
+    if ((ret = uring_wait_block(c, b)) < 0)
+        return ret;
+    if (c->error)
+        return c->error;
+
+    size = FFMIN(size, c->block_size);
+    memcpy(b->buf, buf, size);
+    b->offset       = c->pos;
+    b->size         = size;
+    b->pos          = 0;
+    b->iov.iov_base = b->buf;
+    b->iov.iov_len  = size;
+    uring_queue(c, c->head, IORING_OP_WRITEV);
+    if ((ret = uring_run(c, 0)) < 0)
+        return ret;
+
+    c->head = (c->head + 1) % c->queue_depth;
+    c->pos += size;
+
+    return size;
+}
+
+static int64_t uring_seek(URLContext *h, int64_t pos, int whence)
+{
+    UringContext *c = h->priv_data;
+    struct stat st;
+    int64_t ret;
+
+    if (c->sync) {
+        if (whence == AVSEEK_SIZE) {
+            ret = fstat(c->fd, &st);
+            return ret < 0 ? AVERROR(errno) : st.st_size;
+        }
+        ret = lseek(c->fd, pos, whence);
+        return ret < 0 ? AVERROR(errno) : ret;
+    }
+
+    /* Requests in flight may overlap the region written after the seek and
+     * are not ordered against each other, so writes are always drained. */
+    if (c->writing) {
+        if ((ret = uring_drain(c)) < 0)
+            return ret;
+        if (c->error)
+            return c->error;
+    }
+
+    if (whence == AVSEEK_SIZE || whence == SEEK_END) {
+        if (fstat(c->fd, &st) < 0)
+            return AVERROR(errno);
+        if (whence == AVSEEK_SIZE)
+            return st.st_size;
+        pos += st.st_size;
+    } else if (whence == SEEK_CUR) {
+        pos += c->pos;
+    } else if (whence != SEEK_SET) {
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+
+    if (!c->writing && c->nb_readahead &&
+        pos >= c->blocks[c->head].offset && pos < c->read_pos) {
+        /* Keep the read-ahead covering the new position. */
+        UringBlock *b = &c->blocks[c->head];
+        while (pos >= b->offset + b->size) {
+            if ((ret = uring_wait_block(c, b)) < 0)
+                return ret;
+            c->head = (c->head + 1) % c->queue_depth;
+            c->nb_readahead--;
+            b = &c->blocks[c->head];
+        }
+        b->pos = pos - b->offset;
+        c->pos = pos;
+        return pos;
+    }
+
+    if ((ret = uring_drain(c)) < 0)
+        return ret;
+    c->pos = c->read_pos = pos;
+    return pos;
+}
+
+static int uring_close(URLContext *h)
+{
+    UringContext *c = h->priv_data;
+    int ret = 0, i;
+
+    if (c->ring_fd >= 0) {
+        ret = uring_drain(c);
+        if (c->writing && c->error)
+            ret = c->error;
+    }
+    uring_free_ring(c);
+    if (c->blocks) {
+        for (i = 0; i < c->queue_depth; i++)
+            av_freep(&c->blocks[i].buf);
+        av_freep(&c->blocks);
+    }
+    if (c->fd >= 0 && close(c->fd) < 0 && !ret)
+        ret = AVERROR(errno);
+
+    return ret;
+}
+
+static int uring_open(URLContext *h, const char *filename, int flags)
+{
+    UringContext *c = h->priv_data;
+    struct stat st;
+    int access, ret, i;
+
+    av_strstart(filename, "uring:", &filename);
+
+    c->fd = c->ring_fd = -1;
+
+    if (flags & AVIO_FLAG_WRITE && flags & AVIO_FLAG_READ) {
+        access = O_CREAT | O_RDWR;
+        if (c->trunc)
+            access |= O_TRUNC;
+    } else if (flags & AVIO_FLAG_WRITE) {
+        access = O_CREAT | O_WRONLY;
+        if (c->trunc)
+            access |= O_TRUNC;
+    } else {
+        access = O_RDONLY;
+    }
+    c->fd = avpriv_open(filename, access, 0666);
+    if (c->fd < 0)
+        return AVERROR(errno);
+
+    if (fstat(c->fd, &st) < 0) {
+        ret = AVERROR(errno);
+        goto fail;
+    }
+    if (!S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode)) {
+        av_log(h, AV_LOG_ERROR, "%s is not a regular file or block device\n",
+               filename);
+        ret = AVERROR(EINVAL);
+        goto fail;
+    }
+
+    if ((ret = uring_setup(c)) < 0) {
+        av_log(h, AV_LOG_WARNING, "Could not set up io_uring: %s, "
+               "falling back to synchronous I/O\n", av_err2str(ret));
+        uring_free_ring(c);
+        c->sync = 1;
+        return 0;
+    }
+
+    c->blocks = av_mallocz_array(c->queue_depth, sizeof(*c->blocks));
+    if (!c->blocks) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (i = 0; i < c->queue_depth; i++) {
+        c->blocks[i].buf = av_malloc(c->block_size);
+        if (!c->blocks[i].buf) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
+
+    if (flags & AVIO_FLAG_WRITE)
+        h->min_packet_size = h->max_packet_size = c->block_size;
+
+    return 0;
+fail:
+    uring_close(h);
+    return ret;
+}
+
+static int uring_get_handle(URLContext *h)
+{
+    UringContext *c = h->priv_data;
+    return c->fd;
+}
+
+static int uring_check(URLContext *h, int mask)
+{
+    const char *filename = h->filename;
+    int ret = 0;
+
+    av_strstart(filename, "uring:", &filename);
+
+    if (access(filename, F_OK) < 0)
+        return AVERROR(errno);
+    if (mask & AVIO_FLAG_READ && access(filename, R_OK) >= 0)
+        ret |= AVIO_FLAG_READ;
+    if (mask & AVIO_FLAG_WRITE && access(filename, W_OK) >= 0)
+        ret |= AVIO_FLAG_WRITE;
+
+    return ret;
+}
+
+static int uring_delete(URLContext *h)
+{
+    const char *filename = h->filename;
+    int ret;
+
+    av_strstart(filename, "uring:", &filename);
+
+    ret = rmdir(filename);
+    if (ret < 0 && errno == ENOTDIR)
+        ret = unlink(filename);
+    if (ret < 0)
+        return AVERROR(errno);
+
+    return ret;
+}
+
+static int uring_move(URLContext *h_src, URLContext *h_dst)
+{
+    const char *filename_src = h_src->filename;
+    const char *filename_dst = h_dst->filename;
+    av_strstart(filename_src, "uring:", &filename_src);
+    av_strstart(filename_dst, "uring:", &filename_dst);
+
+    if (rename(filename_src, filename_dst) < 0)
+        return AVERROR(errno);
+
+    return 0;
+}
+
+const URLProtocol ff_uring_protocol = {
+    .name                = "uring",
+    .url_open            = uring_open,
+    .url_read            = uring_read,
+    .url_write           = uring_write,
+    .url_seek            = uring_seek,
+    .url_close           = uring_close,
+    .url_get_file_handle = uring_get_handle,
+    .url_check           = uring_check,
+    .url_delete          = uring_delete,
+    .url_move            = uring_move,
+    .priv_data_size      = sizeof(UringContext),
+    .priv_data_class     = &uring_class,
+    .default_whitelist   = "uring,crypto,data"
+};
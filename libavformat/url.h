@@ -49,6 +49,9 @@ typedef struct URLContext {
     const char *protocol_whitelist;
     const char *protocol_blacklist;
     int min_packet_size;        /**< if non zero, the stream is packetized with this min packet size */
+    int prefetch_size;          /**< size of the read-ahead buffer, 0 if disabled */
+    int prefetch_low_watermark; /**< resume reading ahead below this many buffered bytes */
+    struct URLPrefetch *prefetch;
 } URLContext;
 
 typedef struct URLProtocol {
@@ -257,6 +260,17 @@ int ffurl_get_multi_file_handle(URLContext *h, int **handles, int *numhandles);
  */
 int ffurl_get_short_seek(URLContext *h);
 
+/**
+ * Start reading ahead from h in a background thread if the prefetch_size
+ * option is set and h is opened for reading only. Afterwards ffurl_read()
+ * and ffurl_seek() are served from the read-ahead buffer and the protocol
+ * must not be accessed directly anymore.
+ *
+ * @return 0 on success (including when prefetching is not enabled), a
+ * negative AVERROR code on failure
+ */
+int ffurl_start_prefetch(URLContext *h);
+
 /**
  * Signal the URLContext that we are done reading or writing the stream.
  *
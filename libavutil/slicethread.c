@@ -18,12 +18,31 @@
 
 #include <stdatomic.h>
 #include "slicethread.h"
+#include "threadpool.h"
 #include "mem.h"
 #include "thread.h"
 #include "avassert.h"
 
 #if HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS2THREADS
 
+typedef struct SharedPool {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    pthread_t       *threads;
+    int             nb_threads;
+    int             finished;
+
+    /* contexts waiting for helpers, protected by mutex */
+    AVSliceThread   *queue;
+
+    /* one reference for the pool itself and one per context using it,
+     * protected by shared_pool_lock */
+    int             refcount;
+} SharedPool;
+
+static AVMutex shared_pool_lock = AV_MUTEX_INITIALIZER;
+static SharedPool *shared_pool;
+
 typedef struct WorkerContext {
     AVSliceThread   *ctx;
     pthread_mutex_t mutex;
@@ -48,6 +67,13 @@ struct AVSliceThread {
     void            *priv;
     void            (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads);
     void            (*main_func)(void *priv);
+
+    /* shared pool mode, the fields below are protected by pool->mutex */
+    SharedPool      *pool;
+    AVSliceThread   *next;          ///< next context in the pool queue
+    int             queued;
+    int             nb_helpers;     ///< pool threads that joined the current execute
+    int             nb_running;     ///< pool threads still running jobs
 };
 
 static int run_jobs(AVSliceThread *ctx)
@@ -91,6 +117,192 @@ static void *attribute_align_arg thread_worker(void *v)
     }
 }
 
+static void run_shared_jobs(AVSliceThread *ctx, int threadnr)
+{
+    unsigned nb_jobs = ctx->nb_jobs;
+    unsigned jobnr;
+
+    while ((jobnr = atomic_fetch_add_explicit(&ctx->current_job, 1, memory_order_acq_rel)) < nb_jobs)
+        ctx->worker_func(ctx->priv, jobnr, threadnr, nb_jobs, ctx->nb_active_threads);
+}
+
+static void shared_pool_dequeue(SharedPool *pool, AVSliceThread *ctx)
+{
+    AVSliceThread **p = &pool->queue;
+
+    while (*p != ctx)
+        p = &(*p)->next;
+    *p = ctx->next;
+    ctx->next   = NULL;
+    ctx->queued = 0;
+}
+
+static void *attribute_align_arg shared_pool_worker(void *v)
+{
+    SharedPool *pool = v;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (1) {
+        AVSliceThread *ctx;
+        int threadnr;
+
+        while (!pool->queue && !pool->finished)
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        if (pool->finished)
+            break;
+
+        /* threadnr 0 is taken by the thread calling execute */
+        ctx      = pool->queue;
+        threadnr = ++ctx->nb_helpers;
+        if (ctx->nb_helpers == ctx->nb_active_threads - 1)
+            shared_pool_dequeue(pool, ctx);
+        ctx->nb_running++;
+        pthread_mutex_unlock(&pool->mutex);
+
+        run_shared_jobs(ctx, threadnr);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (!--ctx->nb_running)
+            pthread_cond_signal(&ctx->done_cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+static void shared_pool_free(SharedPool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->finished = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (i = 0; i < pool->nb_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->mutex);
+    av_freep(&pool->threads);
+    av_free(pool);
+}
+
+static void shared_pool_unref(SharedPool *pool)
+{
+    int last;
+
+    ff_mutex_lock(&shared_pool_lock);
+    last = !--pool->refcount;
+    ff_mutex_unlock(&shared_pool_lock);
+
+    if (last)
+        shared_pool_free(pool);
+}
+
+int av_thread_pool_init(int nb_threads)
+{
+    SharedPool *pool;
+    int i, ret = 0;
+
+    if (nb_threads < 0)
+        return AVERROR(EINVAL);
+    if (!nb_threads)
+        nb_threads = av_cpu_count();
+
+    ff_mutex_lock(&shared_pool_lock);
+    if (shared_pool) {
+        ret = AVERROR(EEXIST);
+        goto end;
+    }
+
+    pool = av_mallocz(sizeof(*pool));
+    if (!pool || !(pool->threads = av_calloc(nb_threads, sizeof(*pool->threads)))) {
+        av_free(pool);
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    pool->refcount = 1;
+
+    for (i = 0; i < nb_threads; i++) {
+        if (ret = pthread_create(&pool->threads[i], NULL, shared_pool_worker, pool)) {
+            pool->nb_threads = i;
+            shared_pool_free(pool);
+            ret = AVERROR(ret);
+            goto end;
+        }
+    }
+    pool->nb_threads = nb_threads;
+    shared_pool      = pool;
+
+end:
+    ff_mutex_unlock(&shared_pool_lock);
+    return ret;
+}
+
+void av_thread_pool_uninit(void)
+{
+    SharedPool *pool;
+
+    ff_mutex_lock(&shared_pool_lock);
+    pool        = shared_pool;
+    shared_pool = NULL;
+    ff_mutex_unlock(&shared_pool_lock);
+
+    if (pool)
+        shared_pool_unref(pool);
+}
+
+static SharedPool *shared_pool_ref(void)
+{
+    SharedPool *pool;
+
+    ff_mutex_lock(&shared_pool_lock);
+    pool = shared_pool;
+    if (pool)
+        pool->refcount++;
+    ff_mutex_unlock(&shared_pool_lock);
+
+    return pool;
+}
+
+static void shared_execute(AVSliceThread *ctx, int nb_jobs)
+{
+    SharedPool *pool = ctx->pool;
+    int i;
+
+    ctx->nb_jobs           = nb_jobs;
+    ctx->nb_active_threads = FFMIN(nb_jobs, ctx->nb_threads);
+    atomic_store_explicit(&ctx->current_job, 0, memory_order_relaxed);
+
+    if (ctx->nb_active_threads > 1) {
+        AVSliceThread **p;
+
+        pthread_mutex_lock(&pool->mutex);
+        ctx->nb_helpers = 0;
+        ctx->queued     = 1;
+        for (p = &pool->queue; *p; p = &(*p)->next);
+        *p = ctx;
+        for (i = 1; i < ctx->nb_active_threads; i++)
+            pthread_cond_signal(&pool->cond);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    run_shared_jobs(ctx, 0);
+
+    /* all jobs have been taken, wait for the helpers still running some */
+    if (ctx->nb_active_threads > 1) {
+        pthread_mutex_lock(&pool->mutex);
+        if (ctx->queued)
+            shared_pool_dequeue(pool, ctx);
+        while (ctx->nb_running)
+            pthread_cond_wait(&ctx->done_cond, &pool->mutex);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
 int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
                               void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
                               void (*main_func)(void *priv),
@@ -116,6 +328,11 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
     if (!ctx)
         return AVERROR(ENOMEM);
 
+    /* the main function may wait for the jobs, which a busy pool could
+     * then never run: keep dedicated threads in that case */
+    if (!main_func && (ctx->pool = shared_pool_ref()))
+        nb_workers = 0;
+
     if (nb_workers && !(ctx->workers = av_calloc(nb_workers, sizeof(*ctx->workers)))) {
         av_freep(pctx);
         return AVERROR(ENOMEM);
@@ -166,6 +383,10 @@ void avpriv_slicethread_execute(AVSliceThread *ctx, int nb_jobs, int execute_mai
     int nb_workers, i, is_last = 0;
 
     av_assert0(nb_jobs > 0);
+    if (ctx->pool) {
+        shared_execute(ctx, nb_jobs);
+        return;
+    }
     ctx->nb_jobs           = nb_jobs;
     ctx->nb_active_threads = FFMIN(nb_jobs, ctx->nb_threads);
     atomic_store_explicit(&ctx->first_job, 0, memory_order_relaxed);
@@ -208,6 +429,10 @@ void avpriv_slicethread_free(AVSliceThread **pctx)
     nb_workers = ctx->nb_threads;
     if (!ctx->main_func)
         nb_workers--;
+    if (ctx->pool) {
+        shared_pool_unref(ctx->pool);
+        nb_workers = 0;
+    }
 
     ctx->finished = 1;
     for (i = 0; i < nb_workers; i++) {
@@ -252,4 +477,13 @@ void avpriv_slicethread_free(AVSliceThread **pctx)
     av_assert0(!pctx || !*pctx);
 }
 
+int av_thread_pool_init(int nb_threads)
+{
+    return AVERROR(ENOSYS);
+}
+
+void av_thread_pool_uninit(void)
+{
+}
+
 #endif /* HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS32THREADS */
@@ -0,0 +1,161 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/lfg.h"
+#include "libavutil/mem.h"
+#include "libavutil/tx.h"
+
+#define NB_TX 5
+
+static const struct {
+    enum AVTXType type;
+    const char *name;
+    size_t size;
+    double tolerance;
+} types[] = {
+    { AV_TX_FLOAT_FFT,  "float",  sizeof(AVComplexFloat),  1e-5  },
+    { AV_TX_DOUBLE_FFT, "double", sizeof(AVComplexDouble), 1e-13 },
+    { AV_TX_INT32_FFT,  "int32",  sizeof(AVComplexInt32),  0     },
+};
+
+static const int lens[] = { 2, 4, 16, 64, 1024, 48, 120 };
+
+static void get_sample(int t, const uint8_t *p, double *re, double *im)
+{
+    switch (types[t].type) {
+    case AV_TX_FLOAT_FFT:
+        *re = ((const AVComplexFloat *)p)->re;
+        *im = ((const AVComplexFloat *)p)->im;
+        break;
+    case AV_TX_DOUBLE_FFT:
+        *re = ((const AVComplexDouble *)p)->re;
+        *im = ((const AVComplexDouble *)p)->im;
+        break;
+    default:
+        *re = ((const AVComplexInt32 *)p)->re;
+        *im = ((const AVComplexInt32 *)p)->im;
+        break;
+    }
+}
+
+static void set_sample(int t, uint8_t *p, double re, double im)
+{
+    switch (types[t].type) {
+    case AV_TX_FLOAT_FFT:
+        ((AVComplexFloat *)p)->re = re;
+        ((AVComplexFloat *)p)->im = im;
+        break;
+    case AV_TX_DOUBLE_FFT:
+        ((AVComplexDouble *)p)->re = re;
+        ((AVComplexDouble *)p)->im = im;
+        break;
+    default:
+        ((AVComplexInt32 *)p)->re = lrint(re * (1 << 20));
+        ((AVComplexInt32 *)p)->im = lrint(im * (1 << 20));
+        break;
+    }
+}
+
+/* Runs NB_TX transforms through av_tx_batch() and compares them with the
+ * same transforms run one by one through the av_tx_fn on flat arrays. */
+static int test_batch(AVLFG *lfg, int t, int len, int inv, int interleaved,
+                      int inplace)
+{
+    const size_t size = types[t].size;
+    const ptrdiff_t stride = interleaved ? NB_TX*size : size;
+    const ptrdiff_t dist   = interleaved ? size : len*size;
+    uint8_t *in = NULL, *out = NULL, *ref_in = NULL, *ref_out = NULL;
+    AVTXContext *ctx = NULL;
+    av_tx_fn fn;
+    double err = 0, peak = 0;
+    int ret;
+
+    if ((ret = av_tx_init(&ctx, &fn, types[t].type, inv, len, NULL, 0)) < 0)
+        goto end;
+
+    in      = av_malloc(NB_TX*len*size);
+    out     = av_malloc(NB_TX*len*size);
+    ref_in  = av_malloc(len*size);
+    ref_out = av_malloc(len*size);
+    if (!in || !out || !ref_in || !ref_out) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    for (int i = 0; i < NB_TX*len; i++)
+        set_sample(t, in + i*size, av_lfg_get(lfg) / (double)UINT32_MAX - 0.5,
+                                   av_lfg_get(lfg) / (double)UINT32_MAX - 0.5);
+
+    if (inplace)
+        memcpy(out, in, NB_TX*len*size);
+    if ((ret = av_tx_batch(ctx, out, inplace ? out : in, stride, dist, NB_TX)) < 0)
+        goto end;
+
+    for (int i = 0; i < NB_TX; i++) {
+        for (int k = 0; k < len; k++)
+            memcpy(ref_in + k*size, in + i*dist + k*stride, size);
+        fn(ctx, ref_out, ref_in, size);
+        for (int k = 0; k < len; k++) {
+            double re, im, ref_re, ref_im;
+            get_sample(t, out + i*dist + k*stride, &re, &im);
+            get_sample(t, ref_out + k*size, &ref_re, &ref_im);
+            err  = FFMAX(err,  FFMAX(fabs(re - ref_re), fabs(im - ref_im)));
+            peak = FFMAX(peak, FFMAX(fabs(ref_re), fabs(ref_im)));
+        }
+    }
+
+    printf("%-6s len %4d %s %s %s: %s\n", types[t].name, len,
+           inv ? "inverse" : "forward",
+           interleaved ? "interleaved" : "planar     ",
+           inplace ? "in-place" : "separate",
+           err <= types[t].tolerance * peak ? "OK" : "FAIL");
+    if (err > types[t].tolerance * peak)
+        ret = 1;
+
+end:
+    av_free(in);
+    av_free(out);
+    av_free(ref_in);
+    av_free(ref_out);
+    av_tx_uninit(&ctx);
+    return ret;
+}
+
+int main(void)
+{
+    AVLFG lfg;
+    int ret = 0;
+
+    av_lfg_init(&lfg, 0xdeadbeef);
+
+    for (int t = 0; t < FF_ARRAY_ELEMS(types); t++)
+        for (int l = 0; l < FF_ARRAY_ELEMS(lens); l++)
+            for (int inv = 0; inv < 2; inv++)
+                for (int interleaved = 1; interleaved >= 0; interleaved--)
+                    for (int inplace = 0; inplace < 2; inplace++)
+                        if (test_batch(&lfg, t, lens[l], inv,
+                                       interleaved, inplace))
+                            ret = 1;
+
+    return ret;
+}
@@ -0,0 +1,53 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_THREADPOOL_H
+#define AVUTIL_THREADPOOL_H
+
+/**
+ * @file
+ * Process-wide shared worker pool.
+ *
+ * By default, every codec and filtergraph using slice threading spawns its
+ * own threads. Once the shared pool is enabled, slice threading contexts
+ * created afterwards do not spawn threads anymore, but borrow workers from
+ * the pool instead, the calling thread always taking part in the work. The
+ * thread count of each context (e.g. AVCodecContext.thread_count,
+ * AVFilterGraph.nb_threads) then only caps how many threads may work on it
+ * at the same time.
+ *
+ * Frame threading, and slice threading in the few codecs that run a main
+ * function alongside the slice jobs, keep using their own threads.
+ */
+
+/**
+ * Enable the shared worker pool.
+ *
+ * @param nb_threads number of worker threads, 0 for one per CPU core
+ * @return 0 on success, AVERROR(EEXIST) if the pool is already enabled, or
+ *         another negative AVERROR code on failure
+ */
+int av_thread_pool_init(int nb_threads);
+
+/**
+ * Disable the shared worker pool. Contexts already using it keep doing so;
+ * the worker threads exit once the last of them has been freed.
+ */
+void av_thread_pool_uninit(void);
+
+#endif /* AVUTIL_THREADPOOL_H */
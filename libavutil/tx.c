@@ -116,10 +116,50 @@ av_cold void av_tx_uninit(AVTXContext **ctx)
     av_free((*ctx)->exptab);
     av_free((*ctx)->revtab);
     av_free((*ctx)->tmp);
+    av_free((*ctx)->batch_tmp);
+    av_free((*ctx)->batch_tw);
 
     av_freep(ctx);
 }
 
+int av_tx_batch(AVTXContext *s, void *out, void *in,
+                ptrdiff_t stride, ptrdiff_t dist, int nb_tx)
+{
+    const int len = s->n*s->m;
+    uint8_t *dst = out, *src = in, *tmp_in, *tmp_out;
+    size_t size;
+
+    switch (s->type) {
+    case AV_TX_FLOAT_FFT:  size = sizeof(AVComplexFloat);  break;
+    case AV_TX_DOUBLE_FFT: size = sizeof(AVComplexDouble); break;
+    case AV_TX_INT32_FFT:  size = sizeof(AVComplexInt32);  break;
+    default:
+        return AVERROR(EINVAL);
+    }
+
+    if (s->fft_interleaved && dist == size) {
+        s->fft_interleaved(s, out, in, stride, nb_tx);
+        return 0;
+    }
+
+    if (!s->batch_tmp && !(s->batch_tmp = av_malloc(2*len*size)))
+        return AVERROR(ENOMEM);
+    tmp_in  = (uint8_t *)s->batch_tmp;
+    tmp_out = tmp_in + len*size;
+
+    for (int i = 0; i < nb_tx; i++) {
+        for (int k = 0; k < len; k++)
+            memcpy(tmp_in + k*size, src + k*stride, size);
+        s->fn(s, tmp_out, tmp_in, size);
+        for (int k = 0; k < len; k++)
+            memcpy(dst + k*stride, tmp_out + k*size, size);
+        dst += dist;
+        src += dist;
+    }
+
+    return 0;
+}
+
 av_cold int av_tx_init(AVTXContext **ctx, av_tx_fn *tx, enum AVTXType type,
                        int inv, int len, const void *scale, uint64_t flags)
 {
@@ -149,6 +189,7 @@ av_cold int av_tx_init(AVTXContext **ctx, av_tx_fn *tx, enum AVTXType type,
         goto fail;
     }
 
+    s->fn = *tx;
     *ctx = s;
 
     return 0;
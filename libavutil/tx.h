@@ -109,6 +109,35 @@ typedef void (*av_tx_fn)(AVTXContext *s, void *out, void *in, ptrdiff_t stride);
 int av_tx_init(AVTXContext **ctx, av_tx_fn *tx, enum AVTXType type,
                int inv, int len, const void *scale, uint64_t flags);
 
+/**
+ * Perform nb_tx FFTs of the length the context was initialized with in one
+ * call. Sample k of transform i is read from in + i*dist + k*stride and its
+ * result is written to out + i*dist + k*stride.
+ *
+ * For interleaved transforms, i.e. dist equal to the size of one sample, such
+ * as the columns of a 2D block, power of two lengths are handled by a kernel
+ * which runs all transforms at once. Other layouts and lengths are gathered
+ * into a temporary buffer and run one transform at a time.
+ *
+ * @param s the transform context, initialized with av_tx_init() for one of
+ *          the FFT types
+ * @param out the output array of the first transform, may be equal to in,
+ *            but must not otherwise overlap it
+ * @param in the input array of the first transform
+ * @param stride the distance in bytes between consecutive samples of one
+ *               transform
+ * @param dist the distance in bytes between the first samples of consecutive
+ *             transforms
+ * @param nb_tx the number of transforms
+ *
+ * The transforms must not overlap each other. There are no alignment
+ * constraints.
+ *
+ * @return 0 on success, a negative error code on failure
+ */
+int av_tx_batch(AVTXContext *s, void *out, void *in,
+                ptrdiff_t stride, ptrdiff_t dist, int nb_tx);
+
 /**
  * Frees a context and sets ctx to NULL, does nothing when ctx == NULL
  */
@@ -112,6 +112,19 @@ struct AVTXContext {
     FFTComplex *tmp;    /* Temporary buffer needed for all compound transforms */
     int        *pfatab; /* Input/Output mapping for compound transforms */
     int        *revtab; /* Input mapping for power of two transforms */
+
+    /* In-place power of two FFT of length m, on input mapped with revtab */
+    void (*fft_ptwo)(AVTXContext *s, FFTComplex *z);
+
+    /* Used by av_tx_batch() */
+    av_tx_fn    fn;        /* Transform function returned by av_tx_init() */
+    FFTComplex *batch_tmp; /* Gather/scatter buffers, allocated on first use */
+    FFTComplex *batch_tw;  /* Twiddles for fft_interleaved */
+
+    /* Power of two FFTs of length m on nb_tx interleaved transforms, each
+     * row of nb_tx samples being stride bytes apart, may be in-place */
+    void (*fft_interleaved)(AVTXContext *s, void *out, void *in,
+                            ptrdiff_t stride, int nb_tx);
 };
 
 /* Shared functions */
@@ -146,6 +159,9 @@ int ff_tx_init_mdct_fft_int32(AVTXContext *s, av_tx_fn *tx,
                               enum AVTXType type, int inv, int len,
                               const void *scale, uint64_t flags);
 
+/* Replace the power of two FFT with a SIMD version and adjust revtab to it */
+void ff_tx_init_float_x86(AVTXContext *s);
+
 typedef struct CosTabsInitOnce {
     void (*func)(void);
     AVOnce control;
@@ -359,6 +359,11 @@ static void (* const fft_dispatch[])(FFTComplex*) = {
     fft1024, fft2048, fft4096, fft8192, fft16384, fft32768, fft65536, fft131072
 };
 
+static void fft_ptwo(AVTXContext *s, FFTComplex *z)
+{
+    fft_dispatch[av_log2(s->m)](z);
+}
+
 #define DECL_COMP_FFT(N)                                                       \
 static void compound_fft_##N##xM(AVTXContext *s, void *_out,                   \
                                  void *_in, ptrdiff_t stride)                  \
@@ -367,7 +372,6 @@ static void compound_fft_##N##xM(AVTXContext *s, void *_out,                   \
     FFTComplex *in = _in;                                                      \
     FFTComplex *out = _out;                                                    \
     FFTComplex fft##N##in[N];                                                  \
-    void (*fftp)(FFTComplex *z) = fft_dispatch[av_log2(m)];                    \
                                                                                \
     for (int i = 0; i < m; i++) {                                              \
         for (int j = 0; j < N; j++)                                            \
@@ -376,7 +380,7 @@ static void compound_fft_##N##xM(AVTXContext *s, void *_out,                   \
     }                                                                          \
                                                                                \
     for (int i = 0; i < N; i++)                                                \
-        fftp(s->tmp + m*i);                                                    \
+        s->fft_ptwo(s, s->tmp + m*i);                                          \
                                                                                \
     for (int i = 0; i < N*m; i++)                                              \
         out[i] = s->tmp[out_map[i]];                                           \
@@ -391,12 +395,88 @@ static void monolithic_fft(AVTXContext *s, void *_out, void *_in,
 {
     FFTComplex *in = _in;
     FFTComplex *out = _out;
-    int m = s->m, mb = av_log2(m);
+    int m = s->m;
     for (int i = 0; i < m; i++)
         out[s->revtab[i]] = in[i];
-    fft_dispatch[mb](out);
+    s->fft_ptwo(s, out);
+}
+
+#if !defined(TX_INT32)
+static av_always_inline int bitrev(int i, int bits)
+{
+    int r = 0;
+    for (int j = 0; j < bits; j++)
+        r |= ((i >> j) & 1) << (bits - 1 - j);
+    return r;
+}
+
+#define ROW(base, k) ((FFTComplex *)((base) + (k)*stride))
+
+/* Radix-2 decimation in time over all transforms at once: every butterfly
+ * runs along a row of nb_tx contiguous samples, which the compiler can
+ * vectorize regardless of the transform length. */
+static void fft_interleaved(AVTXContext *s, void *_out, void *_in,
+                            ptrdiff_t stride, int nb_tx)
+{
+    const int m = s->m, bits = av_log2(m);
+    const FFTComplex *tw = s->batch_tw;
+    uint8_t *out = _out, *in = _in;
+
+    if (out == in) {
+        for (int k = 0; k < m; k++) {
+            const int r = bitrev(k, bits);
+            if (k < r) {
+                FFTComplex *a = ROW(out, k), *b = ROW(out, r);
+                for (int t = 0; t < nb_tx; t++)
+                    FFSWAP(FFTComplex, a[t], b[t]);
+            }
+        }
+    } else {
+        for (int k = 0; k < m; k++)
+            memcpy(ROW(out, bitrev(k, bits)), ROW(in, k),
+                   nb_tx*sizeof(FFTComplex));
+    }
+
+    for (int half = 1; half < m; half <<= 1) {
+        const int step = m / (2*half);
+        for (int start = 0; start < m; start += 2*half) {
+            for (int j = 0; j < half; j++) {
+                const FFTComplex w = tw[j*step];
+                FFTComplex *av_restrict a = ROW(out, start + j);
+                FFTComplex *av_restrict b = ROW(out, start + j + half);
+                for (int t = 0; t < nb_tx; t++) {
+                    FFTComplex tmp;
+                    CMUL3(tmp, b[t], w);
+                    BF(b[t].re, a[t].re, a[t].re, tmp.re);
+                    BF(b[t].im, a[t].im, a[t].im, tmp.im);
+                }
+            }
+        }
+    }
 }
 
+#undef ROW
+
+static int gen_interleaved_tw(AVTXContext *s)
+{
+    const int m = s->m;
+    const double sign = s->inv ? 1.0 : -1.0;
+
+    if (!(s->batch_tw = av_malloc((m >> 1)*sizeof(*s->batch_tw))))
+        return AVERROR(ENOMEM);
+
+    for (int j = 0; j < m >> 1; j++) {
+        const double phase = sign*2.0*M_PI*j/m;
+        s->batch_tw[j].re = RESCALE(cos(phase));
+        s->batch_tw[j].im = RESCALE(sin(phase));
+    }
+
+    s->fft_interleaved = fft_interleaved;
+
+    return 0;
+}
+#endif
+
 #define DECL_COMP_IMDCT(N)                                                     \
 static void compound_imdct_##N##xM(AVTXContext *s, void *_dst, void *_src,     \
                                    ptrdiff_t stride)                           \
@@ -406,7 +486,6 @@ static void compound_imdct_##N##xM(AVTXContext *s, void *_dst, void *_src,     \
     const int m = s->m, len8 = N*m >> 1;                                       \
     const int *in_map = s->pfatab, *out_map = in_map + N*m;                    \
     const FFTSample *src = _src, *in1, *in2;                                   \
-    void (*fftp)(FFTComplex *) = fft_dispatch[av_log2(m)];                     \
                                                                                \
     stride /= sizeof(*src); /* To convert it from bytes */                     \
     in1 = src;                                                                 \
@@ -422,7 +501,7 @@ static void compound_imdct_##N##xM(AVTXContext *s, void *_dst, void *_src,     \
     }                                                                          \
                                                                                \
     for (int i = 0; i < N; i++)                                                \
-        fftp(s->tmp + m*i);                                                    \
+        s->fft_ptwo(s, s->tmp + m*i);                                          \
                                                                                \
     for (int i = 0; i < len8; i++) {                                           \
         const int i0 = len8 + i, i1 = len8 - i - 1;                            \
@@ -447,7 +526,6 @@ static void compound_mdct_##N##xM(AVTXContext *s, void *_dst, void *_src,      \
     FFTComplex *exp = s->exptab, tmp, fft##N##in[N];                           \
     const int m = s->m, len4 = N*m, len3 = len4 * 3, len8 = len4 >> 1;         \
     const int *in_map = s->pfatab, *out_map = in_map + N*m;                    \
-    void (*fftp)(FFTComplex *) = fft_dispatch[av_log2(m)];                     \
                                                                                \
     stride /= sizeof(*dst);                                                    \
                                                                                \
@@ -468,7 +546,7 @@ static void compound_mdct_##N##xM(AVTXContext *s, void *_dst, void *_src,      \
     }                                                                          \
                                                                                \
     for (int i = 0; i < N; i++)                                                \
-        fftp(s->tmp + m*i);                                                    \
+        s->fft_ptwo(s, s->tmp + m*i);                                          \
                                                                                \
     for (int i = 0; i < len8; i++) {                                           \
         const int i0 = len8 + i, i1 = len8 - i - 1;                            \
@@ -493,7 +571,6 @@ static void monolithic_imdct(AVTXContext *s, void *_dst, void *_src,
     FFTComplex *z = _dst, *exp = s->exptab;
     const int m = s->m, len8 = m >> 1;
     const FFTSample *src = _src, *in1, *in2;
-    void (*fftp)(FFTComplex *) = fft_dispatch[av_log2(m)];
 
     stride /= sizeof(*src);
     in1 = src;
@@ -504,7 +581,7 @@ static void monolithic_imdct(AVTXContext *s, void *_dst, void *_src,
         CMUL3(z[s->revtab[i]], tmp, exp[i]);
     }
 
-    fftp(z);
+    s->fft_ptwo(s, z);
 
     for (int i = 0; i < len8; i++) {
         const int i0 = len8 + i, i1 = len8 - i - 1;
@@ -522,7 +599,6 @@ static void monolithic_mdct(AVTXContext *s, void *_dst, void *_src,
     FFTSample *src = _src, *dst = _dst;
     FFTComplex *exp = s->exptab, tmp, *z = _dst;
     const int m = s->m, len4 = m, len3 = len4 * 3, len8 = len4 >> 1;
-    void (*fftp)(FFTComplex *) = fft_dispatch[av_log2(m)];
 
     stride /= sizeof(*dst);
 
@@ -539,7 +615,7 @@ static void monolithic_mdct(AVTXContext *s, void *_dst, void *_src,
              exp[i].re, exp[i].im);
     }
 
-    fftp(z);
+    s->fft_ptwo(s, z);
 
     for (int i = 0; i < len8; i++) {
         const int i0 = len8 + i, i1 = len8 - i - 1;
@@ -622,14 +698,24 @@ int TX_NAME(ff_tx_init_mdct_fft)(AVTXContext *s, av_tx_fn *tx,
         *tx = monolithic_fft;
         if (is_mdct)
             *tx = inv ? monolithic_imdct : monolithic_mdct;
+#if !defined(TX_INT32)
+        else if ((err = gen_interleaved_tw(s)))
+            return err;
+#endif
     }
 
     if (n != 1)
         init_cos_tabs(0);
     if (m != 1) {
-        ff_tx_gen_ptwo_revtab(s);
+        if ((err = ff_tx_gen_ptwo_revtab(s)))
+            return err;
         for (int i = 4; i <= av_log2(m); i++)
             init_cos_tabs(i);
+        s->fft_ptwo = fft_ptwo;
+#ifdef TX_FLOAT
+        if (ARCH_X86)
+            ff_tx_init_float_x86(s);
+#endif
     }
 
     if (is_mdct)
@@ -0,0 +1,72 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#define TX_FLOAT
+#include "libavutil/tx_priv.h"
+#include "libavutil/attributes.h"
+#include "libavutil/cpu.h"
+#include "cpu.h"
+
+void ff_tx_fft_ptwo_float_avx(AVTXContext *s, FFTComplex *z);
+
+static const int avx_tab[] = {
+    0, 4, 1, 5, 8, 12, 9, 13, 2, 6, 3, 7, 10, 14, 11, 15
+};
+
+static int is_second_half_of_fft32(int i, int n)
+{
+    if (n <= 32)
+        return i >= 16;
+    else if (i < n/2)
+        return is_second_half_of_fft32(i, n/2);
+    else if (i < 3*n/4)
+        return is_second_half_of_fft32(i - n/2, n/4);
+    else
+        return is_second_half_of_fft32(i - 3*n/4, n/4);
+}
+
+/* The AVX FFT keeps its intermediate results in blocks of 8 reals and
+ * 8 imaginaries, so its input is mapped accordingly */
+static av_cold void gen_revtab_avx(AVTXContext *s)
+{
+    const int m = s->m, inv = s->inv;
+
+    for (int i = 0; i < m; i += 16) {
+        for (int k = 0; k < 16; k++) {
+            int j = i + k;
+            if (is_second_half_of_fft32(i, m))
+                j = i + avx_tab[k];
+            else
+                j = (j & ~7) | ((j >> 1) & 3) | ((j << 2) & 4);
+            s->revtab[-split_radix_permutation(i + k, m, inv) & (m - 1)] = j;
+        }
+    }
+}
+
+/* Only the float power of two FFT core has an assembly version so far.
+ * The MDCT pre/post rotations, the 3/5/15-point parts of the compound
+ * transforms and the double and int32 transforms still run in C. */
+av_cold void ff_tx_init_float_x86(AVTXContext *s)
+{
+    int cpu_flags = av_get_cpu_flags();
+
+    if (EXTERNAL_AVX_FAST(cpu_flags) && s->m >= 32) {
+        gen_revtab_avx(s);
+        s->fft_ptwo = ff_tx_fft_ptwo_float_avx;
+    }
+}
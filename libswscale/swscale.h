@@ -218,6 +218,39 @@ int sws_scale(struct SwsContext *c, const uint8_t *const srcSlice[],
               const int srcStride[], int srcSliceY, int srcSliceH,
               uint8_t *const dst[], const int dstStride[]);
 
+/**
+ * Scale the complete image in srcSlice and put only the rows
+ * dstSliceY to dstSliceY + dstSliceH - 1 of the result in dst.
+ *
+ * Several contexts created with identical parameters may be used to
+ * fill disjoint row ranges of the same destination image concurrently,
+ * which allows the caller to split one conversion across threads.
+ * A single context must not be used by more than one thread at a time.
+ * A call with dstSliceH set to 0 writes nothing and can be used to check
+ * whether the conversion supports this.
+ *
+ * @param c         the scaling context previously created with
+ *                  sws_getContext()
+ * @param srcSlice  the array containing the pointers to the planes of
+ *                  the whole source image
+ * @param srcStride the array containing the strides for each plane of
+ *                  the source image
+ * @param dst       the array containing the pointers to the planes of
+ *                  the whole destination image
+ * @param dstStride the array containing the strides for each plane of
+ *                  the destination image
+ * @param dstSliceY the first destination row to write, must be a multiple
+ *                  of the vertical chroma subsampling of the destination
+ * @param dstSliceH the number of destination rows to write
+ * @return          the number of rows written, AVERROR(ENOSYS) if the
+ *                  conversion configured in c cannot be split, in which
+ *                  case sws_scale() must be used, or another negative
+ *                  error code on failure
+ */
+int sws_scale_slice(struct SwsContext *c, const uint8_t *const srcSlice[],
+                    const int srcStride[], uint8_t *const dst[],
+                    const int dstStride[], int dstSliceY, int dstSliceH);
+
 /**
  * @param dstRange flag indicating the while-black range of the output (1=jpeg / 0=mpeg)
  * @param srcRange flag indicating the while-black range of the input (1=jpeg / 0=mpeg)
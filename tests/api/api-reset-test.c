@@ -0,0 +1,303 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * avcodec_reset() test.
+ * Encodes and decodes a stream with a FLAC encoder and decoder, resets them
+ * with the parameters of a second stream and checks that the second stream
+ * comes out identical to what freshly opened contexts produce.
+ */
+
+#include <string.h>
+
+#include "libavcodec/avcodec.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+
+#define NB_FRAMES 20
+
+typedef struct Stream {
+    int sample_rate;
+    uint64_t ch_layout;
+    int seed;
+} Stream;
+
+typedef struct Output {
+    uint8_t *data;
+    int size;
+    int *pkt_sizes;
+    int nb_pkts;
+    uint8_t *extradata;
+    int extradata_size;
+} Output;
+
+static const Stream streams[2] = {
+    { 44100, AV_CH_LAYOUT_STEREO, 1 },
+    { 22050, AV_CH_LAYOUT_MONO,   7 },
+};
+
+static int append(Output *out, const uint8_t *data, int size)
+{
+    int ret = av_reallocp(&out->data, out->size + size);
+    if (ret < 0)
+        return ret;
+    memcpy(out->data + out->size, data, size);
+    out->size += size;
+    return 0;
+}
+
+static int append_packet(Output *out, const AVPacket *pkt)
+{
+    int ret;
+
+    /* the last packet of the encoder only carries the final extradata */
+    if (!pkt->size)
+        return 0;
+    ret = av_reallocp_array(&out->pkt_sizes, out->nb_pkts + 1,
+                                sizeof(*out->pkt_sizes));
+    if (ret < 0)
+        return ret;
+    out->pkt_sizes[out->nb_pkts++] = pkt->size;
+    return append(out, pkt->data, pkt->size);
+}
+
+static void free_output(Output *out)
+{
+    av_freep(&out->data);
+    av_freep(&out->pkt_sizes);
+    av_freep(&out->extradata);
+    out->size = out->nb_pkts = out->extradata_size = 0;
+}
+
+static void set_params(AVCodecContext *ctx, const Stream *st)
+{
+    ctx->sample_fmt     = AV_SAMPLE_FMT_S16;
+    ctx->sample_rate    = st->sample_rate;
+    ctx->channel_layout = st->ch_layout;
+    ctx->channels       = av_get_channel_layout_nb_channels(st->ch_layout);
+    ctx->time_base      = (AVRational){ 1, st->sample_rate };
+}
+
+static int set_extradata(AVCodecContext *ctx, const Output *enc)
+{
+    av_freep(&ctx->extradata);
+    ctx->extradata_size = 0;
+    ctx->extradata = av_mallocz(enc->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!ctx->extradata)
+        return AVERROR(ENOMEM);
+    memcpy(ctx->extradata, enc->extradata, enc->extradata_size);
+    ctx->extradata_size = enc->extradata_size;
+    return 0;
+}
+
+/* Encode NB_FRAMES frames of st and drain the encoder. */
+static int encode(AVCodecContext *ctx, const Stream *st, Output *out)
+{
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *pkt  = av_packet_alloc();
+    int ret = AVERROR(ENOMEM);
+
+    if (!frame || !pkt)
+        goto end;
+
+    for (int i = 0; i <= NB_FRAMES; i++) {
+        if (i < NB_FRAMES) {
+            frame->nb_samples     = ctx->frame_size;
+            frame->format         = ctx->sample_fmt;
+            frame->channel_layout = ctx->channel_layout;
+            frame->pts            = (int64_t)i * ctx->frame_size;
+            if ((ret = av_frame_get_buffer(frame, 0)) < 0)
+                goto end;
+            for (int j = 0; j < frame->nb_samples * ctx->channels; j++)
+                ((int16_t *)frame->data[0])[j] = ((j * st->seed + i) % 97) * 300 - 15000;
+        }
+        if ((ret = avcodec_send_frame(ctx, i < NB_FRAMES ? frame : NULL)) < 0)
+            goto end;
+        av_frame_unref(frame);
+        while ((ret = avcodec_receive_packet(ctx, pkt)) >= 0) {
+            ret = append_packet(out, pkt);
+            av_packet_unref(pkt);
+            if (ret < 0)
+                goto end;
+        }
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+            goto end;
+    }
+
+    out->extradata = av_memdup(ctx->extradata, ctx->extradata_size);
+    if (!out->extradata) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    out->extradata_size = ctx->extradata_size;
+    ret = 0;
+
+end:
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    return ret;
+}
+
+/* Decode the packets produced by encode() and drain the decoder. */
+static int decode(AVCodecContext *ctx, const Output *in, Output *out)
+{
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *pkt  = av_packet_alloc();
+    int pos = 0, ret = AVERROR(ENOMEM);
+
+    if (!frame || !pkt)
+        goto end;
+
+    for (int i = 0; i <= in->nb_pkts; i++) {
+        if (i < in->nb_pkts) {
+            pkt->data = in->data + pos;
+            pkt->size = in->pkt_sizes[i];
+            pos      += pkt->size;
+        }
+        if ((ret = avcodec_send_packet(ctx, i < in->nb_pkts ? pkt : NULL)) < 0)
+            goto end;
+        while ((ret = avcodec_receive_frame(ctx, frame)) >= 0) {
+            ret = append(out, frame->data[0], frame->nb_samples * frame->channels *
+                         av_get_bytes_per_sample(frame->format));
+            av_frame_unref(frame);
+            if (ret < 0)
+                goto end;
+        }
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+            goto end;
+    }
+    ret = 0;
+
+end:
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    return ret;
+}
+
+static int compare(const char *what, const Output *a, const Output *b)
+{
+    if (a->size != b->size || memcmp(a->data, b->data, a->size) ||
+        a->extradata_size != b->extradata_size ||
+        memcmp(a->extradata, b->extradata, a->extradata_size)) {
+        av_log(NULL, AV_LOG_ERROR, "%s differs after avcodec_reset()\n", what);
+        return AVERROR_BUG;
+    }
+    return 0;
+}
+
+static int open_codec(AVCodecContext **ctx, const AVCodec *codec,
+                      const Stream *st, const Output *extradata, int frame_threads)
+{
+    int ret;
+
+    *ctx = avcodec_alloc_context3(codec);
+    if (!*ctx)
+        return AVERROR(ENOMEM);
+    set_params(*ctx, st);
+    if (extradata && (ret = set_extradata(*ctx, extradata)) < 0)
+        return ret;
+    if (frame_threads) {
+        (*ctx)->thread_count = 2;
+        (*ctx)->thread_type  = FF_THREAD_FRAME;
+    }
+    return avcodec_open2(*ctx, codec, NULL);
+}
+
+int main(void)
+{
+    const AVCodec *enc = avcodec_find_encoder(AV_CODEC_ID_FLAC);
+    const AVCodec *dec = avcodec_find_decoder(AV_CODEC_ID_FLAC);
+    AVCodecContext *ctx = NULL;
+    Output enc_ref[2] = { { 0 } }, enc_out = { 0 };
+    Output dec_ref    = { 0 }, dec_out = { 0 };
+    int ret;
+
+    if (!enc || !dec) {
+        av_log(NULL, AV_LOG_ERROR, "FLAC codec not found\n");
+        return 1;
+    }
+
+    /* reference output of freshly opened contexts */
+    for (int i = 0; i < 2; i++) {
+        if ((ret = open_codec(&ctx, enc, &streams[i], NULL, 0)) < 0 ||
+            (ret = encode(ctx, &streams[i], &enc_ref[i])) < 0)
+            goto end;
+        avcodec_free_context(&ctx);
+    }
+    if ((ret = open_codec(&ctx, dec, &streams[1], &enc_ref[1], 0)) < 0 ||
+        (ret = decode(ctx, &enc_ref[1], &dec_ref)) < 0)
+        goto end;
+    avcodec_free_context(&ctx);
+
+    /* encoder reset after draining */
+    if ((ret = open_codec(&ctx, enc, &streams[0], NULL, 0)) < 0 ||
+        (ret = encode(ctx, &streams[0], &enc_out)) < 0)
+        goto end;
+    free_output(&enc_out);
+    set_params(ctx, &streams[1]);
+    if ((ret = avcodec_reset(ctx)) < 0 ||
+        (ret = encode(ctx, &streams[1], &enc_out)) < 0 ||
+        (ret = compare("encoder output", &enc_out, &enc_ref[1])) < 0)
+        goto end;
+    avcodec_free_context(&ctx);
+
+    /* decoder reset after draining, with the extradata of the new stream */
+    if ((ret = open_codec(&ctx, dec, &streams[0], &enc_ref[0], 0)) < 0 ||
+        (ret = decode(ctx, &enc_ref[0], &dec_out)) < 0)
+        goto end;
+    free_output(&dec_out);
+    set_params(ctx, &streams[1]);
+    if ((ret = set_extradata(ctx, &enc_ref[1])) < 0 ||
+        (ret = avcodec_reset(ctx)) < 0 ||
+        (ret = decode(ctx, &enc_ref[1], &dec_out)) < 0 ||
+        (ret = compare("decoder output", &dec_out, &dec_ref)) < 0)
+        goto end;
+    avcodec_free_context(&ctx);
+    free_output(&dec_out);
+
+    /* frame-threaded decoders cannot be reset, but stay usable */
+    if ((ret = open_codec(&ctx, dec, &streams[1], &enc_ref[1], 1)) < 0)
+        goto end;
+    if (ctx->active_thread_type & FF_THREAD_FRAME) {
+        ret = avcodec_reset(ctx);
+        if (ret != AVERROR(ENOSYS)) {
+            av_log(NULL, AV_LOG_ERROR, "Resetting a frame-threaded decoder "
+                   "returned %d\n", ret);
+            ret = AVERROR_BUG;
+            goto end;
+        }
+        if ((ret = decode(ctx, &enc_ref[1], &dec_out)) < 0 ||
+            (ret = compare("frame-threaded decoder output", &dec_out, &dec_ref)) < 0)
+            goto end;
+    }
+    ret = 0;
+
+end:
+    avcodec_free_context(&ctx);
+    for (int i = 0; i < 2; i++)
+        free_output(&enc_ref[i]);
+    free_output(&enc_out);
+    free_output(&dec_ref);
+    free_output(&dec_out);
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Test failed: %s\n", av_err2str(ret));
+    return ret < 0;
+}
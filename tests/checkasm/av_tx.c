@@ -0,0 +1,89 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "config.h"
+
+#include <float.h>
+
+#include "libavutil/cpu.h"
+#include "libavutil/internal.h"
+#include "libavutil/mem.h"
+#define TX_FLOAT
+#include "libavutil/tx_priv.h"
+#include "checkasm.h"
+
+#define MAX_LEN 4096
+
+static void randomize_complex(FFTComplex *buf, int len)
+{
+    for (int i = 0; i < len; i++) {
+        double bmg[2];
+        av_bmg_get(&checkasm_lfg, bmg);
+        buf[i].re = bmg[0];
+        buf[i].im = bmg[1];
+    }
+}
+
+static void check_fft_ptwo(const FFTComplex *in, int len)
+{
+    LOCAL_ALIGNED_32(FFTComplex, cdst, [MAX_LEN]);
+    LOCAL_ALIGNED_32(FFTComplex, odst, [MAX_LEN]);
+    AVTXContext *ref = NULL, *new = NULL;
+    av_tx_fn fn;
+    const float scale = 1.0f;
+    int cpu_flags = av_get_cpu_flags();
+
+    declare_func(void, AVTXContext *s, FFTComplex *z);
+
+    /* The reference context has to use the C revtab as well */
+    av_force_cpu_flags(0);
+    if (av_tx_init(&ref, &fn, AV_TX_FLOAT_FFT, 0, len, &scale, 0) < 0)
+        goto end;
+    av_force_cpu_flags(cpu_flags);
+    if (av_tx_init(&new, &fn, AV_TX_FLOAT_FFT, 0, len, &scale, 0) < 0)
+        goto end;
+
+    if (check_func(new->fft_ptwo, "fft_ptwo_%d", len)) {
+        for (int i = 0; i < len; i++) {
+            cdst[ref->revtab[i]] = in[i];
+            odst[new->revtab[i]] = in[i];
+        }
+        call_ref(ref, cdst);
+        call_new(new, odst);
+        if (!float_near_abs_eps_array((float *)cdst, (float *)odst,
+                                      len * 16 * FLT_EPSILON, 2 * len))
+            fail();
+        bench_new(new, odst);
+    }
+
+end:
+    av_force_cpu_flags(cpu_flags);
+    av_tx_uninit(&ref);
+    av_tx_uninit(&new);
+}
+
+void checkasm_check_av_tx(void)
+{
+    LOCAL_ALIGNED_32(FFTComplex, in, [MAX_LEN]);
+
+    randomize_complex(in, MAX_LEN);
+
+    for (int len = 32; len <= MAX_LEN; len <<= 1)
+        check_fft_ptwo(in, len);
+    report("fft_ptwo");
+}
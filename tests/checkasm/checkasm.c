@@ -186,6 +186,7 @@ static const struct {
     { "sw_scale", checkasm_check_sw_scale },
 #endif
 #if CONFIG_AVUTIL
+        { "av_tx", checkasm_check_av_tx },
         { "fixed_dsp", checkasm_check_fixed_dsp },
         { "float_dsp", checkasm_check_float_dsp },
 #endif
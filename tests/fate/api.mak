@@ -3,6 +3,11 @@ fate-api-flac: $(APITESTSDIR)/api-flac-test$(EXESUF)
 fate-api-flac: CMD = run $(APITESTSDIR)/api-flac-test$(EXESUF)
 fate-api-flac: CMP = null
 
+FATE_API_LIBAVCODEC-$(call ENCDEC, FLAC, FLAC) += fate-api-reset
+fate-api-reset: $(APITESTSDIR)/api-reset-test$(EXESUF)
+fate-api-reset: CMD = run $(APITESTSDIR)/api-reset-test$(EXESUF)
+fate-api-reset: CMP = null
+
 FATE_API_SAMPLES_LIBAVFORMAT-$(call DEMDEC, FLV, FLV) += fate-api-band
 fate-api-band: $(APITESTSDIR)/api-band-test$(EXESUF)
 fate-api-band: CMD = run $(APITESTSDIR)/api-band-test$(EXESUF) $(TARGET_SAMPLES)/mpeg4/resize_down-up.h263
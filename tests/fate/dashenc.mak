@@ -0,0 +1,37 @@
+# Every version of the manifest, written to the output pipe after each
+# segment, with irregular segment durations and a sliding window. The wall
+# clock times of the live manifest are left out.
+FATE_DASHENC-$(call ALLYES, DASH_MUXER MP4_MUXER LAVFI_INDEV TESTSRC_FILTER MPEG4_ENCODER PIPE_PROTOCOL) += fate-dash-manifest-updates
+fate-dash-manifest-updates: CMD = ffmpeg -f lavfi -i testsrc=s=64x48:r=10:d=12 -c:v mpeg4 \
+  -force_key_frames "expr:eq(mod(n,7),0)+lt(t,6)*eq(mod(n,11),0)" -flags +bitexact -fflags +bitexact \
+  -f dash -seg_duration 1 -window_size 3 -extra_window_size 1 \
+  -init_seg_name tests/data/fate/dash-manifest-updates-init-\$$RepresentationID\$$.m4s \
+  -media_seg_name tests/data/fate/dash-manifest-updates-\$$RepresentationID\$$-\$$Number\$$.m4s \
+  pipe:1 | grep -v -e availabilityStartTime -e publishTime
+
+# Two representations encoded twice, with the options $(2) and $(3), each
+# run in its own subdirectory of $(1) with the same relative segment names.
+# The manifests and all segments of both runs must match, and the manifests
+# of the second run are checked against the reference.
+DASH_PARITY_ENC = ffmpeg -f lavfi -i testsrc=s=64x48:r=10:d=6 -map 0 -map 0 -c:v mpeg4 -s:v:1 32x24 \
+  -force_key_frames "expr:eq(mod(n,7),0)" -flags +bitexact -fflags +bitexact \
+  -f dash -seg_duration 1 -window_size 3 \
+  -init_seg_name init-\$$RepresentationID\$$.m4s -media_seg_name chunk-\$$RepresentationID\$$-\$$Number\$$.m4s \
+  $(1) pipe:1 | grep -v -e availabilityStartTime -e publishTime
+DASH_PARITY = rm -rf $(1); mkdir -p $(1)/ref $(1)/test; \
+  (cd $(1)/ref  && $(call DASH_PARITY_ENC,$(2)) > manifests) && \
+  (cd $(1)/test && $(call DASH_PARITY_ENC,$(3)) > manifests) && \
+  for f in $$(ls $(1)/ref); do cmp $(1)/ref/$$f $(1)/test/$$f || echo $$f differs; done; \
+  cat $(1)/test/manifests
+
+# segments muxed on the calling thread and by mux workers
+FATE_DASHENC-$(call ALLYES, DASH_MUXER MP4_MUXER LAVFI_INDEV TESTSRC_FILTER MPEG4_ENCODER PIPE_PROTOCOL) += fate-dash-mux-workers
+fate-dash-mux-workers: CMD = $(call DASH_PARITY,$(TARGET_PATH)/tests/data/fate/dash-mux-workers-segments,,-mux_workers 1)
+
+# streamed segments buffered in memory and written chunk by chunk
+FATE_DASHENC-$(call ALLYES, DASH_MUXER MP4_MUXER LAVFI_INDEV TESTSRC_FILTER MPEG4_ENCODER PIPE_PROTOCOL) += fate-dash-direct-chunks
+fate-dash-direct-chunks: CMD = $(call DASH_PARITY,$(TARGET_PATH)/tests/data/fate/dash-direct-chunks-segments, \
+  -streaming 1 -frag_type every_frame,-streaming 1 -frag_type every_frame -direct_chunks 1)
+
+FATE_FFMPEG += $(FATE_DASHENC-yes)
+fate-dashenc: $(FATE_DASHENC-yes)
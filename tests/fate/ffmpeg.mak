@@ -30,6 +30,12 @@ fate-ffmpeg-filter_complex: CMD = framecrc -filter_complex color=d=1:r=5 -fflags
 FATE_FFMPEG-$(call ALLYES, AEVALSRC_FILTER ASETNSAMPLES_FILTER AC3_FIXED_ENCODER) += fate-ffmpeg-filter_complex_audio
 fate-ffmpeg-filter_complex_audio: CMD = framecrc -filter_complex "aevalsrc=0:d=0.1,asetnsamples=1537" -c ac3_fixed
 
+# Chunks encoded in parallel must be muxed in order
+FATE_FFMPEG-$(call ALLYES, IMAGE2_DEMUXER PGMYUV_DECODER MPEG4_ENCODER) += fate-ffmpeg-enc_chunks
+fate-ffmpeg-enc_chunks: $(VREF)
+fate-ffmpeg-enc_chunks: CMD = framecrc -f image2 -c:v pgmyuv -i $(TARGET_PATH)/tests/vsynth1/%02d.pgm \
+  -c:v mpeg4 -qscale 10 -enc_chunks 2 -enc_chunk_size 10
+
 # Ticket 6375, use case of NoX
 FATE_SAMPLES_FFMPEG-$(call ALLYES, MOV_DEMUXER PNG_DECODER ALAC_DECODER PCM_S16LE_ENCODER RAWVIDEO_ENCODER) += fate-ffmpeg-attached_pics
 fate-ffmpeg-attached_pics: CMD = threads=2 framecrc -i $(TARGET_SAMPLES)/lossless-audio/inside.m4a -c:a pcm_s16le -max_muxing_queue_size 16
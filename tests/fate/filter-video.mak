@@ -445,6 +445,12 @@ fate-filter-concat: CMD = framecrc -filter_complex_script $(TARGET_PATH)/tests/d
 fate-filter-concat-vfr: tests/data/filtergraphs/concat-vfr
 fate-filter-concat-vfr: CMD = framecrc -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/concat-vfr
 
+# the branches after split/asplit activated concurrently
+FATE_FILTER-$(call ALLYES, TESTSRC_FILTER FORMAT_FILTER SPLIT_FILTER SCALE_FILTER HFLIP_FILTER NEGATE_FILTER VFLIP_FILTER \
+                           SINE_FILTER AFORMAT_FILTER ASPLIT_FILTER VOLUME_FILTER ANULL_FILTER) += fate-filter-branch-threads
+fate-filter-branch-threads: libavfilter/tests/branch$(EXESUF)
+fate-filter-branch-threads: CMD = run libavfilter/tests/branch$(EXESUF)
+
 FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER FPS_FILTER MPDECIMATE_FILTER) += fate-filter-mpdecimate
 fate-filter-mpdecimate: CMD = framecrc -lavfi testsrc2=r=2:d=10,fps=3,mpdecimate -r 3 -pix_fmt yuv420p
 
@@ -493,6 +499,19 @@ fate-filter-scale200: CMD = video_filter "scale=w=200:h=200"
 FATE_FILTER_VSYNTH-$(CONFIG_SCALE_FILTER) += fate-filter-scale500
 fate-filter-scale500: CMD = video_filter "scale=w=500:h=500"
 
+# same scales with the output rows split across slice threads
+FATE_FILTER_VSYNTH-$(CONFIG_SCALE_FILTER) += fate-filter-scale200-threads
+fate-filter-scale200-threads: CMD = video_filter "scale=w=200:h=200" -filter_threads 4
+
+FATE_FILTER_VSYNTH-$(CONFIG_SCALE_FILTER) += fate-filter-scale500-threads
+fate-filter-scale500-threads: CMD = video_filter "scale=w=500:h=500" -filter_threads 4
+
+FATE_FILTER_VSYNTH-$(CONFIG_SCALELADDER_FILTER) += fate-filter-scaleladder fate-filter-scaleladder-threads fate-filter-scaleladder-interl
+fate-filter-scaleladder: CMD = framecrc -c:v pgmyuv -i $(SRC) -frames:v 5 -filter_complex "scaleladder=sizes=200x150|300x200|96x72:flags=bicubic+bitexact[a][b][c]" -map "[a]" -map "[b]" -map "[c]"
+fate-filter-scaleladder-threads: CMD = framecrc -c:v pgmyuv -i $(SRC) -frames:v 5 -filter_complex_threads 4 -filter_complex "scaleladder=sizes=200x150|300x200|96x72:flags=bicubic+bitexact[a][b][c]" -map "[a]" -map "[b]" -map "[c]"
+fate-filter-scaleladder-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-scaleladder
+fate-filter-scaleladder-interl: CMD = framecrc -c:v pgmyuv -i $(SRC) -frames:v 5 -filter_complex "scaleladder=sizes=200x150|96x72:flags=bicubic+bitexact:interl=1[a][b]" -map "[a]" -map "[b]"
+
 FATE_FILTER_VSYNTH-$(CONFIG_SCALE2REF_FILTER) += fate-filter-scale2ref_keep_aspect
 fate-filter-scale2ref_keep_aspect: tests/data/filtergraphs/scale2ref_keep_aspect
 fate-filter-scale2ref_keep_aspect: CMD = framemd5 -frames:v 5 -filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/scale2ref_keep_aspect -map "[main]"
@@ -666,6 +685,9 @@ FATE_FILTER_VSYNTH-$(CONFIG_STEREO3D_FILTER) += $(FATE_STEREO3D)
 FATE_FILTER_VSYNTH-$(CONFIG_THUMBNAIL_FILTER) += fate-filter-thumbnail
 fate-filter-thumbnail: CMD = video_filter "thumbnail=10"
 
+FATE_FILTER_VSYNTH-$(CONFIG_THUMBNAIL_FILTER) += fate-filter-thumbnail-low-memory
+fate-filter-thumbnail-low-memory: CMD = video_filter "thumbnail=10:low_memory=1"
+
 FATE_FILTER_VSYNTH-$(CONFIG_TILE_FILTER) += fate-filter-tile
 fate-filter-tile: CMD = video_filter "tile=3x3:nb_frames=5:padding=7:margin=2"
 
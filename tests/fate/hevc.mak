@@ -256,6 +256,26 @@ fate-hevc-bsf-mp4toannexb: REF = 1873662a3af1848c37e4eb25722c8df9
 fate-hevc-skiploopfilter: CMD = framemd5 -skip_loop_filter nokey -i $(TARGET_SAMPLES)/hevc-conformance/SAO_D_Samsung_5.bit -sws_flags bitexact
 FATE_HEVC += fate-hevc-skiploopfilter
 
+# WPP rows decoded in parallel within each frame thread
+define FATE_HEVC_WPP_THREADS_TEST
+FATE_HEVC += fate-hevc-wpp-threads-$(1)
+fate-hevc-wpp-threads-$(1): CMD = threads=2 thread_type=frame framecrc -wpp_threads 3 -flags unaligned -vsync drop -i $(TARGET_SAMPLES)/hevc-conformance/$(1).bit -pix_fmt yuv420p
+fate-hevc-wpp-threads-$(1): REF = $(SRC_PATH)/tests/ref/fate/hevc-conformance-$(1)
+endef
+
+$(foreach N,$(filter WPP_%,$(HEVC_SAMPLES)),$(eval $(call FATE_HEVC_WPP_THREADS_TEST,$(N))))
+
+# tiles of a slice decoded in parallel; run on every 8-bit conformance sample
+# so that the tile layouts mixed with dependent slice segments or WPP, which
+# must fall back to sequential decoding, are covered as well
+define FATE_HEVC_TILE_THREADS_TEST
+FATE_HEVC += fate-hevc-tile-threads-$(1)
+fate-hevc-tile-threads-$(1): CMD = threads=3 thread_type=slice framecrc -flags unaligned -vsync drop -i $(TARGET_SAMPLES)/hevc-conformance/$(1).bit -pix_fmt yuv420p
+fate-hevc-tile-threads-$(1): REF = $(SRC_PATH)/tests/ref/fate/hevc-conformance-$(1)
+endef
+
+$(foreach N,$(HEVC_SAMPLES),$(eval $(call FATE_HEVC_TILE_THREADS_TEST,$(N))))
+
 FATE_HEVC-$(call DEMDEC, HEVC, HEVC) += $(FATE_HEVC)
 FATE_HEVC-$(call ALLYES, HEVC_DEMUXER HEVC_DECODER LARGE_TESTS) += $(FATE_HEVC_LARGE)
 
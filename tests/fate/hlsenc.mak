@@ -111,3 +111,25 @@ fate-hls-fmp4_ac3: CMD = probeaudiostream $(TARGET_PATH)/tests/data/now_ac3.mp4
 
 FATE_SAMPLES_FFMPEG += $(FATE_HLSENC-yes)
 fate-hlsenc: $(FATE_HLSENC-yes)
+
+# Every version of the playlist, written to the output pipe after each
+# segment, with irregular segment durations and a sliding window.
+FATE_HLSENC_PLAYLIST-$(call ALLYES, HLS_MUXER MPEGTS_MUXER LAVFI_INDEV TESTSRC_FILTER MPEG4_ENCODER PIPE_PROTOCOL) += fate-hls-playlist-updates
+fate-hls-playlist-updates: CMD = ffmpeg -f lavfi -i testsrc=s=64x48:r=10:d=12 -c:v mpeg4 \
+  -force_key_frames "expr:eq(mod(n,7),0)+lt(t,6)*eq(mod(n,11),0)" -flags +bitexact -fflags +bitexact \
+  -f hls -hls_time 1 -hls_list_size 4 -hls_segment_filename $(TARGET_PATH)/tests/data/fate/hls-playlist-updates-%d.ts pipe:1
+
+# The same playlists and segments written from the background I/O thread
+FATE_HLSENC_PLAYLIST-$(call ALLYES, HLS_MUXER MPEGTS_MUXER LAVFI_INDEV TESTSRC_FILTER MPEG4_ENCODER PIPE_PROTOCOL) += fate-hls-async-io
+fate-hls-async-io: fate-hls-playlist-updates
+fate-hls-async-io: CMD = rm -rf $(TARGET_PATH)/tests/data/fate/hls-async-io-segments; mkdir -p $(TARGET_PATH)/tests/data/fate/hls-async-io-segments; \
+  ffmpeg -f lavfi -i testsrc=s=64x48:r=10:d=12 -c:v mpeg4 \
+  -force_key_frames "expr:eq(mod(n,7),0)+lt(t,6)*eq(mod(n,11),0)" -flags +bitexact -fflags +bitexact \
+  -f hls -hls_time 1 -hls_list_size 4 -hls_async_io 4 \
+  -hls_segment_filename $(TARGET_PATH)/tests/data/fate/hls-async-io-segments/hls-playlist-updates-%d.ts pipe:1 && \
+  for f in $$(ls $(TARGET_PATH)/tests/data/fate | grep ^hls-playlist-updates-); do \
+    cmp $(TARGET_PATH)/tests/data/fate/$$f $(TARGET_PATH)/tests/data/fate/hls-async-io-segments/$$f || echo $$f differs; done
+fate-hls-async-io: REF = $(SRC_PATH)/tests/ref/fate/hls-playlist-updates
+
+FATE_FFMPEG += $(FATE_HLSENC_PLAYLIST-yes)
+fate-hlsenc: $(FATE_HLSENC_PLAYLIST-yes)
@@ -154,6 +154,10 @@ fate-twofish: libavutil/tests/twofish$(EXESUF)
 fate-twofish: CMD = run libavutil/tests/twofish$(EXESUF)
 fate-twofish: CMP = null
 
+FATE_LIBAVUTIL += fate-tx
+fate-tx: libavutil/tests/tx$(EXESUF)
+fate-tx: CMD = run libavutil/tests/tx$(EXESUF)
+
 FATE_LIBAVUTIL += fate-xtea
 fate-xtea: libavutil/tests/xtea$(EXESUF)
 fate-xtea: CMD = run libavutil/tests/xtea$(EXESUF)
@@ -124,3 +124,12 @@ fate-mov-faststart-4gb-overflow: CMP = oneline
 fate-mov-faststart-4gb-overflow: REF = bc875921f151871e787c4b4023269b29
 
 fate-mov-mp4-with-mov-in24-ver: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_entries stream=codec_name -select_streams 1 $(TARGET_SAMPLES)/mov/mp4-with-mov-in24-ver.mp4
+
+# Timestamps and durations of a fragmented file, with the fragment index built
+# by reading every moof and by scanning the moof atoms.
+FATE_MOV_FRAG_PROBE = fate-mov-frag-probe fate-mov-frag-probe-scan
+FATE_FFPROBE-$(call ENCDEC2, MPEG4, MP2, MOV) += $(FATE_MOV_FRAG_PROBE)
+$(FATE_MOV_FRAG_PROBE): fate-lavf-mp4_frag
+$(FATE_MOV_FRAG_PROBE): REF = $(SRC_PATH)/tests/ref/fate/mov-frag-probe
+fate-mov-frag-probe: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -show_entries stream=start_pts,duration_ts:format=duration:packet=stream_index,pts,dts,duration,pos,size,flags -print_format compact -bitexact $(TARGET_PATH)/tests/data/lavf/lavf.mp4_frag
+fate-mov-frag-probe-scan: CMD = run ffprobe$(PROGSSUF)$(EXESUF) -scan_fragments 1 -show_entries stream=start_pts,duration_ts:format=duration:packet=stream_index,pts,dts,duration,pos,size,flags -print_format compact -bitexact $(TARGET_PATH)/tests/data/lavf/lavf.mp4_frag
@@ -15,5 +15,15 @@ FATE_MPEG4-$(call DEMDEC, M4V, MPEG4) += fate-m4v  fate-m4v-cfr
 fate-m4v:     CMD = framecrc -flags +bitexact -idct simple -i $(TARGET_SAMPLES)/mpeg4/demo.m4v
 fate-m4v-cfr: CMD = framecrc -flags +bitexact -idct simple -i $(TARGET_SAMPLES)/mpeg4/demo.m4v -vf fps=5
 
+# Encoding closed GOPs in parallel must give the same output as a single thread
+MPEG4_CGOP_ENC = framemd5 -f image2 -c:v pgmyuv -i $(TARGET_PATH)/tests/vsynth1/%02d.pgm \
+                 -c:v mpeg4 -qscale 10 -flags +cgop -sc_threshold 1000000000 -bf 0 -g 12
+
+FATE_MPEG4_FFMPEG-$(call ENCDEC, MPEG4 PGMYUV, FRAMEMD5 IMAGE2) += fate-mpeg4-cgop fate-mpeg4-cgop-threads
+fate-mpeg4-cgop:         CMD = $(MPEG4_CGOP_ENC) -threads 1
+fate-mpeg4-cgop-threads: CMD = $(MPEG4_CGOP_ENC) -threads 4 -thread_type frame
+$(FATE_MPEG4_FFMPEG-yes): $(VREF)
+
 FATE_SAMPLES_AVCONV += $(FATE_MPEG4-yes)
-fate-mpeg4: $(FATE_MPEG4-yes)
+FATE_AVCONV += $(FATE_MPEG4_FFMPEG-yes)
+fate-mpeg4: $(FATE_MPEG4-yes) $(FATE_MPEG4_FFMPEG-yes)
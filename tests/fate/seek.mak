@@ -176,6 +176,7 @@ FATE_SEEK_LAVF-$(call ENCDEC,  MJPEG,                 IMAGE2)      += jpg
 FATE_SEEK_LAVF-$(call ENCDEC2, MPEG4,      MP2,       MATROSKA)    += mkv
 FATE_SEEK_LAVF-$(call ENCDEC,  ADPCM_YAMAHA,          MMF)         += mmf
 FATE_SEEK_LAVF-$(call ENCDEC2, MPEG4,      PCM_ALAW,  MOV)         += mov
+FATE_SEEK_LAVF-$(call ENCDEC2, MPEG4,      MP2,       MOV)         += mp4_frag
 FATE_SEEK_LAVF-$(call ENCDEC2, MPEG1VIDEO, MP2,       MPEG1SYSTEM MPEGPS) += mpg
 FATE_SEEK_LAVF-$(call ENCDEC,  PCM_MULAW,             PCM_MULAW)   += ul
 FATE_SEEK_LAVF-$(call ENCDEC2, MPEG2VIDEO, PCM_S16LE, MXF)         += mxf
@@ -217,6 +218,7 @@ fate-seek-lavf-jpg:      SRC = images/jpg/%02d.jpg
 fate-seek-lavf-mkv:      SRC = lavf/lavf.mkv
 fate-seek-lavf-mmf:      SRC = lavf/lavf.mmf
 fate-seek-lavf-mov:      SRC = lavf/lavf.mov
+fate-seek-lavf-mp4_frag: SRC = lavf/lavf.mp4_frag
 fate-seek-lavf-mpg:      SRC = lavf/lavf.mpg
 fate-seek-lavf-ul:       SRC = lavf/lavf.ul
 fate-seek-lavf-mxf:      SRC = lavf/lavf.mxf
@@ -246,6 +248,33 @@ fate-seek-lavf-y4m:      SRC = lavf/lavf.y4m
 
 FATE_SEEK += $(FATE_SEEK_LAVF-yes:%=fate-seek-lavf-%)
 
+# same seeks through the background read-ahead of the protocol layer
+FATE_SEEK_PREFETCH-$(call ENCDEC2, MPEG4, MP2, NUT) += fate-seek-prefetch-nut
+fate-seek-prefetch-nut: fate-lavf-nut libavformat/tests/seek$(EXESUF)
+fate-seek-prefetch-nut: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.nut -prefetch_size 4096
+fate-seek-prefetch-nut: REF = $(SRC_PATH)/tests/ref/seek/lavf-nut
+
+# same seeks with the index built on demand instead of at open time
+FATE_SEEK_LAZY_INDEX-$(call ENCDEC2, MPEG4, PCM_ALAW, MOV) += fate-seek-lazy-index-mov
+fate-seek-lazy-index-mov: fate-lavf-mov libavformat/tests/seek$(EXESUF)
+fate-seek-lazy-index-mov: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.mov -lazy_index 1
+fate-seek-lazy-index-mov: REF = $(SRC_PATH)/tests/ref/seek/lavf-mov
+
+# same seeks with the sample tables taken from the index cache created by
+# the first run
+FATE_SEEK_INDEX_CACHE-$(call ENCDEC2, MPEG4, PCM_ALAW, MOV) += fate-seek-index-cache-mov
+fate-seek-index-cache-mov: fate-lavf-mov libavformat/tests/seek$(EXESUF)
+fate-seek-index-cache-mov: CMD = rm -f $(TARGET_PATH)/tests/data/fate/seek-index-cache-mov.idx; \
+  run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.mov -index_cache $(TARGET_PATH)/tests/data/fate/seek-index-cache-mov.idx > /dev/null; \
+  run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.mov -index_cache $(TARGET_PATH)/tests/data/fate/seek-index-cache-mov.idx
+fate-seek-index-cache-mov: REF = $(SRC_PATH)/tests/ref/seek/lavf-mov
+
+# same seeks with the fragment index built by scanning the moof atoms
+FATE_SEEK_SCAN_FRAGMENTS-$(call ENCDEC2, MPEG4, MP2, MOV) += fate-seek-scan-fragments-mp4_frag
+fate-seek-scan-fragments-mp4_frag: fate-lavf-mp4_frag libavformat/tests/seek$(EXESUF)
+fate-seek-scan-fragments-mp4_frag: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.mp4_frag -scan_fragments 1
+fate-seek-scan-fragments-mp4_frag: REF = $(SRC_PATH)/tests/ref/seek/lavf-mp4_frag
+
 # extra files
 
 FATE_SEEK_EXTRA-$(CONFIG_MP3_DEMUXER)   += fate-seek-extra-mp3
@@ -272,6 +301,8 @@ $(FATE_SEEK) $(FATE_SAMPLES_SEEK): CMD = run libavformat/tests/seek$(EXESUF) $(T
 $(FATE_SEEK) $(FATE_SAMPLES_SEEK): fate-seek-%: fate-%
 fate-seek-%: REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%=%)
 
-FATE_AVCONV += $(FATE_SEEK)
+FATE_AVCONV += $(FATE_SEEK) $(FATE_SEEK_PREFETCH-yes) $(FATE_SEEK_SCAN_FRAGMENTS-yes) $(FATE_SEEK_INDEX_CACHE-yes) \
+               $(FATE_SEEK_LAZY_INDEX-yes)
 FATE_SAMPLES_AVCONV += $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
-fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
+fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA) $(FATE_SEEK_PREFETCH-yes) $(FATE_SEEK_SCAN_FRAGMENTS-yes) \
+               $(FATE_SEEK_INDEX_CACHE-yes) $(FATE_SEEK_LAZY_INDEX-yes)